@@ -0,0 +1,126 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "client-registry.h"
+
+#include <string.h>
+
+#include "metrics.h"
+
+static metric_t metric_clients = METRIC_GAUGE_INIT("lwm2m.clients");
+
+
+int client_registry_init(client_registry_t *registry)
+{
+    registry->names = rest_hash_new();
+    registry->ids = rest_hash_new();
+    if (registry->names == NULL || registry->ids == NULL)
+    {
+        client_registry_cleanup(registry);
+        return -1;
+    }
+
+    metrics_register(&metric_clients);
+
+    return 0;
+}
+
+void client_registry_cleanup(client_registry_t *registry)
+{
+    if (registry->ids != NULL)
+    {
+        metrics_add(&metric_clients, -(int64_t)registry->ids->count);
+        rest_hash_delete(registry->ids);
+        registry->ids = NULL;
+    }
+
+    if (registry->names != NULL)
+    {
+        rest_hash_delete(registry->names);
+        registry->names = NULL;
+    }
+}
+
+int client_registry_add(client_registry_t *registry, lwm2m_client_t *client)
+{
+    lwm2m_client_t *previous;
+    size_t count = registry->ids->count;
+
+    // Re-registration reuses client structure, but its name is reallocated
+    previous = rest_hash_get(registry->ids, &client->internalID, sizeof(client->internalID));
+    if (previous != NULL && previous != client)
+    {
+        client_registry_remove(registry, client->internalID);
+        count = registry->ids->count;
+    }
+
+    if (rest_hash_put(registry->ids, &client->internalID, sizeof(client->internalID), client) != 0)
+    {
+        return -1;
+    }
+
+    if (rest_hash_put(registry->names, client->name, strlen(client->name), client) != 0)
+    {
+        rest_hash_remove(registry->ids, &client->internalID, sizeof(client->internalID));
+        metrics_add(&metric_clients, (int64_t)registry->ids->count - count);
+        return -1;
+    }
+
+    metrics_add(&metric_clients, (int64_t)registry->ids->count - count);
+
+    return 0;
+}
+
+lwm2m_client_t *client_registry_remove(client_registry_t *registry, uint16_t client_id)
+{
+    lwm2m_client_t *client;
+    size_t name_length;
+
+    client = rest_hash_remove(registry->ids, &client_id, sizeof(client_id));
+    if (client == NULL)
+    {
+        return NULL;
+    }
+
+    // Name may already be taken over by a newer registration
+    name_length = strlen(client->name);
+    if (rest_hash_get(registry->names, client->name, name_length) == client)
+    {
+        rest_hash_remove(registry->names, client->name, name_length);
+    }
+
+    metrics_add(&metric_clients, -1);
+
+    return client;
+}
+
+lwm2m_client_t *client_registry_find_name(const client_registry_t *registry, const char *name)
+{
+    if (name == NULL)
+    {
+        return NULL;
+    }
+
+    return rest_hash_get(registry->names, name, strlen(name));
+}
+
+lwm2m_client_t *client_registry_find_id(const client_registry_t *registry, uint16_t client_id)
+{
+    return rest_hash_get(registry->ids, &client_id, sizeof(client_id));
+}
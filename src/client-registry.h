@@ -0,0 +1,98 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include <stdint.h>
+
+#include <liblwm2m.h>
+
+#include "rest-hash.h"
+
+
+/*
+ * Index of registered LwM2M clients by endpoint name and by internal ID.
+ * Clients are owned by the LwM2M context, registry only references them and
+ * has to be updated from the monitoring callback, before wakaama frees the
+ * client. Registry is not thread-safe.
+ */
+typedef struct
+{
+    rest_hash_t *names;
+    rest_hash_t *ids;
+} client_registry_t;
+
+/**
+ * Initialises empty client registry.
+ *
+ * @param[in]  registry  Pointer to the client registry
+ *
+ * @return 0 on success, -1 on error
+ */
+int client_registry_init(client_registry_t *registry);
+
+/**
+ * Releases registry resources, indexed clients are not freed.
+ *
+ * @param[in]  registry  Pointer to the client registry
+ */
+void client_registry_cleanup(client_registry_t *registry);
+
+/**
+ * Indexes (or re-indexes after registration update) the client.
+ *
+ * @param[in]  registry  Pointer to the client registry
+ * @param[in]  client    Registered client
+ *
+ * @return 0 on success, -1 on allocation error
+ */
+int client_registry_add(client_registry_t *registry, lwm2m_client_t *client);
+
+/**
+ * Removes the client from the registry.
+ *
+ * @param[in]  registry   Pointer to the client registry
+ * @param[in]  client_id  Internal ID of the client
+ *
+ * @return Removed client or NULL if client was not indexed
+ */
+lwm2m_client_t *client_registry_remove(client_registry_t *registry, uint16_t client_id);
+
+/**
+ * Finds client by endpoint name.
+ *
+ * @param[in]  registry  Pointer to the client registry
+ * @param[in]  name      Endpoint name
+ *
+ * @return Client or NULL if not found
+ */
+lwm2m_client_t *client_registry_find_name(const client_registry_t *registry, const char *name);
+
+/**
+ * Finds client by internal ID.
+ *
+ * @param[in]  registry   Pointer to the client registry
+ * @param[in]  client_id  Internal ID of the client
+ *
+ * @return Client or NULL if not found
+ */
+lwm2m_client_t *client_registry_find_id(const client_registry_t *registry, uint16_t client_id);
+
+#endif // CLIENT_REGISTRY_H
@@ -0,0 +1,294 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "client-snapshot.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+static metric_t metric_publications = METRIC_COUNTER_INIT("lwm2m.snapshot_publications");
+static metric_t metric_build_us_max = METRIC_GAUGE_INIT("lwm2m.snapshot_build_us_max");
+
+
+static void client_record_acquire(client_record_t *record)
+{
+    __atomic_add_fetch(&record->refcount, 1, __ATOMIC_RELAXED);
+}
+
+void client_record_release(client_record_t *record)
+{
+    if (record == NULL || __atomic_sub_fetch(&record->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    free(record->name);
+    free(record->type);
+    free(record->uris);
+    free(record);
+}
+
+static client_record_t *client_record_new(const lwm2m_client_t *client)
+{
+    client_record_t *record;
+    lwm2m_client_object_t *obj;
+    lwm2m_list_t *ins;
+    size_t count = 0;
+
+    for (obj = client->objectList; obj != NULL; obj = obj->next)
+    {
+        count++;
+        for (ins = obj->instanceList; ins != NULL; ins = ins->next)
+        {
+            count++;
+        }
+    }
+
+    record = calloc(1, sizeof(client_record_t));
+    if (record == NULL)
+    {
+        return NULL;
+    }
+
+    record->refcount = 1;
+    record->binding = client->binding;
+    record->lifetime = client->lifetime;
+    record->name = strdup(client->name);
+    record->type = client->type != NULL ? strdup(client->type) : NULL;
+    record->uris = calloc(count > 0 ? count : 1, sizeof(client_record_uri_t));
+    if (record->name == NULL || record->uris == NULL
+        || (client->type != NULL && record->type == NULL))
+    {
+        client_record_release(record);
+        return NULL;
+    }
+
+    for (obj = client->objectList; obj != NULL; obj = obj->next)
+    {
+        if (obj->instanceList == NULL)
+        {
+            record->uris[record->uri_count].object_id = obj->id;
+            record->uri_count++;
+        }
+
+        for (ins = obj->instanceList; ins != NULL; ins = ins->next)
+        {
+            record->uris[record->uri_count].object_id = obj->id;
+            record->uris[record->uri_count].instance_id = ins->id;
+            record->uris[record->uri_count].has_instance = true;
+            record->uri_count++;
+        }
+    }
+
+    return record;
+}
+
+static client_snapshot_t *client_snapshot_new(size_t count)
+{
+    client_snapshot_t *snapshot;
+
+    snapshot = calloc(1, sizeof(client_snapshot_t));
+    if (snapshot == NULL)
+    {
+        return NULL;
+    }
+
+    snapshot->records = calloc(count > 0 ? count : 1, sizeof(client_record_t *));
+    if (snapshot->records == NULL)
+    {
+        free(snapshot);
+        return NULL;
+    }
+
+    snapshot->refcount = 1;
+
+    return snapshot;
+}
+
+void client_snapshot_release(client_snapshot_t *snapshot)
+{
+    size_t i;
+
+    if (snapshot == NULL || __atomic_sub_fetch(&snapshot->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+
+    for (i = 0; i < snapshot->count; i++)
+    {
+        client_record_release(snapshot->records[i]);
+    }
+
+    free(snapshot->records);
+    free(snapshot);
+}
+
+int client_publisher_init(client_publisher_t *publisher)
+{
+    memset(publisher, 0, sizeof(client_publisher_t));
+
+    pthread_mutex_init(&publisher->mutex, NULL);
+
+    publisher->records = rest_hash_new();
+    publisher->current = client_snapshot_new(0);
+    if (publisher->records == NULL || publisher->current == NULL)
+    {
+        client_publisher_cleanup(publisher);
+        return -1;
+    }
+
+    metrics_register(&metric_publications);
+    metrics_register(&metric_build_us_max);
+
+    return 0;
+}
+
+void client_publisher_cleanup(client_publisher_t *publisher)
+{
+    rest_hash_entry_t *entry, *next;
+
+    if (publisher->records != NULL)
+    {
+        for (entry = rest_hash_next(publisher->records, NULL); entry != NULL; entry = next)
+        {
+            next = rest_hash_next(publisher->records, entry);
+            client_record_release(entry->data);
+        }
+
+        rest_hash_delete(publisher->records);
+        publisher->records = NULL;
+    }
+
+    client_snapshot_release(publisher->current);
+    publisher->current = NULL;
+
+    pthread_mutex_destroy(&publisher->mutex);
+}
+
+int client_publisher_update(client_publisher_t *publisher, const lwm2m_client_t *client)
+{
+    client_record_t *record, *previous;
+
+    record = client_record_new(client);
+    if (record == NULL)
+    {
+        return -1;
+    }
+
+    previous = rest_hash_get(publisher->records, &client->internalID, sizeof(client->internalID));
+    if (rest_hash_put(publisher->records, &client->internalID, sizeof(client->internalID),
+                      record) != 0)
+    {
+        client_record_release(record);
+        return -1;
+    }
+
+    client_record_release(previous);
+    publisher->dirty = true;
+
+    return 0;
+}
+
+void client_publisher_remove(client_publisher_t *publisher, uint16_t client_id)
+{
+    client_record_t *record;
+
+    record = rest_hash_remove(publisher->records, &client_id, sizeof(client_id));
+    if (record != NULL)
+    {
+        client_record_release(record);
+        publisher->dirty = true;
+    }
+}
+
+client_record_t *client_publisher_get_record(client_publisher_t *publisher, uint16_t client_id)
+{
+    client_record_t *record;
+
+    record = rest_hash_get(publisher->records, &client_id, sizeof(client_id));
+    if (record != NULL)
+    {
+        client_record_acquire(record);
+    }
+
+    return record;
+}
+
+int64_t client_publisher_publish(client_publisher_t *publisher, int64_t now_us)
+{
+    client_snapshot_t *snapshot, *previous;
+    rest_hash_entry_t *entry;
+    int64_t holdoff;
+
+    if (!publisher->dirty)
+    {
+        return -1;
+    }
+
+    holdoff = publisher->published_us + publisher->build_us * CLIENT_SNAPSHOT_COST_RATIO - now_us;
+    if (holdoff > 0)
+    {
+        return holdoff;
+    }
+
+    snapshot = client_snapshot_new(publisher->records->count);
+    if (snapshot == NULL)
+    {
+        // Keep serving previous snapshot and retry a bit later
+        return 1000;
+    }
+
+    // Records are modified only by the calling (shard) thread
+    for (entry = rest_hash_next(publisher->records, NULL); entry != NULL;
+         entry = rest_hash_next(publisher->records, entry))
+    {
+        client_record_acquire(entry->data);
+        snapshot->records[snapshot->count++] = entry->data;
+    }
+
+    pthread_mutex_lock(&publisher->mutex);
+    previous = publisher->current;
+    publisher->current = snapshot;
+    pthread_mutex_unlock(&publisher->mutex);
+
+    client_snapshot_release(previous);
+
+    publisher->dirty = false;
+    publisher->published_us = metrics_time_us();
+    publisher->build_us = publisher->published_us - now_us;
+
+    metrics_add(&metric_publications, 1);
+    metrics_max(&metric_build_us_max, publisher->build_us);
+
+    return -1;
+}
+
+client_snapshot_t *client_publisher_acquire(client_publisher_t *publisher)
+{
+    client_snapshot_t *snapshot;
+
+    pthread_mutex_lock(&publisher->mutex);
+    snapshot = publisher->current;
+    __atomic_add_fetch(&snapshot->refcount, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&publisher->mutex);
+
+    return snapshot;
+}
@@ -0,0 +1,167 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CLIENT_SNAPSHOT_H
+#define CLIENT_SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <liblwm2m.h>
+
+#include "rest-hash.h"
+
+/*
+ * Publication is deferred until the time since the previous one is at least
+ * this many times longer than building a snapshot took, i.e. publishing uses
+ * at most ~1/CLIENT_SNAPSHOT_COST_RATIO of the shard thread time.
+ */
+#define CLIENT_SNAPSHOT_COST_RATIO 10
+
+
+typedef struct
+{
+    uint16_t object_id;
+    uint16_t instance_id;
+    bool has_instance;
+} client_record_uri_t;
+
+/*
+ * Immutable copy of registered client state. Records are replaced, never
+ * modified, when registration changes.
+ */
+typedef struct
+{
+    uint32_t refcount;
+    char *name;
+    char *type;
+    lwm2m_binding_t binding;
+    uint32_t lifetime;
+    size_t uri_count;
+    client_record_uri_t *uris;
+} client_record_t;
+
+typedef struct
+{
+    uint32_t refcount;
+    size_t count;
+    client_record_t **records;
+} client_snapshot_t;
+
+/*
+ * Publisher keeps current record of every client (updated by the shard
+ * thread from the monitoring callback) and periodically publishes snapshot
+ * of all records. Snapshots can be acquired from any thread without the
+ * shard lock, current snapshot pointer is guarded by its own mutex, which is
+ * held only to swap the pointer or take a reference.
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    client_snapshot_t *current;
+    rest_hash_t *records;
+    bool dirty;
+    int64_t published_us;
+    int64_t build_us;
+} client_publisher_t;
+
+/**
+ * Initialises publisher with an empty snapshot.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ *
+ * @return 0 on success, -1 on error
+ */
+int client_publisher_init(client_publisher_t *publisher);
+
+/**
+ * Releases publisher resources. Acquired snapshots and records stay valid
+ * until released.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ */
+void client_publisher_cleanup(client_publisher_t *publisher);
+
+/**
+ * Replaces record of the client after registration or registration update.
+ * Must be called from the shard thread while holding the shard lock.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ * @param[in]  client     Registered client
+ *
+ * @return 0 on success, -1 on allocation error
+ */
+int client_publisher_update(client_publisher_t *publisher, const lwm2m_client_t *client);
+
+/**
+ * Removes record of deregistered client. Must be called from the shard
+ * thread while holding the shard lock.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ * @param[in]  client_id  Internal ID of the client
+ */
+void client_publisher_remove(client_publisher_t *publisher, uint16_t client_id);
+
+/**
+ * Finds current record of the client. Must be called while holding the
+ * shard lock.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ * @param[in]  client_id  Internal ID of the client
+ *
+ * @return Referenced record (release with client_record_release()) or NULL
+ */
+client_record_t *client_publisher_get_record(client_publisher_t *publisher, uint16_t client_id);
+
+/**
+ * Publishes new snapshot if records have changed and publication is not
+ * deferred. Must be called from the shard thread.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ * @param[in]  now_us     Current monotonic time in microseconds
+ *
+ * @return Microseconds until deferred publication or -1 if nothing is pending
+ */
+int64_t client_publisher_publish(client_publisher_t *publisher, int64_t now_us);
+
+/**
+ * Takes reference to the latest published snapshot.
+ *
+ * @param[in]  publisher  Pointer to the publisher
+ *
+ * @return Referenced snapshot (release with client_snapshot_release())
+ */
+client_snapshot_t *client_publisher_acquire(client_publisher_t *publisher);
+
+/**
+ * Drops snapshot reference, last reference frees the snapshot.
+ *
+ * @param[in]  snapshot  Pointer to the snapshot
+ */
+void client_snapshot_release(client_snapshot_t *snapshot);
+
+/**
+ * Drops record reference, last reference frees the record.
+ *
+ * @param[in]  record  Pointer to the record
+ */
+void client_record_release(client_record_t *record);
+
+#endif // CLIENT_SNAPSHOT_H
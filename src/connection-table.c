@@ -0,0 +1,285 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOG_MODULE LOG_MODULE_COAP
+
+#include "connection-table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "metrics.h"
+
+static metric_t metric_connections = METRIC_GAUGE_INIT("coap.connections");
+static metric_t metric_connections_created = METRIC_COUNTER_INIT("coap.connections_created");
+static metric_t metric_connections_evicted = METRIC_COUNTER_INIT("coap.connections_evicted");
+
+static void connection_queue_unlink(connection_queue_t *queue, connection_entry_t *entry)
+{
+    if (entry->previous != NULL)
+    {
+        entry->previous->next = entry->next;
+    }
+    else
+    {
+        queue->head = entry->next;
+    }
+
+    if (entry->next != NULL)
+    {
+        entry->next->previous = entry->previous;
+    }
+    else
+    {
+        queue->tail = entry->previous;
+    }
+
+    entry->previous = NULL;
+    entry->next = NULL;
+}
+
+static void connection_queue_append(connection_queue_t *queue, connection_entry_t *entry)
+{
+    entry->previous = queue->tail;
+    entry->next = NULL;
+
+    if (queue->tail != NULL)
+    {
+        queue->tail->next = entry;
+    }
+    else
+    {
+        queue->head = entry;
+    }
+    queue->tail = entry;
+}
+
+static connection_queue_t *connection_entry_queue(connection_table_t *table,
+                                                  connection_entry_t *entry)
+{
+    if (entry->owned)
+    {
+        return NULL;
+    }
+
+    return entry->released ? &table->released : &table->idle;
+}
+
+static void connection_entry_free(connection_table_t *table, connection_entry_t *entry)
+{
+    connection_t *connection = entry->connection;
+
+    rest_hash_remove(table->addresses, &connection->addr, connection->addrLen);
+
+    // connection_free() releases the whole list, detach it first
+    connection->next = NULL;
+    connection_free(connection);
+    free(entry);
+
+    metrics_add(&metric_connections, -1);
+}
+
+int connection_table_init(connection_table_t *table, time_t idle_timeout)
+{
+    memset(table, 0, sizeof(connection_table_t));
+
+    table->idle_timeout = idle_timeout;
+    table->addresses = rest_hash_new();
+    table->owners = rest_hash_new();
+    if (table->addresses == NULL || table->owners == NULL)
+    {
+        connection_table_cleanup(table);
+        return -1;
+    }
+
+    metrics_register(&metric_connections);
+    metrics_register(&metric_connections_created);
+    metrics_register(&metric_connections_evicted);
+
+    return 0;
+}
+
+void connection_table_cleanup(connection_table_t *table)
+{
+    rest_hash_entry_t *hash_entry, *next;
+
+    if (table->addresses != NULL)
+    {
+        for (hash_entry = rest_hash_next(table->addresses, NULL); hash_entry != NULL; hash_entry = next)
+        {
+            next = rest_hash_next(table->addresses, hash_entry);
+            connection_entry_free(table, hash_entry->data);
+        }
+
+        rest_hash_delete(table->addresses);
+        table->addresses = NULL;
+    }
+
+    if (table->owners != NULL)
+    {
+        rest_hash_delete(table->owners);
+        table->owners = NULL;
+    }
+
+    memset(&table->idle, 0, sizeof(table->idle));
+    memset(&table->released, 0, sizeof(table->released));
+}
+
+connection_t *connection_table_get(connection_table_t *table, int sock,
+                                   struct sockaddr_storage *addr, socklen_t addr_len, time_t now)
+{
+    connection_entry_t *entry;
+    connection_queue_t *queue;
+
+    entry = rest_hash_get(table->addresses, addr, addr_len);
+    if (entry != NULL)
+    {
+        entry->last_seen = now;
+
+        queue = connection_entry_queue(table, entry);
+        if (queue != NULL)
+        {
+            // Keep queues ordered by activity, so that sweep only checks heads
+            connection_queue_unlink(queue, entry);
+            connection_queue_append(queue, entry);
+        }
+
+        return entry->connection;
+    }
+
+    entry = calloc(1, sizeof(connection_entry_t));
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    entry->connection = connection_new_incoming(NULL, sock, (struct sockaddr *)addr, addr_len);
+    if (entry->connection == NULL)
+    {
+        free(entry);
+        return NULL;
+    }
+
+    if (rest_hash_put(table->addresses, addr, addr_len, entry) != 0)
+    {
+        connection_free(entry->connection);
+        free(entry);
+        return NULL;
+    }
+
+    entry->last_seen = now;
+    connection_queue_append(&table->idle, entry);
+
+    metrics_add(&metric_connections_created, 1);
+    metrics_add(&metric_connections, 1);
+
+    return entry->connection;
+}
+
+void connection_table_claim(connection_table_t *table, uint16_t client_id,
+                            connection_t *connection, time_t now)
+{
+    connection_entry_t *entry, *previous;
+    connection_queue_t *queue;
+
+    entry = rest_hash_get(table->addresses, &connection->addr, connection->addrLen);
+    if (entry == NULL)
+    {
+        log_message(LOG_LEVEL_WARN, "[CONNECTION] Client %d session is unknown\n", client_id);
+        return;
+    }
+
+    previous = rest_hash_get(table->owners, &client_id, sizeof(client_id));
+    if (previous == entry)
+    {
+        return;
+    }
+
+    if (previous != NULL)
+    {
+        // Client has moved to another address (e.g. NAT rebinding)
+        connection_table_release(table, client_id, now);
+    }
+
+    queue = connection_entry_queue(table, entry);
+    if (queue != NULL)
+    {
+        connection_queue_unlink(queue, entry);
+    }
+
+    if (rest_hash_put(table->owners, &client_id, sizeof(client_id), entry) != 0)
+    {
+        connection_queue_append(&table->idle, entry);
+        return;
+    }
+
+    entry->owned = true;
+    entry->released = false;
+    entry->owner_id = client_id;
+}
+
+void connection_table_release(connection_table_t *table, uint16_t client_id, time_t now)
+{
+    connection_entry_t *entry;
+
+    entry = rest_hash_remove(table->owners, &client_id, sizeof(client_id));
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    entry->owned = false;
+    entry->released = true;
+    entry->last_seen = now;
+    connection_queue_append(&table->released, entry);
+}
+
+static size_t connection_queue_sweep(connection_table_t *table, connection_queue_t *queue,
+                                     time_t timeout, time_t now)
+{
+    connection_entry_t *entry;
+    size_t evicted = 0;
+
+    while (queue->head != NULL && now - queue->head->last_seen >= timeout)
+    {
+        entry = queue->head;
+        connection_queue_unlink(queue, entry);
+        connection_entry_free(table, entry);
+        evicted++;
+    }
+
+    return evicted;
+}
+
+size_t connection_table_sweep(connection_table_t *table, time_t now)
+{
+    size_t evicted;
+
+    evicted = connection_queue_sweep(table, &table->idle, table->idle_timeout, now);
+    evicted += connection_queue_sweep(table, &table->released, CONNECTION_RELEASE_GRACE, now);
+
+    if (evicted > 0)
+    {
+        log_message(LOG_LEVEL_DEBUG, "[CONNECTION] Evicted %zu connections\n", evicted);
+        metrics_add(&metric_connections_evicted, evicted);
+    }
+
+    return evicted;
+}
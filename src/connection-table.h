@@ -0,0 +1,127 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef CONNECTION_TABLE_H
+#define CONNECTION_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "connection.h"
+#include "rest-hash.h"
+
+/*
+ * Released connections may still be referenced by pending CoAP transactions,
+ * therefore they are kept for at least MAX_TRANSMIT_WAIT (RFC 7252) seconds.
+ */
+#define CONNECTION_RELEASE_GRACE 93
+
+
+typedef struct connection_entry_t
+{
+    struct connection_entry_t *previous;
+    struct connection_entry_t *next;
+    connection_t *connection;
+    time_t last_seen;
+    bool owned;
+    bool released;
+    uint16_t owner_id;
+} connection_entry_t;
+
+typedef struct
+{
+    connection_entry_t *head;
+    connection_entry_t *tail;
+} connection_queue_t;
+
+typedef struct
+{
+    rest_hash_t *addresses;
+    rest_hash_t *owners;
+    connection_queue_t idle;
+    connection_queue_t released;
+    time_t idle_timeout;
+} connection_table_t;
+
+/**
+ * Initialises connection table, which maps peer addresses to connections.
+ *
+ * @param[in]  table         Pointer to the connection table
+ * @param[in]  idle_timeout  Seconds after which unowned connection is evicted
+ *
+ * @return 0 on success, -1 on error
+ */
+int connection_table_init(connection_table_t *table, time_t idle_timeout);
+
+/**
+ * Frees all connections and releases table resources.
+ *
+ * @param[in]  table  Pointer to the connection table
+ */
+void connection_table_cleanup(connection_table_t *table);
+
+/**
+ * Finds connection of the peer address or creates a new one.
+ *
+ * @param[in]  table     Pointer to the connection table
+ * @param[in]  sock      Socket on which the packet was received
+ * @param[in]  addr      Peer address
+ * @param[in]  addr_len  Peer address length
+ * @param[in]  now       Current (monotonic) time in seconds
+ *
+ * @return Pointer to the connection or NULL on error
+ */
+connection_t *connection_table_get(connection_table_t *table, int sock,
+                                   struct sockaddr_storage *addr, socklen_t addr_len, time_t now);
+
+/**
+ * Marks connection as owned by registered client, owned connections are
+ * never evicted. Connection previously owned by the same client is released.
+ *
+ * @param[in]  table       Pointer to the connection table
+ * @param[in]  client_id   Internal ID of the client
+ * @param[in]  connection  Client session connection
+ * @param[in]  now         Current (monotonic) time in seconds
+ */
+void connection_table_claim(connection_table_t *table, uint16_t client_id,
+                            connection_t *connection, time_t now);
+
+/**
+ * Releases connection owned by deregistered or timed out client, it will be
+ * evicted after CONNECTION_RELEASE_GRACE seconds of inactivity.
+ *
+ * @param[in]  table      Pointer to the connection table
+ * @param[in]  client_id  Internal ID of the client
+ * @param[in]  now        Current (monotonic) time in seconds
+ */
+void connection_table_release(connection_table_t *table, uint16_t client_id, time_t now);
+
+/**
+ * Evicts expired unowned connections.
+ *
+ * @param[in]  table  Pointer to the connection table
+ * @param[in]  now    Current (monotonic) time in seconds
+ *
+ * @return Number of evicted connections
+ */
+size_t connection_table_sweep(connection_table_t *table, time_t now);
+
+#endif // CONNECTION_TABLE_H
@@ -0,0 +1,230 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOG_MODULE LOG_MODULE_COAP
+
+#include "event-loop.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "logging.h"
+
+#define EVENT_LOOP_MAX_EVENTS 16
+
+static void event_loop_drain(int fd, uint32_t events, void *context)
+{
+    uint64_t value;
+
+    while (read(fd, &value, sizeof(value)) == sizeof(value))
+    {
+    }
+}
+
+static int event_loop_watch(event_loop_t *loop, int fd,
+                            event_loop_callback_t callback, void *context)
+{
+    event_loop_handler_t *handler;
+    struct epoll_event event;
+
+    handler = malloc(sizeof(event_loop_handler_t));
+    if (handler == NULL)
+    {
+        return -1;
+    }
+
+    handler->fd = fd;
+    handler->callback = callback;
+    handler->context = context;
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = handler;
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "epoll_ctl() error: %s\n", strerror(errno));
+        free(handler);
+        return -1;
+    }
+
+    handler->next = loop->handlers;
+    loop->handlers = handler;
+
+    return 0;
+}
+
+int event_loop_init(event_loop_t *loop)
+{
+    memset(loop, 0, sizeof(event_loop_t));
+    loop->wakeup_fd = -1;
+    loop->timer_fd = -1;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "epoll_create1() error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    loop->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->wakeup_fd < 0 || loop->timer_fd < 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "Failed to create event descriptors: %s\n", strerror(errno));
+        event_loop_cleanup(loop);
+        return -1;
+    }
+
+    if (event_loop_watch(loop, loop->wakeup_fd, event_loop_drain, NULL) != 0
+        || event_loop_watch(loop, loop->timer_fd, event_loop_drain, NULL) != 0)
+    {
+        event_loop_cleanup(loop);
+        return -1;
+    }
+
+    return 0;
+}
+
+void event_loop_cleanup(event_loop_t *loop)
+{
+    event_loop_handler_t *handler;
+
+    while (loop->handlers != NULL)
+    {
+        handler = loop->handlers;
+        loop->handlers = handler->next;
+        free(handler);
+    }
+
+    if (loop->timer_fd >= 0)
+    {
+        close(loop->timer_fd);
+        loop->timer_fd = -1;
+    }
+
+    if (loop->wakeup_fd >= 0)
+    {
+        close(loop->wakeup_fd);
+        loop->wakeup_fd = -1;
+    }
+
+    if (loop->epoll_fd >= 0)
+    {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+}
+
+int event_loop_add(event_loop_t *loop, int fd, event_loop_callback_t callback, void *context)
+{
+    return event_loop_watch(loop, fd, callback, context);
+}
+
+void event_loop_remove(event_loop_t *loop, int fd)
+{
+    event_loop_handler_t *handler, *previous = NULL;
+
+    for (handler = loop->handlers; handler != NULL; handler = handler->next)
+    {
+        if (handler->fd == fd)
+        {
+            epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+            if (previous == NULL)
+            {
+                loop->handlers = handler->next;
+            }
+            else
+            {
+                previous->next = handler->next;
+            }
+
+            free(handler);
+            return;
+        }
+
+        previous = handler;
+    }
+}
+
+void event_loop_wakeup(event_loop_t *loop)
+{
+    uint64_t value = 1;
+
+    // Counter overflow (EAGAIN) means that a wakeup is already pending
+    if (write(loop->wakeup_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    {
+        log_message(LOG_LEVEL_ERROR, "Failed to wake up event loop: %s\n", strerror(errno));
+    }
+}
+
+int event_loop_set_timeout(event_loop_t *loop, const struct timespec *timeout)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value = *timeout;
+
+    // Zero value disarms the timer, expire as soon as possible instead
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+    {
+        spec.it_value.tv_nsec = 1;
+    }
+
+    if (timerfd_settime(loop->timer_fd, 0, &spec, NULL) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "timerfd_settime() error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int event_loop_run(event_loop_t *loop)
+{
+    struct epoll_event events[EVENT_LOOP_MAX_EVENTS];
+    event_loop_handler_t *handler;
+    int count, i;
+
+    count = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, -1);
+    if (count < 0)
+    {
+        if (errno == EINTR)
+        {
+            return 0;
+        }
+
+        log_message(LOG_LEVEL_ERROR, "epoll_wait() error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        handler = events[i].data.ptr;
+        handler->callback(handler->fd, events[i].events, handler->context);
+    }
+
+    return count;
+}
@@ -0,0 +1,113 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <time.h>
+
+
+typedef void (*event_loop_callback_t)(int fd, uint32_t events, void *context);
+
+typedef struct event_loop_handler_t
+{
+    struct event_loop_handler_t *next;
+    int fd;
+    event_loop_callback_t callback;
+    void *context;
+} event_loop_handler_t;
+
+typedef struct
+{
+    int epoll_fd;
+    int wakeup_fd;
+    int timer_fd;
+    event_loop_handler_t *handlers;
+} event_loop_t;
+
+/**
+ * Creates epoll instance along with wakeup (eventfd) and deadline (timerfd)
+ * file descriptors, which are watched internally.
+ *
+ * @param[in]  loop  Pointer to the event loop
+ *
+ * @return 0 on success, -1 on error
+ */
+int event_loop_init(event_loop_t *loop);
+
+/**
+ * Closes all event loop file descriptors and releases registered handlers.
+ * Watched file descriptors are not closed.
+ *
+ * @param[in]  loop  Pointer to the event loop
+ */
+void event_loop_cleanup(event_loop_t *loop);
+
+/**
+ * Starts watching file descriptor for readability.
+ *
+ * @param[in]  loop      Pointer to the event loop
+ * @param[in]  fd        File descriptor to be watched
+ * @param[in]  callback  Function called from event_loop_run() once fd is ready
+ * @param[in]  context   Pointer passed to the callback
+ *
+ * @return 0 on success, -1 on error
+ */
+int event_loop_add(event_loop_t *loop, int fd, event_loop_callback_t callback, void *context);
+
+/**
+ * Stops watching file descriptor.
+ *
+ * @param[in]  loop  Pointer to the event loop
+ * @param[in]  fd    File descriptor which was added with event_loop_add()
+ */
+void event_loop_remove(event_loop_t *loop, int fd);
+
+/**
+ * Interrupts event_loop_run() waiting in another thread. Safe to be called
+ * from any thread at any time.
+ *
+ * @param[in]  loop  Pointer to the event loop
+ */
+void event_loop_wakeup(event_loop_t *loop);
+
+/**
+ * Sets deadline after which event_loop_run() returns even if no file
+ * descriptor becomes ready.
+ *
+ * @param[in]  loop     Pointer to the event loop
+ * @param[in]  timeout  Time until deadline, zero means "as soon as possible"
+ *
+ * @return 0 on success, -1 on error
+ */
+int event_loop_set_timeout(event_loop_t *loop, const struct timespec *timeout);
+
+/**
+ * Waits until any watched file descriptor is ready, wakeup is requested or
+ * deadline expires, and calls related callbacks.
+ *
+ * @param[in]  loop  Pointer to the event loop
+ *
+ * @return Number of handled events, or -1 on error (interruption by signal
+ *         is not considered an error)
+ */
+int event_loop_run(event_loop_t *loop);
+
+#endif // EVENT_LOOP_H
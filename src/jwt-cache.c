@@ -0,0 +1,186 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#include "jwt-cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void jwt_cache_unlink(jwt_cache_t *cache, jwt_cache_entry_t *entry)
+{
+    if (entry->previous != NULL)
+    {
+        entry->previous->next = entry->next;
+    }
+    else
+    {
+        cache->head = entry->next;
+    }
+
+    if (entry->next != NULL)
+    {
+        entry->next->previous = entry->previous;
+    }
+    else
+    {
+        cache->tail = entry->previous;
+    }
+
+    entry->previous = NULL;
+    entry->next = NULL;
+}
+
+// Head is the most recently used entry
+static void jwt_cache_link(jwt_cache_t *cache, jwt_cache_entry_t *entry)
+{
+    entry->previous = NULL;
+    entry->next = cache->head;
+
+    if (cache->head != NULL)
+    {
+        cache->head->previous = entry;
+    }
+    else
+    {
+        cache->tail = entry;
+    }
+    cache->head = entry;
+}
+
+static void jwt_cache_evict(jwt_cache_t *cache, jwt_cache_entry_t *entry)
+{
+    jwt_cache_unlink(cache, entry);
+    rest_hash_remove(cache->tokens, entry->token, entry->token_length);
+
+    free(entry->token);
+    free(entry);
+}
+
+jwt_cache_t *jwt_cache_new(size_t capacity)
+{
+    jwt_cache_t *cache;
+
+    cache = calloc(1, sizeof(jwt_cache_t));
+    if (cache == NULL)
+    {
+        return NULL;
+    }
+
+    cache->tokens = rest_hash_new();
+    if (cache->tokens == NULL)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    cache->capacity = capacity;
+    pthread_mutex_init(&cache->mutex, NULL);
+
+    return cache;
+}
+
+void jwt_cache_delete(jwt_cache_t *cache)
+{
+    while (cache->head != NULL)
+    {
+        jwt_cache_evict(cache, cache->head);
+    }
+
+    rest_hash_delete(cache->tokens);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+bool jwt_cache_get(jwt_cache_t *cache, const char *token, void **user, time_t *issuing_time)
+{
+    jwt_cache_entry_t *entry;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = rest_hash_get(cache->tokens, token, strlen(token));
+    if (entry != NULL)
+    {
+        jwt_cache_unlink(cache, entry);
+        jwt_cache_link(cache, entry);
+
+        *user = entry->user;
+        *issuing_time = entry->issuing_time;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    return entry != NULL;
+}
+
+void jwt_cache_put(jwt_cache_t *cache, const char *token, void *user, time_t issuing_time)
+{
+    jwt_cache_entry_t *entry;
+    size_t token_length = strlen(token);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    // Concurrent requests with the same token may both miss
+    if (rest_hash_get(cache->tokens, token, token_length) != NULL)
+    {
+        pthread_mutex_unlock(&cache->mutex);
+        return;
+    }
+
+    while (cache->tail != NULL && cache->tokens->count >= cache->capacity)
+    {
+        jwt_cache_evict(cache, cache->tail);
+    }
+
+    entry = calloc(1, sizeof(jwt_cache_entry_t));
+    if (entry == NULL || (entry->token = strdup(token)) == NULL)
+    {
+        free(entry);
+        pthread_mutex_unlock(&cache->mutex);
+        return;
+    }
+
+    entry->token_length = token_length;
+    entry->user = user;
+    entry->issuing_time = issuing_time;
+
+    if (rest_hash_put(cache->tokens, token, token_length, entry) != 0)
+    {
+        free(entry->token);
+        free(entry);
+        pthread_mutex_unlock(&cache->mutex);
+        return;
+    }
+    jwt_cache_link(cache, entry);
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void jwt_cache_remove(jwt_cache_t *cache, const char *token)
+{
+    jwt_cache_entry_t *entry;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    entry = rest_hash_get(cache->tokens, token, strlen(token));
+    if (entry != NULL)
+    {
+        jwt_cache_evict(cache, entry);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
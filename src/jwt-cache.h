@@ -0,0 +1,103 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef JWT_CACHE_H
+#define JWT_CACHE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "rest-hash.h"
+
+#define JWT_CACHE_SIZE 1024
+
+typedef struct jwt_cache_entry_t
+{
+    struct jwt_cache_entry_t *previous;
+    struct jwt_cache_entry_t *next;
+    char *token;
+    size_t token_length;
+    void *user;
+    time_t issuing_time;
+} jwt_cache_entry_t;
+
+/*
+ * Bounded LRU cache of verified access tokens, so signature verification and
+ * grant parsing is done once per token instead of once per request. The cache
+ * is thread-safe.
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    rest_hash_t *tokens;
+    jwt_cache_entry_t *head;
+    jwt_cache_entry_t *tail;
+    size_t capacity;
+} jwt_cache_t;
+
+/**
+ * Creates token cache.
+ *
+ * @param[in]  capacity  Maximum number of cached tokens, least recently used
+ *                       ones are evicted first
+ *
+ * @return Pointer to a new cache or NULL on error
+ */
+jwt_cache_t *jwt_cache_new(size_t capacity);
+
+/**
+ * Releases the cache, cached users are not released. Cache is not cleared in
+ * place: once users or the secret key change, it is replaced with a new one.
+ *
+ * @param[in]  cache  Pointer to the cache
+ */
+void jwt_cache_delete(jwt_cache_t *cache);
+
+/**
+ * Finds verified token.
+ *
+ * @param[in]  cache         Pointer to the cache
+ * @param[in]  token         Access token
+ * @param[out] user          User the token was issued to
+ * @param[out] issuing_time  Token issuing time
+ *
+ * @return true if the token is cached
+ */
+bool jwt_cache_get(jwt_cache_t *cache, const char *token, void **user, time_t *issuing_time);
+
+/**
+ * Stores verified token.
+ *
+ * @param[in]  cache         Pointer to the cache
+ * @param[in]  token         Access token
+ * @param[in]  user          User the token was issued to
+ * @param[in]  issuing_time  Token issuing time
+ */
+void jwt_cache_put(jwt_cache_t *cache, const char *token, void *user, time_t issuing_time);
+
+/**
+ * Removes token from the cache, e.g. once it expires.
+ *
+ * @param[in]  cache  Pointer to the cache
+ * @param[in]  token  Access token
+ */
+void jwt_cache_remove(jwt_cache_t *cache, const char *token);
+
+#endif // JWT_CACHE_H
@@ -17,86 +17,529 @@
  *
  */
 
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <sys/time.h>
 
 #include "logging.h"
+#include "metrics.h"
+
+#define LOGGING_IDLE_WAIT_MS 100
+
+/*
+ * Ring buffer slot, sequence tells whether the slot is free for the producer
+ * at the same position (sequence == position) or holds a record for the
+ * consumer (sequence == position + 1), see Vyukov's bounded MPMC queue.
+ */
+typedef struct
+{
+    atomic_size_t sequence;
+    logging_level_t level;
+    bool line_start;
+    struct timeval time;
+    size_t length;
+    char text[LOGGING_RECORD_SIZE];
+} logging_record_t;
 
 static logging_settings_t logging_settings;
 
-int logging_init(logging_settings_t *settings)
+atomic_int logging_levels[LOG_MODULE_COUNT];
+
+static const char *logging_module_names[] =
 {
-    memcpy(&logging_settings, settings, sizeof(logging_settings_t));
-    log_message(LOG_LEVEL_TRACE, "Logging timestamp: %s\n", logging_settings.timestamp ? "ON" : "OFF");
-    log_message(LOG_LEVEL_TRACE, "Logging level set to %d\n", logging_settings.level);
+    [LOG_MODULE_CORE] = "core",
+    [LOG_MODULE_COAP] = "coap",
+    [LOG_MODULE_MONITOR] = "monitor",
+    [LOG_MODULE_RESOURCE] = "resource",
+    [LOG_MODULE_OBSERVE] = "observe",
+    [LOG_MODULE_NOTIFY] = "notify",
+    [LOG_MODULE_CALLBACK] = "callback",
+    [LOG_MODULE_JOURNAL] = "journal",
+    [LOG_MODULE_JWT] = "jwt",
+};
 
-    if (logging_settings.level > LOG_LEVEL_TRACE)
+// Output state, only used by the writer thread or under the output mutex
+static pthread_mutex_t logging_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE *logging_file;
+static size_t logging_file_bytes;
+
+static logging_record_t *logging_ring;
+static atomic_size_t logging_enqueue_position;
+static size_t logging_dequeue_position;
+static atomic_bool logging_running;
+static atomic_bool logging_writer_waiting;
+static pthread_mutex_t logging_wakeup_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logging_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_t logging_writer;
+
+// Partial lines are continued by the same thread, timestamp starts a line
+static __thread bool logging_line_open[2];
+
+static metric_t metric_records = METRIC_COUNTER_INIT("log.records");
+static metric_t metric_dropped = METRIC_COUNTER_INIT("log.dropped");
+
+static void logging_rotate(void)
+{
+    char *from, *to;
+    size_t length = strlen(logging_settings.file) + 16;
+    int i;
+
+    fclose(logging_file);
+    logging_file = NULL;
+
+    from = malloc(length);
+    to = malloc(length);
+    if (from != NULL && to != NULL)
     {
-        log_message(LOG_LEVEL_WARN, "Unexpected high log level \"%d\".\n", logging_settings.level);
+        // "log.N-1" -> "log.N", ..., "log" -> "log.1"
+        for (i = logging_settings.file_count; i > 0; i--)
+        {
+            if (i > 1)
+            {
+                snprintf(from, length, "%s.%d", logging_settings.file, i - 1);
+            }
+            else
+            {
+                snprintf(from, length, "%s", logging_settings.file);
+            }
+            snprintf(to, length, "%s.%d", logging_settings.file, i);
+            rename(from, to);
+        }
     }
+    free(from);
+    free(to);
 
-    return 0;
+    logging_file = fopen(logging_settings.file, logging_settings.file_count > 0 ? "a" : "w");
+    logging_file_bytes = 0;
 }
 
-int log_message(logging_level_t level, char *format, ...)
+static void logging_output(logging_level_t level, bool line_start, const struct timeval *time,
+                           const char *text, size_t length)
 {
-    struct timeval time_timeval;
-    time_t time_time;
-    struct tm *time_tm;
     char time_buffer[64];
-
-    static size_t stdout_chars = 0, stderr_chars = 0;
+    struct tm time_tm;
     FILE *stream;
-    size_t *stream_chars;
-    int status = 0;
-    va_list arg_ptr;
-    va_start(arg_ptr, format);
+    int written = 0;
+
+    if (logging_file != NULL)
+    {
+        if (logging_settings.file_size > 0 && logging_file_bytes >= logging_settings.file_size
+            && line_start)
+        {
+            logging_rotate();
+        }
+        stream = logging_file;
+    }
+    else
+    {
+        stream = level <= LOG_LEVEL_ERROR ? stderr : stdout;
+    }
+
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    if (logging_settings.timestamp && line_start)
+    {
+        if (logging_settings.human_readable_timestamp)
+        {
+            localtime_r(&time->tv_sec, &time_tm);
+
+            strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", &time_tm);
+            written = fprintf(stream, "%s.%03lu ", time_buffer,
+                              (unsigned long)time->tv_usec / 1000);
+        }
+        else
+        {
+            written = fprintf(stream, "%lu.%03lu ", (unsigned long)time->tv_sec,
+                              (unsigned long)time->tv_usec / 1000);
+        }
+    }
 
-    if (level > logging_settings.level)
+    written += fwrite(text, 1, length, stream);
+
+    if (stream == logging_file)
     {
-        status = 1;
-        goto exit;
+        logging_file_bytes += written > 0 ? written : 0;
     }
-    else if (level <= LOG_LEVEL_ERROR)
+}
+
+static void logging_flush(void)
+{
+    if (logging_file != NULL)
     {
-        stream = stderr;
-        stream_chars = &stderr_chars;
+        fflush(logging_file);
     }
     else
     {
-        stream = stdout;
-        stream_chars = &stdout_chars;
+        fflush(stdout);
+        fflush(stderr);
     }
+}
+
+static bool logging_dequeue(void)
+{
+    logging_record_t *record = &logging_ring[logging_dequeue_position & (LOGGING_RING_SIZE - 1)];
 
-    if (logging_settings.timestamp && *stream_chars == 0)
+    if (atomic_load_explicit(&record->sequence, memory_order_acquire)
+        != logging_dequeue_position + 1)
     {
-        gettimeofday(&time_timeval, NULL);
+        return false;
+    }
 
-        if (logging_settings.human_readable_timestamp)
+    logging_output(record->level, record->line_start, &record->time, record->text,
+                   record->length);
+
+    // Slot becomes free for the producer one lap later
+    atomic_store_explicit(&record->sequence, logging_dequeue_position + LOGGING_RING_SIZE,
+                          memory_order_release);
+    logging_dequeue_position++;
+
+    return true;
+}
+
+static void *logging_writer_thread(void *arg)
+{
+    struct timespec deadline;
+    bool running = true;
+
+    while (running)
+    {
+        running = atomic_load(&logging_running);
+
+        pthread_mutex_lock(&logging_output_mutex);
+        while (logging_dequeue())
+        {
+            // Everything published so far is written before a single flush
+        }
+        logging_flush();
+        pthread_mutex_unlock(&logging_output_mutex);
+
+        if (!running)
+        {
+            break;
+        }
+
+        // Producers only signal if the writer announced it is going to sleep
+        pthread_mutex_lock(&logging_wakeup_mutex);
+        atomic_store(&logging_writer_waiting, true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&logging_ring[logging_dequeue_position
+                                               & (LOGGING_RING_SIZE - 1)].sequence,
+                                 memory_order_acquire) != logging_dequeue_position + 1
+            && atomic_load(&logging_running))
         {
-            time_time = time_timeval.tv_sec;
-            time_tm = localtime(&time_time);
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += LOGGING_IDLE_WAIT_MS * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&logging_wakeup, &logging_wakeup_mutex, &deadline);
+        }
+        atomic_store(&logging_writer_waiting, false);
+        pthread_mutex_unlock(&logging_wakeup_mutex);
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns the claimed slot or NULL if the buffer is full and messages are
+ * dropped, or if the writer stopped while waiting for a free slot.
+ */
+static logging_record_t *logging_claim(size_t *position)
+{
+    logging_record_t *record;
+    size_t sequence;
+    intptr_t difference;
+
+    *position = atomic_load_explicit(&logging_enqueue_position, memory_order_relaxed);
+    for (;;)
+    {
+        record = &logging_ring[*position & (LOGGING_RING_SIZE - 1)];
+        sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+        difference = (intptr_t)sequence - (intptr_t)*position;
 
-            strftime(time_buffer, sizeof(time_buffer), "%Y-%m-%d %H:%M:%S", time_tm);
-            fprintf(stream, "%s.%03lu ", time_buffer, time_timeval.tv_usec / 1000);
+        if (difference == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&logging_enqueue_position, position,
+                                                      *position + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                return record;
+            }
+        }
+        else if (difference < 0)
+        {
+            // Full, the slot still holds a record from the previous lap
+            if (logging_settings.overflow_policy == LOGGING_OVERFLOW_DROP)
+            {
+                metrics_add(&metric_dropped, 1);
+                return NULL;
+            }
+            // Nobody frees the slot once the writer is joined
+            if (!atomic_load(&logging_running))
+            {
+                return NULL;
+            }
+            sched_yield();
+            *position = atomic_load_explicit(&logging_enqueue_position, memory_order_relaxed);
         }
         else
         {
-            fprintf(stream, "%lu.%03lu ", time_timeval.tv_sec, time_timeval.tv_usec / 1000);
+            *position = atomic_load_explicit(&logging_enqueue_position, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * Returns false if the writer stopped and the message has to be written
+ * synchronously.
+ */
+static bool logging_enqueue(logging_level_t level, bool line_start, const struct timeval *time,
+                            const char *format, va_list arg_ptr)
+{
+    logging_record_t *record;
+    size_t position;
+    int length;
+
+    record = logging_claim(&position);
+    if (record == NULL)
+    {
+        return atomic_load(&logging_running);
+    }
+
+    record->level = level;
+    record->line_start = line_start;
+    record->time = *time;
+
+    length = vsnprintf(record->text, LOGGING_RECORD_SIZE, format, arg_ptr);
+    if (length < 0)
+    {
+        length = 0;
+    }
+    else if (length >= LOGGING_RECORD_SIZE)
+    {
+        // Truncated messages still end their line
+        length = LOGGING_RECORD_SIZE - 1;
+        if (format[0] != '\0' && format[strlen(format) - 1] == '\n')
+        {
+            record->text[length - 1] = '\n';
+        }
+    }
+    record->length = length;
+
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+    metrics_add(&metric_records, 1);
+
+    // Pairs with the fence of the writer, so either it sees the record or we see it waiting
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&logging_writer_waiting))
+    {
+        pthread_mutex_lock(&logging_wakeup_mutex);
+        pthread_cond_signal(&logging_wakeup);
+        pthread_mutex_unlock(&logging_wakeup_mutex);
+    }
+
+    return true;
+}
+
+int logging_module_parse(const char *name, logging_module_t *module)
+{
+    size_t i;
+
+    for (i = 0; i < LOG_MODULE_COUNT; i++)
+    {
+        if (strcasecmp(name, logging_module_names[i]) == 0)
+        {
+            *module = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+const char *logging_module_name(logging_module_t module)
+{
+    return logging_module_names[module];
+}
+
+void logging_set_level(logging_module_t module, logging_level_t level)
+{
+    atomic_store_explicit(&logging_levels[module], level, memory_order_relaxed);
+}
+
+logging_level_t logging_get_level(logging_module_t module)
+{
+    return atomic_load_explicit(&logging_levels[module], memory_order_relaxed);
+}
+
+int logging_init(logging_settings_t *settings)
+{
+    size_t i;
+
+    logging_cleanup();
+
+    memcpy(&logging_settings, settings, sizeof(logging_settings_t));
+
+    for (i = 0; i < LOG_MODULE_COUNT; i++)
+    {
+        logging_set_level(i, (logging_settings.module_levels_set & (1u << i))
+                          ? logging_settings.module_levels[i] : logging_settings.level);
+    }
+
+    if (logging_settings.file != NULL)
+    {
+        logging_settings.file = strdup(logging_settings.file);
+        logging_file = logging_settings.file != NULL ? fopen(logging_settings.file, "a") : NULL;
+        if (logging_file == NULL)
+        {
+            fprintf(stderr, "Failed to open log file \"%s\": %s\n", settings->file,
+                    strerror(errno));
+            return -1;
+        }
+        fseek(logging_file, 0, SEEK_END);
+        logging_file_bytes = ftell(logging_file);
+    }
+
+    metrics_register(&metric_records);
+    metrics_register(&metric_dropped);
+
+    if (logging_settings.async)
+    {
+        // Never released, a late producer may still hold a slot at exit
+        if (logging_ring == NULL)
+        {
+            logging_ring = calloc(LOGGING_RING_SIZE, sizeof(logging_record_t));
+        }
+        if (logging_ring != NULL)
+        {
+            for (i = 0; i < LOGGING_RING_SIZE; i++)
+            {
+                atomic_init(&logging_ring[i].sequence, i);
+            }
+            atomic_store(&logging_enqueue_position, 0);
+            logging_dequeue_position = 0;
+            atomic_store(&logging_running, true);
+
+            if (pthread_create(&logging_writer, NULL, logging_writer_thread, NULL) != 0)
+            {
+                atomic_store(&logging_running, false);
+            }
+            else
+            {
+                atexit(logging_cleanup);
+            }
+        }
+
+        if (!atomic_load(&logging_running))
+        {
+            log_message(LOG_LEVEL_WARN, "Failed to start asynchronous logging.\n");
         }
     }
 
-    *stream_chars += vfprintf(stream, format, arg_ptr);
+    log_message(LOG_LEVEL_TRACE, "Logging timestamp: %s\n", logging_settings.timestamp ? "ON" : "OFF");
+    log_message(LOG_LEVEL_TRACE, "Logging level set to %d\n", logging_settings.level);
+
+    if (logging_settings.level > LOG_LEVEL_TRACE)
+    {
+        log_message(LOG_LEVEL_WARN, "Unexpected high log level \"%d\".\n", logging_settings.level);
+    }
+
+    return 0;
+}
+
+void logging_cleanup(void)
+{
+    if (atomic_exchange(&logging_running, false))
+    {
+        pthread_mutex_lock(&logging_wakeup_mutex);
+        pthread_cond_signal(&logging_wakeup);
+        pthread_mutex_unlock(&logging_wakeup_mutex);
+
+        pthread_join(logging_writer, NULL);
+    }
+
+    pthread_mutex_lock(&logging_output_mutex);
+    logging_flush();
+    if (logging_file != NULL)
+    {
+        fclose(logging_file);
+        logging_file = NULL;
+    }
+    free(logging_settings.file);
+    logging_settings.file = NULL;
+    pthread_mutex_unlock(&logging_output_mutex);
+}
+
+int logging_write(logging_level_t level, const char *format, ...)
+{
+    struct timeval time_timeval;
+    char text[LOGGING_RECORD_SIZE];
+    char *message;
+    bool *line_open;
+    bool line_start;
+    int length;
+    va_list arg_ptr, arg_copy;
 
-    if (format[strlen(format) - 1] == '\n')
+    line_open = &logging_line_open[level <= LOG_LEVEL_ERROR ? 1 : 0];
+    line_start = !*line_open;
+    // Empty message leaves the line as it is
+    if (format[0] != '\0')
     {
-        *stream_chars = 0;
+        *line_open = format[strlen(format) - 1] != '\n';
+    }
+
+    gettimeofday(&time_timeval, NULL);
+
+    va_start(arg_ptr, format);
+
+    if (!atomic_load(&logging_running)
+        || !logging_enqueue(level, line_start, &time_timeval, format, arg_ptr))
+    {
+        va_copy(arg_copy, arg_ptr);
+        length = vsnprintf(text, sizeof(text), format, arg_ptr);
+        message = text;
+        if (length >= (int)sizeof(text))
+        {
+            // Synchronous output is not limited to the record size
+            message = malloc(length + 1);
+            if (message != NULL)
+            {
+                vsnprintf(message, length + 1, format, arg_copy);
+            }
+            else
+            {
+                message = text;
+                length = sizeof(text) - 1;
+            }
+        }
+        va_end(arg_copy);
+
+        pthread_mutex_lock(&logging_output_mutex);
+        logging_output(level, line_start, &time_timeval, message, length > 0 ? length : 0);
+        pthread_mutex_unlock(&logging_output_mutex);
+
+        if (message != text)
+        {
+            free(message);
+        }
     }
 
-exit:
     va_end(arg_ptr);
-    return status;
+
+    return 0;
 }
@@ -20,7 +20,14 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#define LOGGING_RING_SIZE       2048
+#define LOGGING_RECORD_SIZE     1024
+#define LOGGING_FILE_SIZE       (10 * 1024 * 1024)
+#define LOGGING_FILE_COUNT      5
 
 typedef enum
 {
@@ -32,16 +39,133 @@ typedef enum
     LOG_LEVEL_TRACE = 5,
 } logging_level_t;
 
+/*
+ * Messages are attributed to the module given by LOG_MODULE, which a source
+ * file may define before its includes (the default is LOG_MODULE_CORE), or
+ * explicitly with log_module_message().
+ */
+typedef enum
+{
+    LOG_MODULE_CORE,
+    LOG_MODULE_COAP,
+    LOG_MODULE_MONITOR,
+    LOG_MODULE_RESOURCE,
+    LOG_MODULE_OBSERVE,
+    LOG_MODULE_NOTIFY,
+    LOG_MODULE_CALLBACK,
+    LOG_MODULE_JOURNAL,
+    LOG_MODULE_JWT,
+    LOG_MODULE_COUNT,
+} logging_module_t;
+
+typedef enum
+{
+    LOGGING_OVERFLOW_DROP,
+    LOGGING_OVERFLOW_BLOCK,
+} logging_overflow_policy_t;
+
 typedef struct
 {
     logging_level_t level;
+    logging_level_t module_levels[LOG_MODULE_COUNT];
+    unsigned int module_levels_set;
     bool timestamp;
     bool human_readable_timestamp;
+    bool async;
+    logging_overflow_policy_t overflow_policy;
+    char *file;
+    size_t file_size;
+    int file_count;
 } logging_settings_t;
 
+/**
+ * Applies logging settings. In asynchronous mode messages are formatted by
+ * the calling thread into a lock-free ring buffer and written out by a
+ * background thread, which is stopped (and the buffer drained) at exit.
+ *
+ * @param[in]  settings  Logging settings
+ *
+ * @return 0 on success, -1 if the log file can not be opened
+ */
 int logging_init(logging_settings_t *settings);
 
-int log_message(logging_level_t level, char *format, ...);
+/**
+ * Writes out buffered messages and stops the background writer, later
+ * messages are written synchronously.
+ */
+void logging_cleanup(void);
+
+/**
+ * Finds module by its (case insensitive) name.
+ *
+ * @param[in]  name    Module name, e.g. "jwt"
+ * @param[out] module  Module
+ *
+ * @return 0 on success, -1 if there is no such module
+ */
+int logging_module_parse(const char *name, logging_module_t *module);
+
+/**
+ * Returns module name.
+ *
+ * @param[in]  module  Module
+ *
+ * @return Lower case module name
+ */
+const char *logging_module_name(logging_module_t module);
+
+/**
+ * Changes visible messages level of the module at runtime.
+ *
+ * @param[in]  module  Module
+ * @param[in]  level   Level
+ */
+void logging_set_level(logging_module_t module, logging_level_t level);
+
+/**
+ * Returns current visible messages level of the module.
+ *
+ * @param[in]  module  Module
+ *
+ * @return Level
+ */
+logging_level_t logging_get_level(logging_module_t module);
+
+/**
+ * Writes message regardless of the levels, use log_message() instead.
+ *
+ * @param[in]  level   Message level
+ * @param[in]  format  printf() format
+ *
+ * @return 0
+ */
+int logging_write(logging_level_t level, const char *format, ...);
+
+extern atomic_int logging_levels[LOG_MODULE_COUNT];
+
+/*
+ * Messages above the compile-time level are removed by the compiler, e.g.
+ * -DLOGGING_COMPILE_LEVEL=LOG_LEVEL_INFO drops debug and trace messages.
+ */
+#ifndef LOGGING_COMPILE_LEVEL
+#define LOGGING_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MODULE_CORE
+#endif
+
+#define log_module_enabled(module, level) \
+    ((level) <= LOGGING_COMPILE_LEVEL \
+     && (int)(level) <= atomic_load_explicit(&logging_levels[(module)], memory_order_relaxed))
+
+#define log_enabled(level) log_module_enabled(LOG_MODULE, level)
+
+// Arguments are evaluated only if the message is visible
+#define log_module_message(module, level, ...) \
+    (log_module_enabled(module, level) ? (void)logging_write((level), __VA_ARGS__) : (void)0)
+
+#define log_message(level, ...) log_module_message(LOG_MODULE, level, __VA_ARGS__)
 
 #endif // LOGGING_H
 
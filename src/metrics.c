@@ -0,0 +1,104 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "metrics.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+
+
+static pthread_mutex_t metrics_mutex = PTHREAD_MUTEX_INITIALIZER;
+static metric_t *metrics_list = NULL;
+
+void metrics_register(metric_t *metric)
+{
+    metric_t *entry;
+
+    pthread_mutex_lock(&metrics_mutex);
+
+    for (entry = metrics_list; entry != NULL; entry = entry->next)
+    {
+        if (entry == metric)
+        {
+            pthread_mutex_unlock(&metrics_mutex);
+            return;
+        }
+    }
+
+    metric->next = metrics_list;
+    metrics_list = metric;
+
+    pthread_mutex_unlock(&metrics_mutex);
+}
+
+void metrics_add(metric_t *metric, int64_t value)
+{
+    __atomic_add_fetch(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+void metrics_set(metric_t *metric, int64_t value)
+{
+    __atomic_store_n(&metric->value, value, __ATOMIC_RELAXED);
+}
+
+void metrics_max(metric_t *metric, int64_t value)
+{
+    int64_t current = __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+
+    while (value > current)
+    {
+        if (__atomic_compare_exchange_n(&metric->value, &current, value, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            break;
+        }
+    }
+}
+
+int64_t metrics_get(metric_t *metric)
+{
+    return __atomic_load_n(&metric->value, __ATOMIC_RELAXED);
+}
+
+json_t *metrics_json(void)
+{
+    json_t *jmetrics = json_object();
+    metric_t *entry;
+
+    pthread_mutex_lock(&metrics_mutex);
+
+    for (entry = metrics_list; entry != NULL; entry = entry->next)
+    {
+        json_object_set_new(jmetrics, entry->name, json_integer(metrics_get(entry)));
+    }
+
+    pthread_mutex_unlock(&metrics_mutex);
+
+    return jmetrics;
+}
+
+int64_t metrics_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
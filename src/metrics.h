@@ -0,0 +1,101 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+#include <jansson.h>
+
+
+typedef enum
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+} metric_type_t;
+
+typedef struct metric_t
+{
+    struct metric_t *next;
+    const char *name;
+    metric_type_t type;
+    int64_t value;
+} metric_t;
+
+#define METRIC_COUNTER_INIT(metric_name) { .name = (metric_name), .type = METRIC_COUNTER }
+#define METRIC_GAUGE_INIT(metric_name) { .name = (metric_name), .type = METRIC_GAUGE }
+
+/**
+ * Registers metric so it is reported by metrics_json(). Registering the same
+ * metric more than once has no effect. Metrics must outlive the registry,
+ * therefore they are usually declared as static variables of the module.
+ *
+ * @param[in]  metric  Pointer to the metric
+ */
+void metrics_register(metric_t *metric);
+
+/**
+ * Atomically adds value to the counter or gauge.
+ *
+ * @param[in]  metric  Pointer to the metric
+ * @param[in]  value   Value to be added (may be negative for gauges)
+ */
+void metrics_add(metric_t *metric, int64_t value);
+
+/**
+ * Atomically sets gauge value.
+ *
+ * @param[in]  metric  Pointer to the metric
+ * @param[in]  value   New metric value
+ */
+void metrics_set(metric_t *metric, int64_t value);
+
+/**
+ * Atomically raises gauge value to the given one if it is larger.
+ *
+ * @param[in]  metric  Pointer to the metric
+ * @param[in]  value   Candidate maximum value
+ */
+void metrics_max(metric_t *metric, int64_t value);
+
+/**
+ * Reads current metric value.
+ *
+ * @param[in]  metric  Pointer to the metric
+ *
+ * @return Current metric value
+ */
+int64_t metrics_get(metric_t *metric);
+
+/**
+ * Builds an object with all registered metrics keyed by their names.
+ *
+ * @return New JSON object reference
+ */
+json_t *metrics_json(void);
+
+/**
+ * Returns monotonic time in microseconds, used for latency measurements.
+ *
+ * @return Monotonic timestamp in microseconds
+ */
+int64_t metrics_time_us(void);
+
+#endif // METRICS_H
@@ -0,0 +1,79 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "packet-pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+int packet_pool_init(packet_pool_t *pool, size_t capacity)
+{
+    size_t i;
+
+    memset(pool, 0, sizeof(packet_pool_t));
+
+    pool->buffers = malloc(capacity * sizeof(packet_buffer_t));
+    if (pool->buffers == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < capacity; i++)
+    {
+        pool->buffers[i].next = pool->free_list;
+        pool->free_list = &pool->buffers[i];
+    }
+
+    pool->capacity = capacity;
+    pool->available = capacity;
+
+    return 0;
+}
+
+void packet_pool_cleanup(packet_pool_t *pool)
+{
+    free(pool->buffers);
+    memset(pool, 0, sizeof(packet_pool_t));
+}
+
+packet_buffer_t *packet_pool_acquire(packet_pool_t *pool)
+{
+    packet_buffer_t *buffer = pool->free_list;
+
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    pool->free_list = buffer->next;
+    pool->available--;
+
+    buffer->next = NULL;
+    buffer->length = 0;
+
+    return buffer;
+}
+
+void packet_pool_release(packet_pool_t *pool, packet_buffer_t *buffer)
+{
+    buffer->next = pool->free_list;
+    pool->free_list = buffer;
+    pool->available++;
+}
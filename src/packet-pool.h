@@ -0,0 +1,79 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKET_POOL_BUFFER_SIZE 1500
+
+
+typedef struct packet_buffer_t
+{
+    struct packet_buffer_t *next;
+    size_t length;
+    uint8_t data[PACKET_POOL_BUFFER_SIZE];
+} packet_buffer_t;
+
+typedef struct
+{
+    packet_buffer_t *buffers;
+    packet_buffer_t *free_list;
+    size_t capacity;
+    size_t available;
+} packet_pool_t;
+
+/**
+ * Preallocates packet buffers. The pool is not thread-safe and is meant to be
+ * owned by a single network thread.
+ *
+ * @param[in]  pool      Pointer to the pool
+ * @param[in]  capacity  Number of buffers to allocate
+ *
+ * @return 0 on success, -1 on error
+ */
+int packet_pool_init(packet_pool_t *pool, size_t capacity);
+
+/**
+ * Releases all pool buffers. Buffers must not be used afterwards.
+ *
+ * @param[in]  pool  Pointer to the pool
+ */
+void packet_pool_cleanup(packet_pool_t *pool);
+
+/**
+ * Takes buffer from the pool.
+ *
+ * @param[in]  pool  Pointer to the pool
+ *
+ * @return Pointer to a buffer or NULL if pool is exhausted
+ */
+packet_buffer_t *packet_pool_acquire(packet_pool_t *pool);
+
+/**
+ * Returns buffer to the pool.
+ *
+ * @param[in]  pool    Pointer to the pool
+ * @param[in]  buffer  Buffer previously taken with packet_pool_acquire()
+ */
+void packet_pool_release(packet_pool_t *pool, packet_buffer_t *buffer);
+
+#endif // PACKET_POOL_H
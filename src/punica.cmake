@@ -6,16 +6,39 @@ set(PUNICA_SOURCES
     ${CMAKE_CURRENT_LIST_DIR}/restserver.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-core.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-core-types.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-base64.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-callbacks.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-cbor.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-delivery.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-endpoints.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-resources.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-shard.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-stream.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-notifications.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-notification-log.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-metrics.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-logging.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-subscriptions.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-list.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-random.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-hash.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-http-pool.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-journal.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-json.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-utils.c
+    ${CMAKE_CURRENT_LIST_DIR}/rest-values.c
     ${CMAKE_CURRENT_LIST_DIR}/rest-authentication.c
+    ${CMAKE_CURRENT_LIST_DIR}/client-registry.c
+    ${CMAKE_CURRENT_LIST_DIR}/client-snapshot.c
+    ${CMAKE_CURRENT_LIST_DIR}/connection-table.c
+    ${CMAKE_CURRENT_LIST_DIR}/event-loop.c
+    ${CMAKE_CURRENT_LIST_DIR}/jwt-cache.c
     ${CMAKE_CURRENT_LIST_DIR}/logging.c
+    ${CMAKE_CURRENT_LIST_DIR}/metrics.c
+    ${CMAKE_CURRENT_LIST_DIR}/packet-pool.c
     ${CMAKE_CURRENT_LIST_DIR}/settings.c
     ${CMAKE_CURRENT_LIST_DIR}/security.c
+    ${CMAKE_CURRENT_LIST_DIR}/user-scope.c
     )
 
 add_definitions(-DLWM2M_SERVER_MODE)
@@ -17,12 +17,30 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_JWT
+
+#include <pthread.h>
 #include <string.h>
 
 #include "rest-authentication.h"
 #include "security.h"
 #include "logging.h"
 #include "http_codes.h"
+#include "metrics.h"
+
+static metric_t metric_cache_hits = METRIC_COUNTER_INIT("jwt.cache_hits");
+static metric_t metric_cache_misses = METRIC_COUNTER_INIT("jwt.cache_misses");
+static metric_t metric_verifications = METRIC_COUNTER_INIT("jwt.verifications");
+static metric_t metric_verify_time_us = METRIC_COUNTER_INIT("jwt.verify_time_us_total");
+static pthread_once_t metrics_once = PTHREAD_ONCE_INIT;
+
+static void register_metrics(void)
+{
+    metrics_register(&metric_cache_hits);
+    metrics_register(&metric_cache_misses);
+    metrics_register(&metric_verifications);
+    metrics_register(&metric_verify_time_us);
+}
 
 static int validate_authentication_body(json_t *authentication_json)
 {
@@ -156,26 +174,19 @@ static jwt_error_t validate_token_grants(jwt_settings_t *settings, json_t *j_tok
     return J_OK;
 }
 
-static jwt_error_t access_token_check_scope(char *access_token, jwt_settings_t *jwt_settings,
-                                            char *required_scope)
+/*
+ * Full verification: signature, grants and user lookup. The user is left NULL
+ * if the signature is valid, but the user is not configured (anymore).
+ */
+static jwt_error_t access_token_verify(char *access_token, jwt_settings_t *jwt_settings,
+                                       user_t **user, time_t *issuing_time)
 {
     char *grants_string;
-    const char *user_name;
     json_t *j_grants;
-    rest_list_entry_t *entry;
-    user_t *user = NULL, *user_entry;
     jwt_t *jwt;
     jwt_error_t status;
 
-    if (jwt_settings == NULL)
-    {
-        return J_ERROR_INTERNAL;
-    }
-
-    if (access_token == NULL)
-    {
-        return J_ERROR_INVALID_REQUEST;
-    }
+    *user = NULL;
 
     status = J_ERROR_INVALID_TOKEN;
     if (jwt_decode(&jwt, access_token, jwt_settings->secret_key, jwt_settings->secret_key_length))
@@ -202,35 +213,76 @@ static jwt_error_t access_token_check_scope(char *access_token, jwt_settings_t *
         goto exit;
     }
 
-    user_name = json_string_value(json_object_get(j_grants, "name"));
-    for (entry = jwt_settings->users_list->head; entry != NULL; entry = entry->next)
+    *issuing_time = json_integer_value(json_object_get(j_grants, "iat"));
+
+    *user = security_user_find(jwt_settings,
+                               json_string_value(json_object_get(j_grants, "name")));
+
+exit:
+    json_decref(j_grants);
+    free(grants_string);
+    jwt_free(jwt);
+    return status;
+}
+
+static jwt_error_t access_token_check_scope(char *access_token, jwt_settings_t *jwt_settings,
+                                            char *required_scope)
+{
+    void *cached_user;
+    user_t *user;
+    time_t issuing_time;
+    int64_t start;
+    jwt_error_t status;
+
+    if (jwt_settings == NULL)
     {
-        user_entry = entry->data;
+        return J_ERROR_INTERNAL;
+    }
+
+    if (access_token == NULL)
+    {
+        return J_ERROR_INVALID_REQUEST;
+    }
+
+    if (jwt_settings->cache != NULL
+        && jwt_cache_get(jwt_settings->cache, access_token, &cached_user, &issuing_time))
+    {
+        metrics_add(&metric_cache_hits, 1);
+        user = cached_user;
 
-        if (strncmp(user_entry->name, user_name, strnlen(user_name, J_MAX_LENGTH_USER_NAME)) == 0)
+        if (time(NULL) >= issuing_time + jwt_settings->expiration_time)
         {
-            user = user_entry;
-            break;
+            log_message(LOG_LEVEL_TRACE, "[JWT] User \"%s\" submitted expired token\n", user->name);
+            jwt_cache_remove(jwt_settings->cache, access_token);
+            return J_ERROR_EXPIRED_TOKEN;
         }
     }
-
-    status = J_ERROR_INSUFFICIENT_SCOPE;
-    if (user == NULL)
+    else
     {
-        goto exit;
+        metrics_add(&metric_cache_misses, 1);
+
+        start = metrics_time_us();
+        status = access_token_verify(access_token, jwt_settings, &user, &issuing_time);
+        metrics_add(&metric_verifications, 1);
+        metrics_add(&metric_verify_time_us, metrics_time_us() - start);
+
+        if (status != J_OK)
+        {
+            return status;
+        }
+
+        if (user != NULL && jwt_settings->cache != NULL)
+        {
+            jwt_cache_put(jwt_settings->cache, access_token, user, issuing_time);
+        }
     }
 
-    if (security_user_check_scope(user, required_scope) != 0)
+    if (user == NULL || security_user_check_scope(user, required_scope) != 0)
     {
-        goto exit;
+        return J_ERROR_INSUFFICIENT_SCOPE;
     }
 
-    status = J_OK;
-
-exit:
-    free(grants_string);
-    jwt_free(jwt);
-    return status;
+    return J_OK;
 }
 
 int rest_authenticate_cb(const struct _u_request *request, struct _u_response *response,
@@ -239,8 +291,7 @@ int rest_authenticate_cb(const struct _u_request *request, struct _u_response *r
     json_t *j_request_body, *j_response_body;
     jwt_t *jwt = NULL;
     jwt_settings_t *jwt_settings = (jwt_settings_t *)user_data;
-    rest_list_entry_t *entry;
-    user_t *user = NULL, *user_entry;
+    user_t *user;
     char *token;
     const char *user_name, *user_secret;
     time_t issuing_time;
@@ -263,20 +314,7 @@ int rest_authenticate_cb(const struct _u_request *request, struct _u_response *r
     user_name = json_string_value(json_object_get(j_request_body, "name"));
     user_secret = json_string_value(json_object_get(j_request_body, "secret"));
 
-    for (entry = jwt_settings->users_list->head; entry != NULL; entry = entry->next)
-    {
-        user_entry = entry->data;
-
-        if (strlen(user_entry->name) == strlen(user_name)
-            && strlen(user_entry->secret) == strlen(user_secret)
-            && strncmp(user_entry->name, user_name, strlen(user_name)) == 0
-            && strncmp(user_entry->secret, user_secret, strlen(user_secret)) == 0)
-        {
-            user = user_entry;
-            break;
-        }
-    }
-
+    user = security_user_authenticate(jwt_settings, user_name, user_secret);
     if (user == NULL)
     {
         log_message(LOG_LEVEL_TRACE, "[JWT] User \"%s\" failed to authenticate\n", user_name);
@@ -341,6 +379,8 @@ int rest_validate_jwt_cb(const struct _u_request *request, struct _u_response *r
         return U_CALLBACK_CONTINUE;
     }
 
+    pthread_once(&metrics_once, register_metrics);
+
     required_scope = get_request_scope(request);
     if (required_scope == NULL)
     {
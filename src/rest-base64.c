@@ -0,0 +1,211 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rest-base64.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define REST_BASE64_X86
+#endif
+
+typedef size_t (*rest_base64_encoder_t)(const uint8_t *data, size_t length, char *output);
+
+static const char *base64_table =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static rest_base64_encoder_t rest_base64_encoder;
+static const char *rest_base64_name;
+static pthread_once_t rest_base64_once = PTHREAD_ONCE_INIT;
+
+
+size_t rest_base64_encoded_length(size_t length)
+{
+    return ((length + 2) / 3) * 4;
+}
+
+/*
+ * Encodes the remaining (or all) data, returns number of characters written.
+ */
+static size_t rest_base64_encode_scalar(const uint8_t *data, size_t length, char *output)
+{
+    char *start = output;
+    uint32_t triple;
+
+    for (; length >= 3; length -= 3, data += 3)
+    {
+        triple = (uint32_t)data[0] << 16 | (uint32_t)data[1] << 8 | data[2];
+
+        *output++ = base64_table[(triple >> 18) & 0x3f];
+        *output++ = base64_table[(triple >> 12) & 0x3f];
+        *output++ = base64_table[(triple >> 6) & 0x3f];
+        *output++ = base64_table[triple & 0x3f];
+    }
+
+    if (length > 0)
+    {
+        triple = (uint32_t)data[0] << 16 | (length == 2 ? (uint32_t)data[1] << 8 : 0);
+
+        *output++ = base64_table[(triple >> 18) & 0x3f];
+        *output++ = base64_table[(triple >> 12) & 0x3f];
+        *output++ = length == 2 ? base64_table[(triple >> 6) & 0x3f] : '=';
+        *output++ = '=';
+    }
+
+    return output - start;
+}
+
+#ifdef REST_BASE64_X86
+
+/*
+ * Wojciech Muła's algorithm: twelve input bytes in the low lanes of each
+ * 128-bit lane are split into sixteen 6-bit indices, which are translated
+ * to ASCII by adding an offset selected with a byte shuffle.
+ */
+#define REST_BASE64_SHUFFLE 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1
+#define REST_BASE64_OFFSETS \
+    'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, \
+    '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0
+
+__attribute__((target("ssse3"), always_inline))
+static inline __m128i rest_base64_ssse3_block(__m128i input)
+{
+    __m128i indices, shifted, result;
+
+    input = _mm_shuffle_epi8(input, _mm_set_epi8(REST_BASE64_SHUFFLE));
+
+    indices = _mm_or_si128(
+                  _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00)),
+                                  _mm_set1_epi32(0x04000040)),
+                  _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003f03f0)),
+                                  _mm_set1_epi32(0x01000010)));
+
+    shifted = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    shifted = _mm_or_si128(shifted, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices),
+                                                  _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(_mm_setr_epi8(REST_BASE64_OFFSETS), shifted);
+
+    return _mm_add_epi8(result, indices);
+}
+
+/*
+ * Inlined into the AVX2 encoder as well, so its tail is VEX encoded and
+ * does not pay the SSE/AVX transition penalty.
+ */
+__attribute__((target("ssse3"), always_inline))
+static inline size_t rest_base64_encode_ssse3_blocks(const uint8_t *data, size_t length,
+                                                     char *output)
+{
+    char *start = output;
+
+    // Every block reads 16 bytes, but consumes only 12
+    for (; length >= 16; length -= 12, data += 12, output += 16)
+    {
+        _mm_storeu_si128((__m128i *)output,
+                         rest_base64_ssse3_block(_mm_loadu_si128((const __m128i *)data)));
+    }
+
+    output += rest_base64_encode_scalar(data, length, output);
+
+    return output - start;
+}
+
+__attribute__((target("ssse3")))
+static size_t rest_base64_encode_ssse3(const uint8_t *data, size_t length, char *output)
+{
+    return rest_base64_encode_ssse3_blocks(data, length, output);
+}
+
+__attribute__((target("avx2")))
+static size_t rest_base64_encode_avx2(const uint8_t *data, size_t length, char *output)
+{
+    const __m256i shuffle = _mm256_set_epi8(REST_BASE64_SHUFFLE, REST_BASE64_SHUFFLE);
+    const __m256i offsets = _mm256_setr_epi8(REST_BASE64_OFFSETS, REST_BASE64_OFFSETS);
+    char *start = output;
+    __m256i input, indices, shifted, result;
+
+    // Lanes are loaded 12 bytes apart, the upper one reads 16 bytes
+    for (; length >= 28; length -= 24, data += 24, output += 32)
+    {
+        input = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)data)),
+                    _mm_loadu_si128((const __m128i *)(data + 12)), 1);
+        input = _mm256_shuffle_epi8(input, shuffle);
+
+        indices = _mm256_or_si256(
+                      _mm256_mulhi_epu16(_mm256_and_si256(input, _mm256_set1_epi32(0x0fc0fc00)),
+                                         _mm256_set1_epi32(0x04000040)),
+                      _mm256_mullo_epi16(_mm256_and_si256(input, _mm256_set1_epi32(0x003f03f0)),
+                                         _mm256_set1_epi32(0x01000010)));
+
+        shifted = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        shifted = _mm256_or_si256(shifted,
+                                  _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices),
+                                                   _mm256_set1_epi8(13)));
+        result = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, shifted), indices);
+
+        _mm256_storeu_si256((__m256i *)output, result);
+    }
+
+    output += rest_base64_encode_ssse3_blocks(data, length, output);
+
+    return output - start;
+}
+
+#endif // REST_BASE64_X86
+
+static void rest_base64_select(void)
+{
+    rest_base64_encoder = rest_base64_encode_scalar;
+    rest_base64_name = "scalar";
+
+#ifdef REST_BASE64_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        rest_base64_encoder = rest_base64_encode_avx2;
+        rest_base64_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        rest_base64_encoder = rest_base64_encode_ssse3;
+        rest_base64_name = "ssse3";
+    }
+#endif
+}
+
+size_t rest_base64_encode(const uint8_t *data, size_t length, char *output)
+{
+    size_t written;
+
+    pthread_once(&rest_base64_once, rest_base64_select);
+
+    written = rest_base64_encoder(data, length, output);
+    output[written] = '\0';
+
+    return written;
+}
+
+const char *rest_base64_implementation(void)
+{
+    pthread_once(&rest_base64_once, rest_base64_select);
+
+    return rest_base64_name;
+}
@@ -0,0 +1,55 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_BASE64_H
+#define REST_BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Returns length of base64 encoding (with padding, without null-terminator).
+ *
+ * @param[in]  length  Length of the data
+ *
+ * @return Number of base64 characters
+ */
+size_t rest_base64_encoded_length(size_t length);
+
+/**
+ * Encodes data to base64 with padding. Vectorized implementation (AVX2 or
+ * SSSE3) is selected on first use according to CPU features, with scalar
+ * fallback. Thread-safe.
+ *
+ * @param[in]  data    Data to encode
+ * @param[in]  length  Length of the data
+ * @param[out] output  Buffer of at least rest_base64_encoded_length() + 1 bytes
+ *
+ * @return Number of characters written (without null-terminator)
+ */
+size_t rest_base64_encode(const uint8_t *data, size_t length, char *output);
+
+/**
+ * Returns name of the selected implementation ("avx2", "ssse3" or "scalar").
+ *
+ * @return Implementation name
+ */
+const char *rest_base64_implementation(void);
+
+#endif // REST_BASE64_H
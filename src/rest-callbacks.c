@@ -0,0 +1,446 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#define LOG_MODULE LOG_MODULE_CALLBACK
+
+#include "rest-callbacks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "metrics.h"
+#include "restserver.h"
+
+static metric_t metric_filtered = METRIC_COUNTER_INIT("callback.events_filtered");
+static metric_t metric_dropped = METRIC_COUNTER_INIT("callback.events_dropped");
+
+void rest_notification_source_set(rest_notification_source_t *source,
+                                  const lwm2m_client_t *client, const lwm2m_uri_t *uri)
+{
+    source->name = client != NULL ? client->name : NULL;
+    source->type = client != NULL ? client->type : NULL;
+    source->path[0] = '\0';
+
+    if (uri == NULL)
+    {
+        return;
+    }
+
+    if (LWM2M_URI_IS_SET_RESOURCE(uri))
+    {
+        snprintf(source->path, sizeof(source->path), "/%u/%u/%u",
+                 uri->objectId, uri->instanceId, uri->resourceId);
+    }
+    else if (LWM2M_URI_IS_SET_INSTANCE(uri))
+    {
+        snprintf(source->path, sizeof(source->path), "/%u/%u", uri->objectId, uri->instanceId);
+    }
+    else
+    {
+        snprintf(source->path, sizeof(source->path), "/%u", uri->objectId);
+    }
+}
+
+static int rest_callback_filter_parse_events(rest_callback_filter_t *filter, const json_t *jevents)
+{
+    rest_notification_type_t type;
+    json_t *jevent;
+    size_t index;
+
+    if (!json_is_array(jevents) || json_array_size(jevents) == 0)
+    {
+        return -1;
+    }
+
+    json_array_foreach(jevents, index, jevent)
+    {
+        if (!json_is_string(jevent)
+            || rest_notification_type_parse(json_string_value(jevent), &type) != 0)
+        {
+            return -1;
+        }
+        filter->types |= 1u << type;
+    }
+
+    return 0;
+}
+
+int rest_callback_filter_parse(rest_callback_filter_t *filter, const json_t *jfilter)
+{
+    const char *key;
+    json_t *value;
+
+    memset(filter, 0, sizeof(rest_callback_filter_t));
+
+    if (jfilter == NULL)
+    {
+        return 0;
+    }
+
+    if (!json_is_object(jfilter))
+    {
+        return -1;
+    }
+
+    json_object_foreach((json_t *)jfilter, key, value)
+    {
+        if (strcmp(key, "events") == 0)
+        {
+            if (rest_callback_filter_parse_events(filter, value) != 0)
+            {
+                goto error;
+            }
+        }
+        else if (strcmp(key, "endpoint") == 0)
+        {
+            // Compiled once, events are matched without allocations
+            if (!json_is_string(value)
+                || regcomp(&filter->name, json_string_value(value), REG_EXTENDED | REG_NOSUB) != 0)
+            {
+                goto error;
+            }
+            filter->has_name = true;
+        }
+        else if (strcmp(key, "endpoint_type") == 0)
+        {
+            if (!json_is_string(value))
+            {
+                goto error;
+            }
+            filter->type = strdup(json_string_value(value));
+            if (filter->type == NULL)
+            {
+                goto error;
+            }
+        }
+        else if (strcmp(key, "path") == 0)
+        {
+            if (!json_is_string(value) || json_string_value(value)[0] != '/')
+            {
+                goto error;
+            }
+            filter->path = strdup(json_string_value(value));
+            if (filter->path == NULL)
+            {
+                goto error;
+            }
+
+            // "/3/0/" and "/3/0" are the same prefix
+            filter->path_length = strlen(filter->path);
+            while (filter->path_length > 1 && filter->path[filter->path_length - 1] == '/')
+            {
+                filter->path[--filter->path_length] = '\0';
+            }
+        }
+        else
+        {
+            goto error;
+        }
+    }
+
+    return 0;
+
+error:
+    rest_callback_filter_cleanup(filter);
+    return -1;
+}
+
+void rest_callback_filter_cleanup(rest_callback_filter_t *filter)
+{
+    if (filter->has_name)
+    {
+        regfree(&filter->name);
+    }
+    free(filter->type);
+    free(filter->path);
+
+    memset(filter, 0, sizeof(rest_callback_filter_t));
+}
+
+bool rest_callback_filter_match(const rest_callback_filter_t *filter, rest_notification_type_t type,
+                                const rest_notification_source_t *source)
+{
+    if (filter->types != 0 && (filter->types & (1u << type)) == 0)
+    {
+        return false;
+    }
+
+    if (filter->has_name
+        && (source == NULL || source->name == NULL
+            || regexec(&filter->name, source->name, 0, NULL, 0) != 0))
+    {
+        return false;
+    }
+
+    if (filter->type != NULL
+        && (source == NULL || source->type == NULL || strcmp(filter->type, source->type) != 0))
+    {
+        return false;
+    }
+
+    if (filter->path == NULL)
+    {
+        return true;
+    }
+
+    // Only async responses have a path
+    if (source == NULL || source->path[0] == '\0')
+    {
+        return false;
+    }
+
+    // Prefix must end at a path segment boundary, "/3" does not match "/33"
+    return filter->path_length == 1
+           || (strncmp(source->path, filter->path, filter->path_length) == 0
+               && (source->path[filter->path_length] == '\0'
+                   || source->path[filter->path_length] == '/'));
+}
+
+static void rest_callback_reset(rest_callback_t *callback)
+{
+    size_t i;
+
+    for (i = 0; i < REST_CALLBACK_GROUP_COUNT; i++)
+    {
+        rest_json_writer_cleanup(&callback->json[i]);
+        rest_json_writer_init(&callback->json[i]);
+        rest_cbor_cleanup(&callback->items[i]);
+        rest_cbor_init(&callback->items[i]);
+        callback->counts[i] = 0;
+    }
+
+    callback->records = 0;
+    callback->bytes = 0;
+    callback->batch_start = 0;
+}
+
+rest_callback_t *rest_callback_new(const char *name)
+{
+    rest_callback_t *callback;
+    size_t i;
+
+    callback = calloc(1, sizeof(rest_callback_t));
+    if (callback == NULL)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < REST_CALLBACK_GROUP_COUNT; i++)
+    {
+        rest_json_writer_init(&callback->json[i]);
+        rest_cbor_init(&callback->items[i]);
+    }
+
+    callback->name = strdup(name);
+    callback->delivery = rest_delivery_new();
+    if (callback->name == NULL || callback->delivery == NULL
+        || rest_delivery_start(callback->delivery) != 0)
+    {
+        rest_callback_delete(callback);
+        return NULL;
+    }
+
+    metrics_register(&metric_filtered);
+    metrics_register(&metric_dropped);
+
+    return callback;
+}
+
+void rest_callback_delete(rest_callback_t *callback)
+{
+    size_t i;
+
+    if (callback->delivery != NULL)
+    {
+        rest_delivery_delete(callback->delivery);
+    }
+
+    for (i = 0; i < REST_CALLBACK_GROUP_COUNT; i++)
+    {
+        rest_json_writer_cleanup(&callback->json[i]);
+        rest_cbor_cleanup(&callback->items[i]);
+    }
+
+    rest_callback_filter_cleanup(&callback->filter);
+    if (callback->jcallback != NULL)
+    {
+        json_decref(callback->jcallback);
+    }
+    free(callback->name);
+    free(callback);
+}
+
+void rest_callback_set(rest_callback_t *callback, json_t *jcallback,
+                       rest_callback_filter_t *filter)
+{
+    json_t *jaccept = json_object_get(jcallback, "accept");
+
+    if (callback->jcallback != NULL)
+    {
+        json_decref(callback->jcallback);
+    }
+    callback->jcallback = jcallback;
+    callback->cbor = jaccept != NULL
+                     && strcmp(json_string_value(jaccept), REST_CONTENT_TYPE_CBOR) == 0;
+
+    rest_callback_filter_cleanup(&callback->filter);
+    callback->filter = *filter;
+    memset(filter, 0, sizeof(rest_callback_filter_t));
+}
+
+bool rest_callback_append(rest_callback_t *callback, const rest_notification_t *notification,
+                          const rest_notification_source_t *source, int64_t now, bool accept)
+{
+    size_t group = notification->type, length;
+
+    if (!rest_callback_filter_match(&callback->filter, notification->type, source))
+    {
+        metrics_add(&metric_filtered, 1);
+        return false;
+    }
+
+    if (!accept)
+    {
+        metrics_add(&metric_dropped, 1);
+        return false;
+    }
+
+    if (callback->records == 0)
+    {
+        callback->batch_start = now;
+    }
+
+    if (callback->cbor)
+    {
+        length = callback->items[group].length;
+        rest_notification_to_cbor(&callback->items[group], notification, false);
+        callback->bytes += callback->items[group].length - length;
+    }
+    else
+    {
+        length = callback->json[group].length;
+        rest_notification_to_json(&callback->json[group], notification, false);
+        callback->bytes += callback->json[group].length - length;
+    }
+
+    callback->counts[group]++;
+    callback->records++;
+    callback->last_seq = notification->seq;
+
+    return true;
+}
+
+static void rest_callback_body_json(rest_callback_t *callback, rest_json_writer_t *writer)
+{
+    size_t group;
+
+    rest_json_writer_reserve(writer, callback->bytes + REST_CALLBACK_GROUP_COUNT * 32);
+
+    // Same layout as the batches of the default callback
+    rest_json_object_start(writer);
+    for (group = 0; group < REST_CALLBACK_GROUP_COUNT; group++)
+    {
+        rest_json_key(writer, rest_notification_group(group));
+        rest_json_array_start(writer);
+        if (callback->json[group].length > 0)
+        {
+            rest_json_rawn(writer, callback->json[group].data, callback->json[group].length);
+        }
+        rest_json_array_end(writer);
+
+        if (rest_json_writer_failed(&callback->json[group]))
+        {
+            writer->failed = true;
+        }
+    }
+    rest_json_object_end(writer);
+}
+
+static void rest_callback_body_cbor(rest_callback_t *callback, rest_cbor_t *cbor)
+{
+    size_t group;
+
+    rest_cbor_map(cbor, REST_CALLBACK_GROUP_COUNT);
+    for (group = 0; group < REST_CALLBACK_GROUP_COUNT; group++)
+    {
+        rest_cbor_text(cbor, rest_notification_group(group));
+        rest_cbor_array(cbor, callback->counts[group]);
+        rest_cbor_encoded(cbor, callback->items[group].data, callback->items[group].length);
+
+        if (rest_cbor_failed(&callback->items[group]))
+        {
+            cbor->failed = true;
+        }
+    }
+}
+
+int rest_callback_flush(rest_callback_t *callback)
+{
+    rest_json_writer_t writer;
+    rest_cbor_t cbor;
+    const char *content_type;
+    uint8_t *data;
+    size_t length;
+    bool failed;
+
+    if (callback->records == 0)
+    {
+        return 0;
+    }
+
+    if (callback->cbor)
+    {
+        rest_cbor_init(&cbor);
+        rest_callback_body_cbor(callback, &cbor);
+        content_type = REST_CONTENT_TYPE_CBOR;
+        data = cbor.data;
+        length = cbor.length;
+        failed = rest_cbor_failed(&cbor);
+    }
+    else
+    {
+        rest_json_writer_init(&writer);
+        rest_callback_body_json(callback, &writer);
+        content_type = REST_CONTENT_TYPE_JSON;
+        data = (uint8_t *)writer.data;
+        length = writer.length;
+        failed = rest_json_writer_failed(&writer);
+    }
+    rest_callback_reset(callback);
+
+    if (failed)
+    {
+        free(data);
+        log_message(LOG_LEVEL_ERROR, "[CALLBACK] Failed to encode notifications for \"%s\"\n",
+                    callback->name);
+        return -1;
+    }
+
+    // Buffer ownership is handed over to the queue
+    if (rest_delivery_enqueue(callback->delivery, callback->jcallback, content_type, data, length,
+                              callback->last_seq) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[CALLBACK] Failed to queue notifications for \"%s\"\n",
+                    callback->name);
+        return -1;
+    }
+
+    return 0;
+}
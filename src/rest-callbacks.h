@@ -0,0 +1,180 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef REST_CALLBACKS_H
+#define REST_CALLBACKS_H
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <jansson.h>
+#include <liblwm2m.h>
+
+#include "rest-cbor.h"
+#include "rest-delivery.h"
+#include "rest-json.h"
+#include "rest-notification-log.h"
+
+#define REST_CALLBACKS_MAX          16
+#define REST_CALLBACK_NAME_LENGTH   64
+#define REST_CALLBACK_GROUP_COUNT   4
+#define REST_NOTIFICATION_PATH_LENGTH 24
+
+/*
+ * Endpoint (and resource) an event originates from, events are matched
+ * against callback filters by it.
+ */
+typedef struct
+{
+    const char *name;
+    const char *type;
+    char path[REST_NOTIFICATION_PATH_LENGTH];
+} rest_notification_source_t;
+
+/*
+ * Precompiled event filter, empty criteria match every event.
+ */
+typedef struct
+{
+    uint32_t types;
+    bool has_name;
+    regex_t name;
+    char *type;
+    char *path;
+    size_t path_length;
+} rest_callback_filter_t;
+
+/*
+ * Named callback subscription. Matching events are serialized into the open
+ * batch as they arrive, one buffer per event group, and the finished batch
+ * is sent by its own delivery thread, so subscribers do not hold back each
+ * other.
+ */
+typedef struct rest_callback_t
+{
+    struct rest_callback_t *next;
+    char *name;
+    json_t *jcallback;
+    rest_callback_filter_t filter;
+    bool cbor;
+
+    rest_json_writer_t json[REST_CALLBACK_GROUP_COUNT];
+    rest_cbor_t items[REST_CALLBACK_GROUP_COUNT];
+    size_t counts[REST_CALLBACK_GROUP_COUNT];
+    size_t records;
+    size_t bytes;
+    uint64_t last_seq;
+    int64_t batch_start;
+
+    rest_delivery_t *delivery;
+} rest_callback_t;
+
+/**
+ * Fills event source from LwM2M client and requested path.
+ *
+ * @param[out] source  Event source
+ * @param[in]  client  Client the event relates to, may be NULL
+ * @param[in]  uri     Resource path, NULL for registration events
+ */
+void rest_notification_source_set(rest_notification_source_t *source,
+                                  const lwm2m_client_t *client, const lwm2m_uri_t *uri);
+
+/**
+ * Compiles filter from its JSON representation, an object with optional
+ * "events" (array of event types), "endpoint" (extended regular expression
+ * of the endpoint name), "endpoint_type" and "path" (resource path prefix).
+ *
+ * @param[out] filter   Filter
+ * @param[in]  jfilter  JSON object, NULL for a filter which matches every event
+ *
+ * @return 0 on success, -1 if the filter is not valid
+ */
+int rest_callback_filter_parse(rest_callback_filter_t *filter, const json_t *jfilter);
+
+/**
+ * Releases compiled filter.
+ *
+ * @param[in]  filter  Filter
+ */
+void rest_callback_filter_cleanup(rest_callback_filter_t *filter);
+
+/**
+ * Matches event against the filter.
+ *
+ * @param[in]  filter  Filter
+ * @param[in]  type    Event type
+ * @param[in]  source  Event origin, NULL if unknown (matches only filters without origin criteria)
+ *
+ * @return true if the event passes the filter
+ */
+bool rest_callback_filter_match(const rest_callback_filter_t *filter, rest_notification_type_t type,
+                                const rest_notification_source_t *source);
+
+/**
+ * Creates callback subscription and starts its delivery thread.
+ *
+ * @param[in]  name  Subscription name
+ *
+ * @return Pointer to a new subscription or NULL on error
+ */
+rest_callback_t *rest_callback_new(const char *name);
+
+/**
+ * Stops delivery thread (waiting for a request in progress) and releases the
+ * subscription, undelivered batches are dropped.
+ *
+ * @param[in]  callback  Pointer to the subscription
+ */
+void rest_callback_delete(rest_callback_t *callback);
+
+/**
+ * Sets callback target and filter, the open batch must be flushed beforehand.
+ *
+ * @param[in]  callback   Pointer to the subscription
+ * @param[in]  jcallback  Callback object (reference is taken over)
+ * @param[in]  filter     Compiled filter (taken over)
+ */
+void rest_callback_set(rest_callback_t *callback, json_t *jcallback,
+                       rest_callback_filter_t *filter);
+
+/**
+ * Matches event against the filter and serializes it into the open batch if
+ * it passes.
+ *
+ * @param[in]  callback      Pointer to the subscription
+ * @param[in]  notification  Event (with data)
+ * @param[in]  source        Event source, NULL if unknown
+ * @param[in]  now           Current monotonic time in microseconds
+ * @param[in]  accept        false if the batch can not grow, matching event is dropped
+ *
+ * @return true if the event was added to the batch
+ */
+bool rest_callback_append(rest_callback_t *callback, const rest_notification_t *notification,
+                          const rest_notification_source_t *source, int64_t now, bool accept);
+
+/**
+ * Hands the open batch over to the delivery thread.
+ *
+ * @param[in]  callback  Pointer to the subscription
+ *
+ * @return 0 on success (or if the batch is empty), -1 on error
+ */
+int rest_callback_flush(rest_callback_t *callback);
+
+#endif // REST_CALLBACKS_H
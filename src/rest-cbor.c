@@ -0,0 +1,311 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rest-cbor.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REST_CBOR_INITIAL_CAPACITY 256
+
+#define REST_CBOR_UINT 0
+#define REST_CBOR_NEGINT 1
+#define REST_CBOR_BYTES 2
+#define REST_CBOR_TEXT 3
+#define REST_CBOR_ARRAY 4
+#define REST_CBOR_MAP 5
+#define REST_CBOR_SIMPLE 7
+
+#define REST_CBOR_FALSE 20
+#define REST_CBOR_TRUE 21
+#define REST_CBOR_NULL 22
+#define REST_CBOR_FLOAT64 27
+#define REST_CBOR_INDEFINITE 31
+
+
+static uint8_t *rest_cbor_reserve(rest_cbor_t *cbor, size_t length)
+{
+    size_t capacity;
+    uint8_t *data;
+
+    if (cbor->failed)
+    {
+        return NULL;
+    }
+
+    if (cbor->length + length > cbor->capacity)
+    {
+        capacity = cbor->capacity > 0 ? cbor->capacity : REST_CBOR_INITIAL_CAPACITY;
+        while (capacity < cbor->length + length)
+        {
+            capacity *= 2;
+        }
+
+        data = realloc(cbor->data, capacity);
+        if (data == NULL)
+        {
+            cbor->failed = true;
+            return NULL;
+        }
+
+        cbor->data = data;
+        cbor->capacity = capacity;
+    }
+
+    data = cbor->data + cbor->length;
+    cbor->length += length;
+
+    return data;
+}
+
+static void rest_cbor_head(rest_cbor_t *cbor, uint8_t major, uint64_t value)
+{
+    uint8_t *data;
+    size_t size, i;
+
+    if (value < 24)
+    {
+        size = 0;
+    }
+    else if (value <= UINT8_MAX)
+    {
+        size = 1;
+    }
+    else if (value <= UINT16_MAX)
+    {
+        size = 2;
+    }
+    else if (value <= UINT32_MAX)
+    {
+        size = 4;
+    }
+    else
+    {
+        size = 8;
+    }
+
+    data = rest_cbor_reserve(cbor, 1 + size);
+    if (data == NULL)
+    {
+        return;
+    }
+
+    switch (size)
+    {
+    case 0:
+        data[0] = major << 5 | value;
+        return;
+    case 1:
+        data[0] = major << 5 | 24;
+        break;
+    case 2:
+        data[0] = major << 5 | 25;
+        break;
+    case 4:
+        data[0] = major << 5 | 26;
+        break;
+    default:
+        data[0] = major << 5 | 27;
+        break;
+    }
+
+    // Network byte order
+    for (i = 0; i < size; i++)
+    {
+        data[size - i] = value >> (8 * i);
+    }
+}
+
+static void rest_cbor_raw(rest_cbor_t *cbor, uint8_t major, const void *data, size_t length)
+{
+    uint8_t *buffer;
+
+    rest_cbor_head(cbor, major, length);
+
+    buffer = rest_cbor_reserve(cbor, length);
+    if (buffer != NULL && length > 0)
+    {
+        memcpy(buffer, data, length);
+    }
+}
+
+void rest_cbor_init(rest_cbor_t *cbor)
+{
+    memset(cbor, 0, sizeof(rest_cbor_t));
+}
+
+void rest_cbor_cleanup(rest_cbor_t *cbor)
+{
+    free(cbor->data);
+    rest_cbor_init(cbor);
+}
+
+bool rest_cbor_failed(const rest_cbor_t *cbor)
+{
+    return cbor->failed;
+}
+
+void rest_cbor_map(rest_cbor_t *cbor, size_t count)
+{
+    rest_cbor_head(cbor, REST_CBOR_MAP, count);
+}
+
+void rest_cbor_array(rest_cbor_t *cbor, size_t count)
+{
+    rest_cbor_head(cbor, REST_CBOR_ARRAY, count);
+}
+
+void rest_cbor_array_start(rest_cbor_t *cbor)
+{
+    uint8_t *data = rest_cbor_reserve(cbor, 1);
+
+    if (data != NULL)
+    {
+        data[0] = REST_CBOR_ARRAY << 5 | REST_CBOR_INDEFINITE;
+    }
+}
+
+void rest_cbor_break(rest_cbor_t *cbor)
+{
+    uint8_t *data = rest_cbor_reserve(cbor, 1);
+
+    if (data != NULL)
+    {
+        data[0] = 0xff;
+    }
+}
+
+void rest_cbor_uint(rest_cbor_t *cbor, uint64_t value)
+{
+    rest_cbor_head(cbor, REST_CBOR_UINT, value);
+}
+
+void rest_cbor_int(rest_cbor_t *cbor, int64_t value)
+{
+    if (value < 0)
+    {
+        // -1 - n without overflowing on INT64_MIN
+        rest_cbor_head(cbor, REST_CBOR_NEGINT, ~(uint64_t)value);
+    }
+    else
+    {
+        rest_cbor_head(cbor, REST_CBOR_UINT, value);
+    }
+}
+
+void rest_cbor_double(rest_cbor_t *cbor, double value)
+{
+    uint64_t bits;
+    uint8_t *data;
+    int i;
+
+    data = rest_cbor_reserve(cbor, 9);
+    if (data == NULL)
+    {
+        return;
+    }
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    data[0] = REST_CBOR_SIMPLE << 5 | REST_CBOR_FLOAT64;
+    for (i = 0; i < 8; i++)
+    {
+        data[8 - i] = bits >> (8 * i);
+    }
+}
+
+void rest_cbor_bool(rest_cbor_t *cbor, bool value)
+{
+    rest_cbor_head(cbor, REST_CBOR_SIMPLE, value ? REST_CBOR_TRUE : REST_CBOR_FALSE);
+}
+
+void rest_cbor_null(rest_cbor_t *cbor)
+{
+    rest_cbor_head(cbor, REST_CBOR_SIMPLE, REST_CBOR_NULL);
+}
+
+void rest_cbor_text(rest_cbor_t *cbor, const char *text)
+{
+    rest_cbor_raw(cbor, REST_CBOR_TEXT, text, strlen(text));
+}
+
+void rest_cbor_textn(rest_cbor_t *cbor, const char *text, size_t length)
+{
+    rest_cbor_raw(cbor, REST_CBOR_TEXT, text, length);
+}
+
+void rest_cbor_bytes(rest_cbor_t *cbor, const uint8_t *data, size_t length)
+{
+    rest_cbor_raw(cbor, REST_CBOR_BYTES, data, length);
+}
+
+void rest_cbor_encoded(rest_cbor_t *cbor, const uint8_t *data, size_t length)
+{
+    uint8_t *buffer;
+
+    buffer = rest_cbor_reserve(cbor, length);
+    if (buffer != NULL && length > 0)
+    {
+        memcpy(buffer, data, length);
+    }
+}
+
+void rest_cbor_json(rest_cbor_t *cbor, const json_t *json)
+{
+    const char *key;
+    json_t *value;
+    size_t index;
+
+    switch (json_typeof(json))
+    {
+    case JSON_OBJECT:
+        rest_cbor_map(cbor, json_object_size(json));
+        json_object_foreach((json_t *)json, key, value)
+        {
+            rest_cbor_text(cbor, key);
+            rest_cbor_json(cbor, value);
+        }
+        break;
+    case JSON_ARRAY:
+        rest_cbor_array(cbor, json_array_size(json));
+        json_array_foreach(json, index, value)
+        {
+            rest_cbor_json(cbor, value);
+        }
+        break;
+    case JSON_STRING:
+        rest_cbor_textn(cbor, json_string_value(json), json_string_length(json));
+        break;
+    case JSON_INTEGER:
+        rest_cbor_int(cbor, json_integer_value(json));
+        break;
+    case JSON_REAL:
+        rest_cbor_double(cbor, json_real_value(json));
+        break;
+    case JSON_TRUE:
+        rest_cbor_bool(cbor, true);
+        break;
+    case JSON_FALSE:
+        rest_cbor_bool(cbor, false);
+        break;
+    default:
+        rest_cbor_null(cbor);
+        break;
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_CBOR_H
+#define REST_CBOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <jansson.h>
+
+/*
+ * Streaming CBOR (RFC 7049) writer, items are encoded directly into a
+ * growing buffer. Allocation failure is sticky and reported by
+ * rest_cbor_failed(), so items can be written without checking each call.
+ */
+typedef struct
+{
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} rest_cbor_t;
+
+/**
+ * Initializes empty writer.
+ *
+ * @param[in]  cbor  Pointer to the writer
+ */
+void rest_cbor_init(rest_cbor_t *cbor);
+
+/**
+ * Releases buffer of the writer.
+ *
+ * @param[in]  cbor  Pointer to the writer
+ */
+void rest_cbor_cleanup(rest_cbor_t *cbor);
+
+/**
+ * Checks whether any of the items failed to be written.
+ *
+ * @param[in]  cbor  Pointer to the writer
+ *
+ * @return true if the buffer is incomplete
+ */
+bool rest_cbor_failed(const rest_cbor_t *cbor);
+
+/**
+ * Starts a map of definite number of key/value pairs.
+ *
+ * @param[in]  cbor   Pointer to the writer
+ * @param[in]  count  Number of pairs, which follow
+ */
+void rest_cbor_map(rest_cbor_t *cbor, size_t count);
+
+/**
+ * Starts an array of definite number of items.
+ *
+ * @param[in]  cbor   Pointer to the writer
+ * @param[in]  count  Number of items, which follow
+ */
+void rest_cbor_array(rest_cbor_t *cbor, size_t count);
+
+/**
+ * Starts an indefinite length array, which is terminated with rest_cbor_break().
+ *
+ * @param[in]  cbor  Pointer to the writer
+ */
+void rest_cbor_array_start(rest_cbor_t *cbor);
+
+/**
+ * Terminates indefinite length item.
+ *
+ * @param[in]  cbor  Pointer to the writer
+ */
+void rest_cbor_break(rest_cbor_t *cbor);
+
+void rest_cbor_uint(rest_cbor_t *cbor, uint64_t value);
+void rest_cbor_int(rest_cbor_t *cbor, int64_t value);
+void rest_cbor_double(rest_cbor_t *cbor, double value);
+void rest_cbor_bool(rest_cbor_t *cbor, bool value);
+void rest_cbor_null(rest_cbor_t *cbor);
+void rest_cbor_text(rest_cbor_t *cbor, const char *text);
+void rest_cbor_textn(rest_cbor_t *cbor, const char *text, size_t length);
+void rest_cbor_bytes(rest_cbor_t *cbor, const uint8_t *data, size_t length);
+
+/**
+ * Appends already encoded items as is.
+ *
+ * @param[in]  cbor    Pointer to the writer
+ * @param[in]  data    Encoded items
+ * @param[in]  length  Length of the data
+ */
+void rest_cbor_encoded(rest_cbor_t *cbor, const uint8_t *data, size_t length);
+
+/**
+ * Writes JSON value as the equivalent CBOR item.
+ *
+ * @param[in]  cbor  Pointer to the writer
+ * @param[in]  json  JSON value
+ */
+void rest_cbor_json(rest_cbor_t *cbor, const json_t *json);
+
+#endif // REST_CBOR_H
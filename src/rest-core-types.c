@@ -19,38 +19,54 @@
 
 #include "rest-core-types.h"
 
-#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 #include <liblwm2m.h>
 
+#include "rest-random.h"
 
-static const char *base64_table =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char *hex_table = "0123456789abcdef";
 
 size_t rest_get_random(void *buf, size_t buflen)
 {
-    FILE *f;
-    size_t len;
+    return rest_random_fill(buf, buflen) == 0 ? buflen : 0;
+}
+
+static char *rest_format_uint(char *buffer, uint32_t value)
+{
+    char digits[10];
+    int count = 0;
 
-    f = fopen("/dev/urandom", "r");
-    if (f == NULL)
+    do
     {
-        return 0;
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (count > 0)
+    {
+        *buffer++ = digits[--count];
     }
 
-    len = fread(buf, 1, buflen, f);
-    fclose(f);
-    return len;
+    return buffer;
 }
 
-rest_async_response_t *rest_async_response_new(void)
+static char *rest_format_hex16(char *buffer, uint16_t value)
+{
+    buffer[0] = hex_table[(value >> 12) & 0xf];
+    buffer[1] = hex_table[(value >> 8) & 0xf];
+    buffer[2] = hex_table[(value >> 4) & 0xf];
+    buffer[3] = hex_table[value & 0xf];
+
+    return buffer + 4;
+}
+
+static rest_async_response_t *rest_async_response_alloc(void)
 {
     rest_async_response_t *response;
-    uint32_t ts;
-    uint16_t r[6];
 
     response = malloc(sizeof(rest_async_response_t));
     if (response == NULL)
@@ -59,14 +75,41 @@ rest_async_response_t *rest_async_response_new(void)
     }
     memset(response, 0, sizeof(rest_async_response_t));
 
-    ts = time(NULL);
-    if (rest_get_random(r, sizeof(r)) != sizeof(r))
+    return response;
+}
+
+rest_async_response_t *rest_async_response_new(void)
+{
+    rest_async_response_t *response;
+    uint16_t r[6];
+    char *id;
+    int i;
+
+    response = rest_async_response_alloc();
+    if (response == NULL)
+    {
+        return NULL;
+    }
+
+    if (rest_random_fill(r, sizeof(r)) != 0)
     {
+        free(response);
         return NULL;
     }
 
-    snprintf(response->id, sizeof(response->id), "%u#%04x%04x-%04x-%04x-%04x-%04x",
-             ts, r[0], r[1], r[2], r[3], r[4], r[5]);
+    // Same as "%u#%04x%04x-%04x-%04x-%04x-%04x", at most 39 characters
+    id = rest_format_uint(response->id, time(NULL));
+    *id++ = '#';
+    id = rest_format_hex16(id, r[0]);
+    for (i = 1; i < 6; i++)
+    {
+        if (i > 1)
+        {
+            *id++ = '-';
+        }
+        id = rest_format_hex16(id, r[i]);
+    }
+    *id = '\0';
 
     return response;
 }
@@ -75,7 +118,8 @@ rest_async_response_t *rest_async_response_clone(const rest_async_response_t *re
 {
     rest_async_response_t *clone;
 
-    clone = rest_async_response_new();
+    // Clone shares the ID, so there is no need to generate a new one
+    clone = rest_async_response_alloc();
     if (clone == NULL)
     {
         return NULL;
@@ -95,62 +139,12 @@ void rest_async_response_delete(rest_async_response_t *response)
         free((void *)response->payload);
     }
 
-    free(response);
-}
-
-const char *base64_encode(const uint8_t *data, size_t length)
-{
-    size_t buffer_length = ((length + 2) / 3) * 4 + 1; // +1 for null-terminator
-    char *buffer;
-    static uint8_t previous_byte;
-    int data_index = 0,
-        buffer_index = 0;
-
-    buffer = malloc(buffer_length);
-    if (buffer == NULL)
-    {
-        return NULL;
-    }
-
-    for (data_index = 0; data_index < length; data_index++)
-    {
-        switch (data_index % 3)
-        {
-        case 2:
-            buffer[buffer_index++] = base64_table[
-                                         ((previous_byte & 0x0f) << 2) + ((data[data_index] & 0xc0) >> 6)
-                                     ];
-            buffer[buffer_index++] = base64_table[data[data_index] & 0x3f];
-            break;
-        case 1:
-            buffer[buffer_index++] = base64_table[
-                                         ((previous_byte & 0x03) << 4) + ((data[data_index] & 0xf0) >> 4)
-                                     ];
-            break;
-        case 0:
-            buffer[buffer_index++] = base64_table[(data[data_index] & 0xfc) >> 2];
-            break;
-        }
-        previous_byte = data[data_index];
-    }
-
-    if ((data_index % 3) == 2)
+    if (response->values != NULL)
     {
-        buffer[buffer_index++] = base64_table[(previous_byte & 0x0f) << 2];
-        buffer[buffer_index++] = '=';
+        free((void *)response->values);
     }
-    else if ((data_index % 3) == 1)
-    {
-        buffer[buffer_index++] = base64_table[(previous_byte & 0x03) << 4];
-        buffer[buffer_index++] = '=';
-        buffer[buffer_index++] = '=';
-    }
-
-    buffer[buffer_index++] = '\0';
 
-    assert(buffer_index == buffer_length);
-
-    return buffer;
+    free(response);
 }
 
 int rest_async_response_set(rest_async_response_t *response, int status,
@@ -165,12 +159,20 @@ int rest_async_response_set(rest_async_response_t *response, int status,
         response->payload = NULL;
     }
 
-    response->payload = base64_encode(payload, length);
+    // Raw payload is kept, it is encoded as needed by the response format
+    response->payload = malloc(length > 0 ? length : 1);
     if (response->payload == NULL)
     {
+        response->payload_length = 0;
         return -1;
     }
 
+    if (length > 0)
+    {
+        memcpy((void *)response->payload, payload, length);
+    }
+    response->payload_length = length;
+
     return 0;
 }
 
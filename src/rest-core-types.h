@@ -32,7 +32,9 @@ typedef struct
     time_t timestamp;
     char id[40];
     int status;
-    const char *payload;
+    const uint8_t *payload;
+    size_t payload_length;
+    const char *values;
 } rest_notif_async_response_t;
 
 typedef rest_notif_async_response_t rest_async_response_t;
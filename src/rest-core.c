@@ -17,100 +17,270 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_CALLBACK
+
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "logging.h"
+#include "metrics.h"
 #include "restserver.h"
 
 void rest_init(rest_context_t *rest)
 {
     memset(rest, 0, sizeof(rest_context_t));
 
-    rest->registrationList = rest_list_new();
-    rest->updateList = rest_list_new();
-    rest->deregistrationList = rest_list_new();
+    rest->callbackDecode = REST_DECODE_NONE;
+    rest->callbackCbor = false;
+    rest->callbackBatchRecords = REST_CALLBACK_BATCH_RECORDS;
+    rest->callbackBatchBytes = REST_CALLBACK_BATCH_BYTES;
+    rest->callbackLinger = REST_CALLBACK_LINGER_MS * 1000;
+    rest->callbackQueueLimit = REST_DELIVERY_QUEUE_LIMIT;
+    rest->streamBufferSize = REST_STREAM_BUFFER_SIZE;
+    rest->notificationLog = rest_notification_log_new();
+    assert(rest->notificationLog != NULL);
     rest->timeoutList = rest_list_new();
-    rest->asyncResponseList = rest_list_new();
     rest->pendingResponseList = rest_list_new();
     rest->observeList = rest_list_new();
 
+    rest->endpointShards = rest_hash_new();
+    assert(rest->endpointShards != NULL);
+    assert(pthread_rwlock_init(&rest->endpointShardsLock, NULL) == 0);
+
+    rest->delivery = rest_delivery_new();
+    assert(rest->delivery != NULL);
+    if (rest_delivery_start(rest->delivery) != 0)
+    {
+        log_message(LOG_LEVEL_FATAL, "Failed to start callback delivery!\n");
+    }
+
     assert(pthread_mutex_init(&rest->mutex, NULL) == 0);
 }
 
 void rest_cleanup(rest_context_t *rest)
 {
+    rest_callback_t *callback;
+    rest_stream_t *stream;
+
+    rest_delivery_delete(rest->delivery);
+    rest->delivery = NULL;
+
+    while (rest->callbacks != NULL)
+    {
+        callback = rest->callbacks;
+        rest->callbacks = callback->next;
+        rest_callback_delete(callback);
+    }
+    rest->callbackCount = 0;
+
+    // HTTP server is already stopped, so streams have no readers left
+    while (rest->streams != NULL)
+    {
+        stream = rest->streams;
+        rest->streams = stream->next;
+        rest_stream_delete(stream);
+    }
+    rest->streamCount = 0;
+
+    if (rest->journal != NULL)
+    {
+        rest_journal_close(rest->journal);
+        rest->journal = NULL;
+    }
+
     if (rest->callback)
     {
         json_decref(rest->callback);
         rest->callback = NULL;
     }
 
-    rest_notifications_clear(rest);
-    rest_list_delete(rest->registrationList);
-    rest_list_delete(rest->updateList);
-    rest_list_delete(rest->deregistrationList);
+    rest_notification_log_delete(rest->notificationLog);
+    rest->notificationLog = NULL;
     rest_list_delete(rest->timeoutList);
-    rest_list_delete(rest->asyncResponseList);
     rest_list_delete(rest->pendingResponseList);
     rest_list_delete(rest->observeList);
 
+    rest_hash_delete(rest->endpointShards);
+    assert(pthread_rwlock_destroy(&rest->endpointShardsLock) == 0);
+
     assert(pthread_mutex_destroy(&rest->mutex) == 0);
 }
 
-int rest_step(rest_context_t *rest, struct timeval *tv)
+/*
+ * Snapshots notifications before the given sequence number into a batch and
+ * hands it over to the delivery thread, so that slow callback receivers never
+ * stall CoAP processing (the caller holds rest_lock()).
+ */
+static int rest_flush_callback(rest_context_t *rest, uint64_t end)
+{
+    rest_json_writer_t writer;
+    rest_cbor_t cbor;
+    const char *content_type;
+    uint8_t *data;
+    size_t length;
+    bool failed;
+
+    if (rest->callbackCbor)
+    {
+        rest_cbor_init(&cbor);
+        rest_notifications_cbor(rest, end, &cbor);
+        content_type = REST_CONTENT_TYPE_CBOR;
+        data = cbor.data;
+        length = cbor.length;
+        failed = rest_cbor_failed(&cbor);
+    }
+    else
+    {
+        rest_json_writer_init(&writer);
+        rest_notifications_json(rest, end, &writer);
+        content_type = REST_CONTENT_TYPE_JSON;
+        data = (uint8_t *)writer.data;
+        length = writer.length;
+        failed = rest_json_writer_failed(&writer);
+    }
+
+    // Notifications stay pending on failure, so the flush is retried on the next step
+    if (failed)
+    {
+        free(data);
+        log_message(LOG_LEVEL_ERROR, "[CALLBACK] Failed to encode notifications\n");
+        return -1;
+    }
+
+    // Buffer ownership is handed over to the queue
+    if (rest_delivery_enqueue(rest->delivery, rest->callback, content_type, data, length,
+                              end - 1) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[CALLBACK] Failed to queue notifications\n");
+        return -1;
+    }
+
+    rest_notification_log_drain_to(rest->notificationLog, end);
+
+    return 0;
+}
+
+static void rest_step_timeout(struct timeval *tv, int64_t timeout)
+{
+    if (timeout < (int64_t)tv->tv_sec * 1000000 + tv->tv_usec)
+    {
+        tv->tv_sec = timeout / 1000000;
+        tv->tv_usec = timeout % 1000000;
+    }
+}
+
+/*
+ * Named callbacks batch their events as they arrive, only batches which
+ * lingered long enough are left to send here.
+ */
+static void rest_step_callbacks(rest_context_t *rest, int64_t now, struct timeval *tv)
 {
-    ulfius_req_t request;
-    ulfius_resp_t response;
-    json_t *jbody;
-    json_t *jheaders;
-    json_t *value;
-    const char *header;
-    struct _u_map headers;
-    int res;
-
-    if ((rest->registrationList->head != NULL
-         || rest->updateList->head != NULL
-         || rest->deregistrationList->head != NULL
-         || rest->asyncResponseList->head != NULL)
-        && rest->callback != NULL)
-    {
-        const char *url = json_string_value(json_object_get(rest->callback, "url"));
-        jheaders = json_object_get(rest->callback, "headers");
-        u_map_init(&headers);
-        json_object_foreach(jheaders, header, value)
+    rest_callback_t *callback;
+    int64_t linger;
+
+    for (callback = rest->callbacks; callback != NULL; callback = callback->next)
+    {
+        if (callback->records == 0)
         {
-            u_map_put(&headers, header, json_string_value(value));
+            continue;
         }
 
-        log_message(LOG_LEVEL_INFO, "[CALLBACK] Sending to %s\n", url);
+        linger = callback->batch_start + rest->callbackLinger - now;
+        if (linger > 0)
+        {
+            rest_step_timeout(tv, linger);
+            continue;
+        }
 
-        jbody = rest_notifications_json(rest);
+        if (rest_delivery_busy(callback->delivery))
+        {
+            rest_step_timeout(tv, REST_CALLBACK_BUSY_POLL_MS * 1000);
+            continue;
+        }
+
+        rest_callback_flush(callback);
+    }
+}
+
+int rest_step(rest_context_t *rest, struct timeval *tv)
+{
+    int64_t now, linger;
+    uint64_t end;
+    bool full;
+
+    now = metrics_time_us();
+    rest_step_callbacks(rest, now, tv);
+
+    if (rest_notification_log_pending(rest->notificationLog) == 0 || rest->callback == NULL)
+    {
+        rest->callbackBatchStart = 0;
+        return 0;
+    }
+
+    if (rest->callbackBatchStart == 0)
+    {
+        rest->callbackBatchStart = now;
+    }
 
-        ulfius_init_request(&request);
-        request.http_verb = strdup("PUT");
-        request.http_url = strdup(url);
-        request.timeout = 20;
-        u_map_copy_into(request.map_header, &headers);
+    /*
+     * Full batches are sent right away, the remainder lingers until it fills
+     * up or the oldest notification waited for long enough.
+     */
+    while (rest_notification_log_pending(rest->notificationLog) > 0)
+    {
+        end = rest_notifications_batch_end(rest, rest->callbackBatchRecords,
+                                           rest->callbackBatchBytes, &full);
 
-        ulfius_set_json_body_request(&request, jbody);
-        json_decref(jbody);
+        linger = rest->callbackBatchStart + rest->callbackLinger - now;
+        if (!full && linger > 0)
+        {
+            rest_step_timeout(tv, linger);
+            return 0;
+        }
 
-        ulfius_init_response(&response);
-        res = ulfius_send_http_request(&request, &response);
-        if (res == U_OK)
+        // Notifications stay pending in the log, where its memory budget applies
+        if (rest_delivery_busy(rest->delivery))
         {
-            rest_notifications_clear(rest);
+            rest_step_timeout(tv, REST_CALLBACK_BUSY_POLL_MS * 1000);
+            return 0;
         }
 
-        u_map_clean(&headers);
-        ulfius_clean_request(&request);
-        ulfius_clean_response(&response);
+        if (rest_flush_callback(rest, end) != 0)
+        {
+            return -1;
+        }
     }
 
+    rest->callbackBatchStart = 0;
+
     return 0;
 }
 
+void rest_set_callback_batching(rest_context_t *rest, size_t max_records, size_t max_bytes,
+                                int max_linger_ms)
+{
+    rest_lock(rest);
+    rest->callbackBatchRecords = max_records;
+    rest->callbackBatchBytes = max_bytes;
+    rest->callbackLinger = (int64_t)max_linger_ms * 1000;
+    rest_unlock(rest);
+}
+
+void rest_set_callback_queue_limit(rest_context_t *rest, size_t queue_limit)
+{
+    rest_callback_t *callback;
+
+    rest_lock(rest);
+    rest->callbackQueueLimit = queue_limit;
+    rest_delivery_set_queue_limit(rest->delivery, queue_limit);
+    for (callback = rest->callbacks; callback != NULL; callback = callback->next)
+    {
+        rest_delivery_set_queue_limit(callback->delivery, queue_limit);
+    }
+    rest_unlock(rest);
+}
+
 void rest_lock(rest_context_t *rest)
 {
     assert(pthread_mutex_lock(&rest->mutex) == 0);
@@ -121,3 +291,13 @@ void rest_unlock(rest_context_t *rest)
     assert(pthread_mutex_unlock(&rest->mutex) == 0);
 }
 
+
+void rest_wakeup(rest_context_t *rest)
+{
+    size_t i;
+
+    for (i = 0; i < rest->shardCount; i++)
+    {
+        rest_shard_wakeup(&rest->shards[i]);
+    }
+}
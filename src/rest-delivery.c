@@ -0,0 +1,726 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOG_MODULE LOG_MODULE_CALLBACK
+
+#include "rest-delivery.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#include "logging.h"
+#include "metrics.h"
+#include "rest-random.h"
+
+#define REST_DELIVERY_TIMEOUT       20
+
+// Retry delays in microseconds, doubled after every consecutive failure
+#define REST_DELIVERY_RETRY_PERIOD      1000000LL
+#define REST_DELIVERY_RETRY_PERIOD_MAX  60000000LL
+#define REST_DELIVERY_RETRY_DOUBLINGS   6
+
+// Consecutive failures which open the circuit
+#define REST_DELIVERY_CIRCUIT_THRESHOLD 5
+
+// Smaller bodies are sent uncompressed, gzip framing would outweigh the savings
+#define REST_DELIVERY_GZIP_MIN_LENGTH   256
+#define REST_DELIVERY_GZIP_LEVEL        6
+
+static metric_t metric_queue_depth = METRIC_GAUGE_INIT("callback.queue_depth");
+static metric_t metric_batches_queued = METRIC_COUNTER_INIT("callback.batches_queued");
+static metric_t metric_batches_delivered = METRIC_COUNTER_INIT("callback.batches_delivered");
+static metric_t metric_delivery_failures = METRIC_COUNTER_INIT("callback.delivery_failures");
+static metric_t metric_send_time_us = METRIC_COUNTER_INIT("callback.send_time_us_total");
+static metric_t metric_send_time_max_us = METRIC_GAUGE_INIT("callback.send_time_us_max");
+static metric_t metric_latency_us = METRIC_COUNTER_INIT("callback.delivery_latency_us_total");
+static metric_t metric_latency_max_us = METRIC_GAUGE_INIT("callback.delivery_latency_us_max");
+static metric_t metric_body_bytes = METRIC_COUNTER_INIT("callback.body_bytes");
+static metric_t metric_sent_bytes = METRIC_COUNTER_INIT("callback.sent_bytes");
+static metric_t metric_retries = METRIC_COUNTER_INIT("callback.retries");
+static metric_t metric_dead_lettered = METRIC_COUNTER_INIT("callback.dead_lettered");
+static metric_t metric_dead_letters_dropped = METRIC_COUNTER_INIT("callback.dead_letters_dropped");
+static metric_t metric_dead_letters = METRIC_GAUGE_INIT("callback.dead_letters");
+static metric_t metric_circuit_opened = METRIC_COUNTER_INIT("callback.circuit_opened");
+static metric_t metric_open_circuits = METRIC_GAUGE_INIT("callback.open_circuits");
+
+static void rest_delivery_batch_delete(rest_delivery_batch_t *batch)
+{
+    json_decref(batch->callback);
+    free(batch->data);
+    free(batch);
+}
+
+static uint8_t *rest_delivery_gzip(const uint8_t *data, size_t length, size_t *compressed_length)
+{
+    z_stream stream;
+    uint8_t *buffer;
+    uLong bound;
+
+    if (length > UINT_MAX)
+    {
+        return NULL;
+    }
+
+    memset(&stream, 0, sizeof(stream));
+    // Window bits over 15 select gzip instead of zlib framing
+    if (deflateInit2(&stream, REST_DELIVERY_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return NULL;
+    }
+
+    bound = deflateBound(&stream, length);
+    buffer = malloc(bound);
+    if (buffer != NULL)
+    {
+        stream.next_in = (Bytef *)data;
+        stream.avail_in = length;
+        stream.next_out = buffer;
+        stream.avail_out = bound;
+
+        if (deflate(&stream, Z_FINISH) == Z_STREAM_END)
+        {
+            *compressed_length = stream.total_out;
+        }
+        else
+        {
+            free(buffer);
+            buffer = NULL;
+        }
+    }
+
+    deflateEnd(&stream);
+
+    return buffer;
+}
+
+int rest_delivery_send_now(rest_delivery_t *delivery, const json_t *callback,
+                           const char *content_type, const uint8_t *data, size_t length,
+                           long *status)
+{
+    const char *url = json_string_value(json_object_get(callback, "url"));
+    const char *encoding = json_string_value(json_object_get(callback, "encoding"));
+    uint8_t *compressed = NULL;
+    size_t compressed_length;
+    int res;
+
+    log_message(LOG_LEVEL_INFO, "[CALLBACK] Sending to %s\n", url);
+
+    metrics_add(&metric_body_bytes, length);
+
+    // Receiver opted in to compressed bodies
+    if (encoding != NULL && length >= REST_DELIVERY_GZIP_MIN_LENGTH)
+    {
+        compressed = rest_delivery_gzip(data, length, &compressed_length);
+        if (compressed == NULL)
+        {
+            log_message(LOG_LEVEL_WARN, "[CALLBACK] Failed to compress batch, sending as is\n");
+        }
+    }
+
+    if (compressed != NULL)
+    {
+        metrics_add(&metric_sent_bytes, compressed_length);
+        res = rest_http_pool_put(delivery->pool, url, json_object_get(callback, "headers"),
+                                 content_type, encoding, compressed, compressed_length,
+                                 REST_DELIVERY_TIMEOUT, status);
+        free(compressed);
+    }
+    else
+    {
+        metrics_add(&metric_sent_bytes, length);
+        res = rest_http_pool_put(delivery->pool, url, json_object_get(callback, "headers"),
+                                 content_type, NULL, data, length, REST_DELIVERY_TIMEOUT,
+                                 status);
+    }
+
+    return res;
+}
+
+/*
+ * Exponential backoff with "equal jitter": half of the delay is fixed, the
+ * other half random, so that retries of several servers do not synchronize.
+ */
+static int64_t rest_delivery_backoff(int failures)
+{
+    int64_t delay = REST_DELIVERY_RETRY_PERIOD_MAX;
+    uint32_t random = 0;
+
+    if (failures <= REST_DELIVERY_RETRY_DOUBLINGS)
+    {
+        delay = REST_DELIVERY_RETRY_PERIOD << (failures - 1);
+        if (delay > REST_DELIVERY_RETRY_PERIOD_MAX)
+        {
+            delay = REST_DELIVERY_RETRY_PERIOD_MAX;
+        }
+    }
+
+    rest_random_fill(&random, sizeof(random));
+
+    return delay / 2 + (int64_t)(random % (uint32_t)(delay / 2 + 1));
+}
+
+static void rest_delivery_set_circuit(rest_delivery_t *delivery, rest_delivery_circuit_t circuit)
+{
+    if (circuit == REST_DELIVERY_CIRCUIT_OPEN && delivery->circuit != circuit)
+    {
+        log_message(LOG_LEVEL_WARN, "[CALLBACK] Circuit opened after %d failures\n",
+                    delivery->failures);
+        metrics_add(&metric_circuit_opened, 1);
+    }
+    else if (circuit == REST_DELIVERY_CIRCUIT_CLOSED && delivery->circuit != circuit)
+    {
+        log_message(LOG_LEVEL_INFO, "[CALLBACK] Circuit closed\n");
+    }
+
+    // Gauges are shared by all delivery instances, so they are adjusted, not set
+    if ((delivery->circuit == REST_DELIVERY_CIRCUIT_CLOSED)
+        != (circuit == REST_DELIVERY_CIRCUIT_CLOSED))
+    {
+        metrics_add(&metric_open_circuits, circuit == REST_DELIVERY_CIRCUIT_CLOSED ? -1 : 1);
+    }
+
+    delivery->circuit = circuit;
+}
+
+static rest_delivery_batch_t *rest_delivery_pop(rest_delivery_t *delivery)
+{
+    rest_delivery_batch_t *batch = delivery->head;
+
+    delivery->head = batch->next;
+    if (delivery->head == NULL)
+    {
+        delivery->tail = NULL;
+    }
+    delivery->length--;
+    batch->next = NULL;
+
+    metrics_add(&metric_queue_depth, -1);
+
+    return batch;
+}
+
+static void rest_delivery_bury(rest_delivery_t *delivery, rest_delivery_batch_t *batch)
+{
+    rest_delivery_batch_t *oldest;
+
+    if (delivery->dead_tail != NULL)
+    {
+        delivery->dead_tail->next = batch;
+    }
+    else
+    {
+        delivery->dead_head = batch;
+    }
+    delivery->dead_tail = batch;
+    delivery->dead_length++;
+    metrics_add(&metric_dead_lettered, 1);
+    metrics_add(&metric_dead_letters, 1);
+
+    while (delivery->dead_length > delivery->dead_limit)
+    {
+        oldest = delivery->dead_head;
+        delivery->dead_head = oldest->next;
+        if (delivery->dead_head == NULL)
+        {
+            delivery->dead_tail = NULL;
+        }
+        delivery->dead_length--;
+        rest_delivery_batch_delete(oldest);
+        metrics_add(&metric_dead_letters_dropped, 1);
+        metrics_add(&metric_dead_letters, -1);
+    }
+}
+
+/*
+ * Receiver which is unreachable, overloaded or timed out may accept the batch
+ * later, other statuses (e.g. 400 or 413) reject this batch for good.
+ */
+static bool rest_delivery_retryable(long status)
+{
+    return status == 0 || status >= 500 || status == 408 || status == 429;
+}
+
+/*
+ * Schedules the next attempt after a failed one, gives up on the batch after
+ * too many retries or if the receiver rejected it. Delivery mutex must be held.
+ */
+static void rest_delivery_failed(rest_delivery_t *delivery, rest_delivery_batch_t *batch,
+                                 int64_t now, long status)
+{
+    int64_t delay;
+
+    metrics_add(&metric_delivery_failures, 1);
+
+    batch->attempts++;
+    batch->failure_time = now;
+    delivery->failures++;
+
+    if (delivery->circuit == REST_DELIVERY_CIRCUIT_HALF_OPEN
+        || delivery->failures >= REST_DELIVERY_CIRCUIT_THRESHOLD)
+    {
+        rest_delivery_set_circuit(delivery, REST_DELIVERY_CIRCUIT_OPEN);
+    }
+
+    delay = rest_delivery_backoff(delivery->failures);
+    delivery->retry_time = now + delay;
+
+    if (!rest_delivery_retryable(status))
+    {
+        log_message(LOG_LEVEL_WARN, "[CALLBACK] Batch rejected with status %ld\n", status);
+    }
+
+    if (batch->attempts > delivery->max_retries || !rest_delivery_retryable(status))
+    {
+        log_message(LOG_LEVEL_WARN, "[CALLBACK] Giving up on batch after %d attempts\n",
+                    batch->attempts);
+
+        // Dead letters are replayed explicitly, journal must not hold them back
+        delivery->completed_seq = batch->seq;
+        if (delivery->ack != NULL)
+        {
+            delivery->ack(batch->seq, delivery->ack_context);
+        }
+
+        rest_delivery_bury(delivery, rest_delivery_pop(delivery));
+        return;
+    }
+
+    log_message(LOG_LEVEL_WARN, "[CALLBACK] Delivery failed, retrying in %" PRId64 " ms\n",
+                delay / 1000);
+    metrics_add(&metric_retries, 1);
+}
+
+static void *rest_delivery_thread(void *context)
+{
+    rest_delivery_t *delivery = (rest_delivery_t *)context;
+    rest_delivery_batch_t *batch;
+    struct timespec deadline;
+    int64_t send_start, now;
+    long status;
+    int res;
+
+    pthread_mutex_lock(&delivery->mutex);
+
+    while (delivery->running)
+    {
+        if (delivery->head == NULL)
+        {
+            pthread_cond_wait(&delivery->cond, &delivery->mutex);
+            continue;
+        }
+
+        // Backing off, or circuit is open
+        now = metrics_time_us();
+        if (now < delivery->retry_time)
+        {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += (delivery->retry_time - now) / 1000000;
+            deadline.tv_nsec += ((delivery->retry_time - now) % 1000000) * 1000;
+            if (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&delivery->cond, &delivery->mutex, &deadline);
+            continue;
+        }
+
+        // Cooldown expired, next request is a trial
+        if (delivery->circuit == REST_DELIVERY_CIRCUIT_OPEN)
+        {
+            rest_delivery_set_circuit(delivery, REST_DELIVERY_CIRCUIT_HALF_OPEN);
+        }
+
+        // Only this thread removes batches, so head stays valid while unlocked
+        batch = delivery->head;
+        pthread_mutex_unlock(&delivery->mutex);
+
+        send_start = metrics_time_us();
+        res = rest_delivery_send_now(delivery, batch->callback, batch->content_type,
+                                     batch->data, batch->length, &status);
+        now = metrics_time_us();
+
+        metrics_add(&metric_send_time_us, now - send_start);
+        metrics_max(&metric_send_time_max_us, now - send_start);
+
+        pthread_mutex_lock(&delivery->mutex);
+
+        if (res != 0)
+        {
+            rest_delivery_failed(delivery, batch, now, status);
+            continue;
+        }
+
+        delivery->failures = 0;
+        delivery->retry_time = 0;
+        rest_delivery_set_circuit(delivery, REST_DELIVERY_CIRCUIT_CLOSED);
+
+        rest_delivery_pop(delivery);
+
+        metrics_add(&metric_batches_delivered, 1);
+        metrics_add(&metric_latency_us, now - batch->enqueue_time);
+        metrics_max(&metric_latency_max_us, now - batch->enqueue_time);
+
+        delivery->completed_seq = batch->seq;
+        if (delivery->ack != NULL)
+        {
+            delivery->ack(batch->seq, delivery->ack_context);
+        }
+
+        rest_delivery_batch_delete(batch);
+    }
+
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return NULL;
+}
+
+rest_delivery_t *rest_delivery_new(void)
+{
+    rest_delivery_t *delivery;
+
+    delivery = malloc(sizeof(rest_delivery_t));
+    if (delivery == NULL)
+    {
+        return NULL;
+    }
+
+    memset(delivery, 0, sizeof(rest_delivery_t));
+
+    delivery->pool = rest_http_pool_new();
+    if (delivery->pool == NULL)
+    {
+        free(delivery);
+        return NULL;
+    }
+
+    pthread_mutex_init(&delivery->mutex, NULL);
+    pthread_cond_init(&delivery->cond, NULL);
+
+    metrics_register(&metric_queue_depth);
+    metrics_register(&metric_batches_queued);
+    metrics_register(&metric_batches_delivered);
+    metrics_register(&metric_delivery_failures);
+    metrics_register(&metric_send_time_us);
+    metrics_register(&metric_send_time_max_us);
+    metrics_register(&metric_latency_us);
+    metrics_register(&metric_latency_max_us);
+    metrics_register(&metric_body_bytes);
+    metrics_register(&metric_sent_bytes);
+    metrics_register(&metric_retries);
+    metrics_register(&metric_dead_lettered);
+    metrics_register(&metric_dead_letters_dropped);
+    metrics_register(&metric_dead_letters);
+    metrics_register(&metric_circuit_opened);
+    metrics_register(&metric_open_circuits);
+
+    delivery->max_retries = REST_DELIVERY_MAX_RETRIES;
+    delivery->dead_limit = REST_DELIVERY_DEAD_LETTER_LIMIT;
+    delivery->queue_limit = REST_DELIVERY_QUEUE_LIMIT;
+
+    return delivery;
+}
+
+void rest_delivery_delete(rest_delivery_t *delivery)
+{
+    rest_delivery_batch_t *batch;
+
+    rest_delivery_stop(delivery);
+
+    if (delivery->length > 0)
+    {
+        log_message(LOG_LEVEL_WARN, "[CALLBACK] Dropping %zu undelivered batches\n",
+                    delivery->length);
+    }
+
+    while (delivery->head != NULL)
+    {
+        batch = delivery->head;
+        delivery->head = batch->next;
+        rest_delivery_batch_delete(batch);
+    }
+    metrics_add(&metric_queue_depth, -(int64_t)delivery->length);
+    delivery->tail = NULL;
+    delivery->length = 0;
+
+    if (delivery->circuit != REST_DELIVERY_CIRCUIT_CLOSED)
+    {
+        metrics_add(&metric_open_circuits, -1);
+    }
+
+    rest_delivery_clear_dead_letters(delivery);
+
+    rest_http_pool_delete(delivery->pool);
+
+    pthread_cond_destroy(&delivery->cond);
+    pthread_mutex_destroy(&delivery->mutex);
+
+    free(delivery);
+}
+
+int rest_delivery_start(rest_delivery_t *delivery)
+{
+    pthread_mutex_lock(&delivery->mutex);
+    delivery->running = true;
+    pthread_mutex_unlock(&delivery->mutex);
+
+    if (pthread_create(&delivery->thread, NULL, rest_delivery_thread, delivery) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[CALLBACK] Failed to start delivery thread: %s\n",
+                    strerror(errno));
+        delivery->running = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+void rest_delivery_stop(rest_delivery_t *delivery)
+{
+    pthread_mutex_lock(&delivery->mutex);
+
+    if (!delivery->running)
+    {
+        pthread_mutex_unlock(&delivery->mutex);
+        return;
+    }
+
+    delivery->running = false;
+    pthread_cond_signal(&delivery->cond);
+
+    pthread_mutex_unlock(&delivery->mutex);
+
+    pthread_join(delivery->thread, NULL);
+}
+
+void rest_delivery_set_ack(rest_delivery_t *delivery, rest_delivery_ack_cb_t ack, void *context)
+{
+    pthread_mutex_lock(&delivery->mutex);
+    delivery->ack = ack;
+    delivery->ack_context = context;
+    pthread_mutex_unlock(&delivery->mutex);
+}
+
+int rest_delivery_set_pool_limits(rest_delivery_t *delivery, size_t size, int idle_timeout)
+{
+    return rest_http_pool_set_limits(delivery->pool, size, idle_timeout);
+}
+
+int rest_delivery_enqueue(rest_delivery_t *delivery, json_t *callback,
+                          const char *content_type, uint8_t *data, size_t length, uint64_t seq)
+{
+    rest_delivery_batch_t *batch;
+
+    batch = malloc(sizeof(rest_delivery_batch_t));
+    if (batch == NULL)
+    {
+        free(data);
+        return -1;
+    }
+
+    batch->next = NULL;
+    batch->callback = json_incref(callback);
+    batch->content_type = content_type;
+    batch->data = data;
+    batch->length = length;
+    batch->seq = seq;
+    batch->enqueue_time = metrics_time_us();
+    batch->attempts = 0;
+    batch->failure_time = 0;
+
+    pthread_mutex_lock(&delivery->mutex);
+
+    if (delivery->tail != NULL)
+    {
+        delivery->tail->next = batch;
+    }
+    else
+    {
+        delivery->head = batch;
+    }
+    delivery->tail = batch;
+    delivery->length++;
+
+    metrics_add(&metric_queue_depth, 1);
+    metrics_add(&metric_batches_queued, 1);
+
+    pthread_cond_signal(&delivery->cond);
+
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return 0;
+}
+
+bool rest_delivery_pending(rest_delivery_t *delivery, uint64_t *completed_seq)
+{
+    bool pending;
+
+    pthread_mutex_lock(&delivery->mutex);
+    pending = delivery->head != NULL;
+    *completed_seq = delivery->completed_seq;
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return pending;
+}
+
+void rest_delivery_set_retry_limits(rest_delivery_t *delivery, int max_retries,
+                                    size_t dead_limit)
+{
+    pthread_mutex_lock(&delivery->mutex);
+    delivery->max_retries = max_retries;
+    delivery->dead_limit = dead_limit;
+    pthread_mutex_unlock(&delivery->mutex);
+}
+
+void rest_delivery_set_queue_limit(rest_delivery_t *delivery, size_t queue_limit)
+{
+    pthread_mutex_lock(&delivery->mutex);
+    delivery->queue_limit = queue_limit;
+    pthread_mutex_unlock(&delivery->mutex);
+}
+
+bool rest_delivery_busy(rest_delivery_t *delivery)
+{
+    bool busy;
+
+    // While the circuit is not closed, a single queued batch serves as the trial request
+    pthread_mutex_lock(&delivery->mutex);
+    busy = delivery->length >= delivery->queue_limit
+           || (delivery->circuit != REST_DELIVERY_CIRCUIT_CLOSED && delivery->length > 0);
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return busy;
+}
+
+json_t *rest_delivery_dead_letters_json(rest_delivery_t *delivery)
+{
+    rest_delivery_batch_t *batch;
+    json_t *jdead, *jletter;
+    int64_t now, wall;
+
+    jdead = json_array();
+    if (jdead == NULL)
+    {
+        return NULL;
+    }
+
+    // Failure times are monotonic, convert them to wall clock seconds
+    now = metrics_time_us();
+    wall = (int64_t)time(NULL);
+
+    pthread_mutex_lock(&delivery->mutex);
+
+    for (batch = delivery->dead_head; batch != NULL; batch = batch->next)
+    {
+        jletter = json_pack("{s:I, s:O, s:i, s:I, s:I}",
+                            "seq", (json_int_t)batch->seq,
+                            "url", json_object_get(batch->callback, "url"),
+                            "attempts", batch->attempts,
+                            "failed", (json_int_t)(wall - (now - batch->failure_time) / 1000000),
+                            "size", (json_int_t)batch->length);
+        if (jletter == NULL || json_array_append_new(jdead, jletter) != 0)
+        {
+            pthread_mutex_unlock(&delivery->mutex);
+            json_decref(jdead);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return jdead;
+}
+
+size_t rest_delivery_replay_dead_letters(rest_delivery_t *delivery)
+{
+    rest_delivery_batch_t *batch;
+    size_t count;
+
+    pthread_mutex_lock(&delivery->mutex);
+
+    count = delivery->dead_length;
+    if (count == 0)
+    {
+        pthread_mutex_unlock(&delivery->mutex);
+        return 0;
+    }
+
+    for (batch = delivery->dead_head; batch != NULL; batch = batch->next)
+    {
+        batch->attempts = 0;
+    }
+
+    if (delivery->tail != NULL)
+    {
+        delivery->tail->next = delivery->dead_head;
+    }
+    else
+    {
+        delivery->head = delivery->dead_head;
+    }
+    delivery->tail = delivery->dead_tail;
+    delivery->length += count;
+
+    delivery->dead_head = NULL;
+    delivery->dead_tail = NULL;
+    delivery->dead_length = 0;
+
+    // Operator asked for it, do not wait for the backoff to expire
+    delivery->retry_time = 0;
+
+    metrics_add(&metric_queue_depth, (int64_t)count);
+    metrics_add(&metric_dead_letters, -(int64_t)count);
+
+    pthread_cond_signal(&delivery->cond);
+
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return count;
+}
+
+size_t rest_delivery_clear_dead_letters(rest_delivery_t *delivery)
+{
+    rest_delivery_batch_t *batch;
+    size_t count;
+
+    pthread_mutex_lock(&delivery->mutex);
+
+    count = delivery->dead_length;
+    while (delivery->dead_head != NULL)
+    {
+        batch = delivery->dead_head;
+        delivery->dead_head = batch->next;
+        rest_delivery_batch_delete(batch);
+    }
+    delivery->dead_tail = NULL;
+    delivery->dead_length = 0;
+
+    metrics_add(&metric_dead_letters, -(int64_t)count);
+
+    pthread_mutex_unlock(&delivery->mutex);
+
+    return count;
+}
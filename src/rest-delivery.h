@@ -0,0 +1,250 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_DELIVERY_H
+#define REST_DELIVERY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <jansson.h>
+
+#include "rest-http-pool.h"
+
+#define REST_DELIVERY_MAX_RETRIES       5
+#define REST_DELIVERY_DEAD_LETTER_LIMIT 1000
+#define REST_DELIVERY_QUEUE_LIMIT       100
+
+typedef struct rest_delivery_batch_t
+{
+    struct rest_delivery_batch_t *next;
+    json_t *callback;
+    const char *content_type;
+    uint8_t *data;
+    size_t length;
+    uint64_t seq;
+    int64_t enqueue_time;
+    int attempts;
+    int64_t failure_time;
+} rest_delivery_batch_t;
+
+/*
+ * Circuit breaker of the callback target. It opens after consecutive
+ * failures, then no requests are sent until the cooldown expires and a
+ * single trial request (half-open) decides whether it closes again.
+ */
+typedef enum
+{
+    REST_DELIVERY_CIRCUIT_CLOSED,
+    REST_DELIVERY_CIRCUIT_HALF_OPEN,
+    REST_DELIVERY_CIRCUIT_OPEN,
+} rest_delivery_circuit_t;
+
+/**
+ * Callback, which is called from the delivery thread once a batch is
+ * delivered.
+ *
+ * @param[in]  seq      Sequence number of the last notification in the batch
+ * @param[in]  context  Acknowledgement context
+ */
+typedef void (*rest_delivery_ack_cb_t)(uint64_t seq, void *context);
+
+typedef struct
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+    rest_delivery_batch_t *head;
+    rest_delivery_batch_t *tail;
+    size_t length;
+    size_t queue_limit;
+    rest_delivery_batch_t *dead_head;
+    rest_delivery_batch_t *dead_tail;
+    size_t dead_length;
+    size_t dead_limit;
+    int max_retries;
+    int failures;
+    int64_t retry_time;
+    rest_delivery_circuit_t circuit;
+    rest_delivery_ack_cb_t ack;
+    void *ack_context;
+    uint64_t completed_seq;
+    rest_http_pool_t *pool;
+} rest_delivery_t;
+
+/**
+ * Creates callback delivery queue. The delivery thread is not started.
+ *
+ * @return Pointer to a new delivery instance or NULL on error
+ */
+rest_delivery_t *rest_delivery_new(void);
+
+/**
+ * Stops the delivery thread (if running), drops undelivered batches and
+ * releases delivery resources.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ */
+void rest_delivery_delete(rest_delivery_t *delivery);
+
+/**
+ * Starts the delivery thread, which sends queued batches to their callbacks.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_delivery_start(rest_delivery_t *delivery);
+
+/**
+ * Stops the delivery thread and waits for it to exit. Batch which is being
+ * sent at the moment is allowed to finish.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ */
+void rest_delivery_stop(rest_delivery_t *delivery);
+
+/**
+ * Sets callback, which acknowledges delivered batches.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ * @param[in]  ack       Acknowledgement callback or NULL
+ * @param[in]  context   Acknowledgement context
+ */
+void rest_delivery_set_ack(rest_delivery_t *delivery, rest_delivery_ack_cb_t ack, void *context);
+
+/**
+ * Checks whether there are queued batches. Notifications after the last
+ * completed (delivered or dead-lettered) batch may still be in the queue, so
+ * other consumers must not acknowledge them.
+ *
+ * @param[in]  delivery       Pointer to the delivery instance
+ * @param[out] completed_seq  Sequence number of the last completed batch
+ *
+ * @return true if there are queued batches
+ */
+bool rest_delivery_pending(rest_delivery_t *delivery, uint64_t *completed_seq);
+
+/**
+ * Sets retry limits. A batch which fails more than max_retries times is moved
+ * to the dead-letter store, which keeps up to dead_limit newest batches.
+ *
+ * @param[in]  delivery     Pointer to the delivery instance
+ * @param[in]  max_retries  Number of retries of a failed batch
+ * @param[in]  dead_limit   Number of batches kept in the dead-letter store
+ */
+void rest_delivery_set_retry_limits(rest_delivery_t *delivery, int max_retries,
+                                    size_t dead_limit);
+
+/**
+ * Sets number of queued batches, after which the delivery reports itself as
+ * busy. The limit is not enforced by the queue, producers are expected to
+ * check rest_delivery_busy() and hold their notifications back.
+ *
+ * @param[in]  delivery     Pointer to the delivery instance
+ * @param[in]  queue_limit  Number of queued batches
+ */
+void rest_delivery_set_queue_limit(rest_delivery_t *delivery, size_t queue_limit);
+
+/**
+ * Checks whether new batches should be held back, because the queue is full
+ * or the circuit breaker is not closed (the receiver is failing) and there
+ * is already a batch to try with.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ *
+ * @return true if no batches should be queued now
+ */
+bool rest_delivery_busy(rest_delivery_t *delivery);
+
+/**
+ * Lists batches in the dead-letter store.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ *
+ * @return JSON array of dead letters ("seq", "url", "attempts", "failed", "size")
+ */
+json_t *rest_delivery_dead_letters_json(rest_delivery_t *delivery);
+
+/**
+ * Moves all dead letters back to the delivery queue, to be sent to the
+ * callbacks they were created for.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ *
+ * @return Number of replayed batches
+ */
+size_t rest_delivery_replay_dead_letters(rest_delivery_t *delivery);
+
+/**
+ * Discards all dead letters.
+ *
+ * @param[in]  delivery  Pointer to the delivery instance
+ *
+ * @return Number of discarded batches
+ */
+size_t rest_delivery_clear_dead_letters(rest_delivery_t *delivery);
+
+/**
+ * Sets limits of the pool of keep-alive connections to callback receivers.
+ *
+ * @param[in]  delivery      Pointer to the delivery instance
+ * @param[in]  size          Number of idle connections kept open
+ * @param[in]  idle_timeout  Seconds after which an idle connection is closed
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_delivery_set_pool_limits(rest_delivery_t *delivery, size_t size, int idle_timeout);
+
+/**
+ * Sends a batch to the callback immediately, bypassing the queue. Used to
+ * probe whether the callback is reachable.
+ *
+ * @param[in]  delivery      Pointer to the delivery instance
+ * @param[in]  callback      Callback object ("url" and "headers")
+ * @param[in]  content_type  Content type of the body
+ * @param[in]  data          Batch body
+ * @param[in]  length        Length of the body
+ * @param[out] status        HTTP status of the response, 0 if the receiver is unreachable
+ *
+ * @return 0 if the receiver accepted the batch, -1 on error
+ */
+int rest_delivery_send_now(rest_delivery_t *delivery, const json_t *callback,
+                           const char *content_type, const uint8_t *data, size_t length,
+                           long *status);
+
+/**
+ * Queues serialized notification batch for delivery. Never blocks on the
+ * network.
+ *
+ * @param[in]  delivery      Pointer to the delivery instance
+ * @param[in]  callback      Callback object ("url" and "headers"), reference is taken
+ * @param[in]  content_type  Content type of the body (static string)
+ * @param[in]  data          Batch body allocated with malloc(), ownership is transferred
+ * @param[in]  length        Length of the body
+ * @param[in]  seq           Sequence number of the last notification in the batch
+ *
+ * @return 0 on success, -1 on error (data is released)
+ */
+int rest_delivery_enqueue(rest_delivery_t *delivery, json_t *callback,
+                          const char *content_type, uint8_t *data, size_t length, uint64_t seq);
+
+#endif // REST_DELIVERY_H
@@ -21,29 +21,52 @@
 
 #include <string.h>
 
+#include "logging.h"
 
-static json_t *endpoint_to_json(lwm2m_client_t *client)
-{
-    bool queue;
 
-    switch (client->binding)
+static bool endpoint_queue_mode(const client_record_t *record)
+{
+    switch (record->binding)
     {
     case BINDING_UQ:
     case BINDING_SQ:
     case BINDING_UQS:
-        queue = true;
-        break;
+        return true;
     default:
-        queue = false;
-        break;
+        return false;
+    }
+}
+
+static void endpoint_to_cbor(rest_cbor_t *cbor, const client_record_t *record)
+{
+    rest_cbor_map(cbor, record->type != NULL ? 4 : 3);
+
+    rest_cbor_text(cbor, "name");
+    rest_cbor_text(cbor, record->name);
+
+    if (record->type != NULL)
+    {
+        rest_cbor_text(cbor, "type");
+        rest_cbor_text(cbor, record->type);
     }
 
+    rest_cbor_text(cbor, "status");
+    rest_cbor_text(cbor, "ACTIVE");
+
+    rest_cbor_text(cbor, "q");
+    rest_cbor_bool(cbor, endpoint_queue_mode(record));
+}
+
+static json_t *endpoint_to_json(const client_record_t *record)
+{
+    bool queue = endpoint_queue_mode(record);
+
     json_t *jclient = json_object();
-    json_object_set_new(jclient, "name", json_string(client->name));
+    json_object_set_new(jclient, "name", json_string(record->name));
 
-    if (client->type != NULL)
+    if (record->type != NULL)
     {
-        json_object_set_new(jclient, "type", json_string(client->type));
+        json_object_set_new(jclient, "type", json_string(record->type));
     }
 
     json_object_set_new(jclient, "status", json_string("ACTIVE"));
@@ -53,102 +76,163 @@ static json_t *endpoint_to_json(lwm2m_client_t *client)
     return jclient;
 }
 
-static json_t *endpoint_resources_to_json(lwm2m_client_t *client)
+static json_t *endpoint_resources_to_json(const client_record_t *record)
 {
-    lwm2m_client_object_t *obj;
-    lwm2m_list_t *ins;
+    const client_record_uri_t *uri;
     char buf[20]; // 13 bytes should be enough (i.e. max string "/65535/65535\0")
+    size_t i;
 
     json_t *jobjects = json_array();
-    for (obj = client->objectList; obj != NULL; obj = obj->next)
+    for (i = 0; i < record->uri_count; i++)
     {
-        if (obj->instanceList == NULL)
+        uri = &record->uris[i];
+        if (uri->has_instance)
         {
-            snprintf(buf, sizeof(buf), "/%d", obj->id);
-            json_t *jobject = json_object();
-            json_object_set_new(jobject, "uri", json_string(buf));
-            json_array_append_new(jobjects, jobject);
+            snprintf(buf, sizeof(buf), "/%d/%d", uri->object_id, uri->instance_id);
         }
         else
         {
-            for (ins = obj->instanceList; ins != NULL; ins = ins->next)
-            {
-                snprintf(buf, sizeof(buf), "/%d/%d", obj->id, ins->id);
-                json_t *jobject = json_object();
-                json_object_set_new(jobject, "uri", json_string(buf));
-                json_array_append_new(jobjects, jobject);
-            }
+            snprintf(buf, sizeof(buf), "/%d", uri->object_id);
         }
+
+        json_t *jobject = json_object();
+        json_object_set_new(jobject, "uri", json_string(buf));
+        json_array_append_new(jobjects, jobject);
     }
 
     return jobjects;
 }
 
-lwm2m_client_t *rest_endpoints_find_client(lwm2m_client_t *list, const char *name)
+lwm2m_client_t *rest_endpoints_find_client(rest_shard_t *shard, const char *name)
 {
-    lwm2m_client_t *client;
+    return client_registry_find_name(&shard->clients, name);
+}
+
+rest_shard_t *rest_endpoints_find_shard(rest_context_t *rest, const char *name)
+{
+    rest_shard_t *shard;
 
     if (name == NULL)
     {
         return NULL;
     }
 
-    for (client = list; client != NULL; client = client->next)
+    // Looked up on every request, so readers only exclude (de)registrations
+    pthread_rwlock_rdlock(&rest->endpointShardsLock);
+    shard = rest_hash_get(rest->endpointShards, name, strlen(name));
+    pthread_rwlock_unlock(&rest->endpointShardsLock);
+
+    return shard;
+}
+
+void rest_endpoints_set_shard(rest_context_t *rest, const char *name, rest_shard_t *shard)
+{
+    pthread_rwlock_wrlock(&rest->endpointShardsLock);
+
+    if (rest_hash_put(rest->endpointShards, name, strlen(name), shard) != 0)
     {
-        if (strcmp(client->name, name) == 0)
-        {
-            return client;
-        }
+        log_message(LOG_LEVEL_ERROR, "[ENDPOINTS] Failed to route endpoint \"%s\"\n", name);
     }
 
-    return NULL;
+    pthread_rwlock_unlock(&rest->endpointShardsLock);
+}
+
+void rest_endpoints_unset_shard(rest_context_t *rest, const char *name, rest_shard_t *shard)
+{
+    pthread_rwlock_wrlock(&rest->endpointShardsLock);
+
+    // Endpoint may have already re-registered through another shard
+    if (rest_hash_get(rest->endpointShards, name, strlen(name)) == shard)
+    {
+        rest_hash_remove(rest->endpointShards, name, strlen(name));
+    }
+
+    pthread_rwlock_unlock(&rest->endpointShardsLock);
 }
 
 int rest_endpoints_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
 {
     rest_context_t *rest = (rest_context_t *)context;
-    lwm2m_client_t *client;
+    client_snapshot_t *snapshot;
+    rest_cbor_t cbor;
+    size_t i, j;
+
+    if (rest_accepts_cbor(req))
+    {
+        // Written straight from the snapshots, total count is not known upfront
+        rest_cbor_init(&cbor);
+        rest_cbor_array_start(&cbor);
+        for (i = 0; i < rest->shardCount; i++)
+        {
+            snapshot = client_publisher_acquire(&rest->shards[i].publisher);
+            for (j = 0; j < snapshot->count; j++)
+            {
+                endpoint_to_cbor(&cbor, snapshot->records[j]);
+            }
+            client_snapshot_release(snapshot);
+        }
+        rest_cbor_break(&cbor);
 
-    rest_lock(rest);
+        rest_set_cbor_response(resp, 200, &cbor);
+        rest_cbor_cleanup(&cbor);
 
+        return U_CALLBACK_COMPLETE;
+    }
+
+    // Served from published snapshots, CoAP processing is never blocked
     json_t *jclients = json_array();
-    for (client = rest->lwm2m->clientList; client != NULL; client = client->next)
+    for (i = 0; i < rest->shardCount; i++)
     {
-        json_array_append_new(jclients, endpoint_to_json(client));
+        snapshot = client_publisher_acquire(&rest->shards[i].publisher);
+        for (j = 0; j < snapshot->count; j++)
+        {
+            json_array_append_new(jclients, endpoint_to_json(snapshot->records[j]));
+        }
+        client_snapshot_release(snapshot);
     }
 
     ulfius_set_json_body_response(resp, 200, jclients);
     json_decref(jclients);
 
-    rest_unlock(rest);
-
     return U_CALLBACK_COMPLETE;
 }
 
 int rest_endpoints_name_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
 {
     rest_context_t *rest = (rest_context_t *)context;
+    rest_shard_t *shard;
     lwm2m_client_t *client;
+    client_record_t *record = NULL;
     const char *name = u_map_get(req->map_url, "name");
     json_t *jclient;
 
-    rest_lock(rest);
-
-    client = rest_endpoints_find_client(rest->lwm2m->clientList, name);
-
-    if (client == NULL)
+    shard = rest_endpoints_find_shard(rest, name);
+    if (shard == NULL)
     {
         ulfius_set_empty_body_response(resp, 404);
+        return U_CALLBACK_COMPLETE;
     }
-    else
+
+    // Only record lookup is done under the shard lock, serialization is not
+    rest_shard_lock(shard);
+    client = rest_endpoints_find_client(shard, name);
+    if (client != NULL)
     {
-        jclient = endpoint_resources_to_json(client);
-        ulfius_set_json_body_response(resp, 200, jclient);
-        json_decref(jclient);
+        record = client_publisher_get_record(&shard->publisher, client->internalID);
     }
+    rest_shard_unlock(shard);
 
-    rest_unlock(rest);
+    if (record == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 404);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    jclient = endpoint_resources_to_json(record);
+    rest_set_body_response(req, resp, 200, jclient);
+    json_decref(jclient);
+
+    client_record_release(record);
 
     return U_CALLBACK_COMPLETE;
 }
-
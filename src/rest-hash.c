@@ -0,0 +1,224 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rest-hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REST_HASH_INITIAL_BUCKETS 64
+
+
+uint32_t rest_hash_bytes(const void *key, size_t key_length)
+{
+    const uint8_t *bytes = key;
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < key_length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static rest_hash_entry_t **rest_hash_find(const rest_hash_t *hash, uint32_t key_hash,
+                                          const void *key, size_t key_length)
+{
+    rest_hash_entry_t **link;
+
+    link = &hash->buckets[key_hash & (hash->bucket_count - 1)];
+    for (; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->hash == key_hash
+            && (*link)->key_length == key_length
+            && memcmp((*link)->key, key, key_length) == 0)
+        {
+            break;
+        }
+    }
+
+    return link;
+}
+
+static void rest_hash_grow(rest_hash_t *hash)
+{
+    rest_hash_entry_t **buckets;
+    rest_hash_entry_t *entry, *next;
+    size_t bucket_count = hash->bucket_count * 2;
+    size_t i, index;
+
+    buckets = calloc(bucket_count, sizeof(rest_hash_entry_t *));
+    if (buckets == NULL)
+    {
+        // Table keeps working, only with longer chains
+        return;
+    }
+
+    for (i = 0; i < hash->bucket_count; i++)
+    {
+        for (entry = hash->buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            index = entry->hash & (bucket_count - 1);
+            entry->next = buckets[index];
+            buckets[index] = entry;
+        }
+    }
+
+    free(hash->buckets);
+    hash->buckets = buckets;
+    hash->bucket_count = bucket_count;
+}
+
+rest_hash_t *rest_hash_new(void)
+{
+    rest_hash_t *hash = malloc(sizeof(rest_hash_t));
+
+    if (hash == NULL)
+    {
+        return NULL;
+    }
+
+    memset(hash, 0, sizeof(rest_hash_t));
+
+    hash->bucket_count = REST_HASH_INITIAL_BUCKETS;
+    hash->buckets = calloc(hash->bucket_count, sizeof(rest_hash_entry_t *));
+    if (hash->buckets == NULL)
+    {
+        free(hash);
+        return NULL;
+    }
+
+    return hash;
+}
+
+void rest_hash_delete(rest_hash_t *hash)
+{
+    rest_hash_entry_t *entry, *next;
+    size_t i;
+
+    for (i = 0; i < hash->bucket_count; i++)
+    {
+        for (entry = hash->buckets[i]; entry != NULL; entry = next)
+        {
+            next = entry->next;
+            free(entry);
+        }
+    }
+
+    free(hash->buckets);
+    free(hash);
+}
+
+int rest_hash_put(rest_hash_t *hash, const void *key, size_t key_length, void *data)
+{
+    uint32_t key_hash = rest_hash_bytes(key, key_length);
+    rest_hash_entry_t **link;
+    rest_hash_entry_t *entry;
+
+    link = rest_hash_find(hash, key_hash, key, key_length);
+    if (*link != NULL)
+    {
+        (*link)->data = data;
+        return 0;
+    }
+
+    // Key is stored right after the entry to save an allocation
+    entry = malloc(sizeof(rest_hash_entry_t) + key_length);
+    if (entry == NULL)
+    {
+        return -1;
+    }
+
+    entry->next = NULL;
+    entry->hash = key_hash;
+    entry->key_length = key_length;
+    entry->key = entry + 1;
+    entry->data = data;
+    memcpy(entry->key, key, key_length);
+
+    *link = entry;
+    hash->count++;
+
+    if (hash->count > hash->bucket_count)
+    {
+        rest_hash_grow(hash);
+    }
+
+    return 0;
+}
+
+void *rest_hash_get(const rest_hash_t *hash, const void *key, size_t key_length)
+{
+    rest_hash_entry_t **link;
+
+    link = rest_hash_find(hash, rest_hash_bytes(key, key_length), key, key_length);
+
+    return (*link != NULL) ? (*link)->data : NULL;
+}
+
+void *rest_hash_remove(rest_hash_t *hash, const void *key, size_t key_length)
+{
+    rest_hash_entry_t **link;
+    rest_hash_entry_t *entry;
+    void *data;
+
+    link = rest_hash_find(hash, rest_hash_bytes(key, key_length), key, key_length);
+    if (*link == NULL)
+    {
+        return NULL;
+    }
+
+    entry = *link;
+    *link = entry->next;
+    hash->count--;
+
+    data = entry->data;
+    free(entry);
+
+    return data;
+}
+
+rest_hash_entry_t *rest_hash_next(const rest_hash_t *hash, const rest_hash_entry_t *entry)
+{
+    size_t i = 0;
+
+    if (entry != NULL)
+    {
+        if (entry->next != NULL)
+        {
+            return entry->next;
+        }
+
+        i = (entry->hash & (hash->bucket_count - 1)) + 1;
+    }
+
+    for (; i < hash->bucket_count; i++)
+    {
+        if (hash->buckets[i] != NULL)
+        {
+            return hash->buckets[i];
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,113 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_HASH_H
+#define REST_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct rest_hash_entry_t
+{
+    struct rest_hash_entry_t *next;
+    uint32_t hash;
+    size_t key_length;
+    void *key;
+    void *data;
+} rest_hash_entry_t;
+
+typedef struct
+{
+    rest_hash_entry_t **buckets;
+    size_t bucket_count;
+    size_t count;
+} rest_hash_t;
+
+/**
+ * Computes 32-bit FNV-1a hash of the given bytes.
+ *
+ * @param[in]  key         Pointer to the key
+ * @param[in]  key_length  Length of the key in bytes
+ *
+ * @return Hash value
+ */
+uint32_t rest_hash_bytes(const void *key, size_t key_length);
+
+/**
+ * This function creates new hash table. Keys are arbitrary byte strings,
+ * which are copied into the table. The table is not thread-safe.
+ *
+ * @return Pointer to a new hash table instance or NULL on error
+ */
+rest_hash_t *rest_hash_new(void);
+
+/**
+ * This function deletes hash table. Stored data is not released.
+ *
+ * @param[in]  hash  Pointer to the hash table which will be deleted
+ */
+void rest_hash_delete(rest_hash_t *hash);
+
+/**
+ * Stores data under the key, replacing previously stored data.
+ *
+ * @param[in]  hash        Pointer to the hash table
+ * @param[in]  key         Pointer to the key
+ * @param[in]  key_length  Length of the key in bytes
+ * @param[in]  data        Data entry to be stored
+ *
+ * @return 0 on success, -1 on allocation error
+ */
+int rest_hash_put(rest_hash_t *hash, const void *key, size_t key_length, void *data);
+
+/**
+ * Finds data stored under the key.
+ *
+ * @param[in]  hash        Pointer to the hash table
+ * @param[in]  key         Pointer to the key
+ * @param[in]  key_length  Length of the key in bytes
+ *
+ * @return Stored data or NULL if key is not present
+ */
+void *rest_hash_get(const rest_hash_t *hash, const void *key, size_t key_length);
+
+/**
+ * Removes the key from the table.
+ *
+ * @param[in]  hash        Pointer to the hash table
+ * @param[in]  key         Pointer to the key
+ * @param[in]  key_length  Length of the key in bytes
+ *
+ * @return Data which was stored under the key or NULL if key is not present
+ */
+void *rest_hash_remove(rest_hash_t *hash, const void *key, size_t key_length);
+
+/**
+ * Iterates over table entries. Table must not be modified while iterating,
+ * except for removal of the current entry once its successor is obtained.
+ *
+ * @param[in]  hash   Pointer to the hash table
+ * @param[in]  entry  Previous entry or NULL to get the first one
+ *
+ * @return Next entry or NULL if there are no more entries
+ */
+rest_hash_entry_t *rest_hash_next(const rest_hash_t *hash, const rest_hash_entry_t *entry);
+
+#endif // REST_HASH_H
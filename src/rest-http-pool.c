@@ -0,0 +1,418 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE // asprintf()
+
+#define LOG_MODULE LOG_MODULE_CALLBACK
+
+#include "rest-http-pool.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "logging.h"
+#include "metrics.h"
+
+static metric_t metric_connections_opened = METRIC_COUNTER_INIT("callback.connections_opened");
+static metric_t metric_connections_reused = METRIC_COUNTER_INIT("callback.connections_reused");
+static metric_t metric_connect_time_us = METRIC_COUNTER_INIT("callback.connect_time_us_total");
+static metric_t metric_idle_connections = METRIC_GAUGE_INIT("callback.idle_connections");
+
+static void rest_http_share_lock(CURL *curl, curl_lock_data data, curl_lock_access access,
+                                 void *context)
+{
+    rest_http_pool_t *pool = (rest_http_pool_t *)context;
+
+    pthread_mutex_lock(&pool->share_mutex[data]);
+}
+
+static void rest_http_share_unlock(CURL *curl, curl_lock_data data, void *context)
+{
+    rest_http_pool_t *pool = (rest_http_pool_t *)context;
+
+    pthread_mutex_unlock(&pool->share_mutex[data]);
+}
+
+static size_t rest_http_discard_cb(char *data, size_t size, size_t count, void *context)
+{
+    return size * count;
+}
+
+/*
+ * Origin is the part of the URL up to the path, connections are reusable
+ * only for requests to the same origin.
+ */
+static char *rest_http_origin(const char *url)
+{
+    const char *host = strstr(url, "://");
+    size_t length;
+
+    host = host != NULL ? host + 3 : url;
+    length = host - url + strcspn(host, "/?#");
+
+    return strndup(url, length);
+}
+
+/*
+ * Idle connection gauge is shared by all pools, every pool adds the change
+ * of its own count since the last report.
+ */
+static void rest_http_pool_report(rest_http_pool_t *pool)
+{
+    metrics_add(&metric_idle_connections,
+                (int64_t)pool->idle_count - (int64_t)pool->reported_count);
+    pool->reported_count = pool->idle_count;
+}
+
+static void rest_http_connection_delete(rest_http_connection_t *connection)
+{
+    curl_easy_cleanup(connection->curl);
+    free(connection->origin);
+    free(connection);
+}
+
+static rest_http_connection_t *rest_http_connection_new(char *origin)
+{
+    rest_http_connection_t *connection;
+
+    connection = malloc(sizeof(rest_http_connection_t));
+    if (connection == NULL)
+    {
+        free(origin);
+        return NULL;
+    }
+
+    connection->curl = curl_easy_init();
+    if (connection->curl == NULL)
+    {
+        free(origin);
+        free(connection);
+        return NULL;
+    }
+    connection->origin = origin;
+    connection->last_used = 0;
+
+    return connection;
+}
+
+/*
+ * Closes idle connections over the idle timeout and, if room for another
+ * one is needed, the least recently used one. Pool mutex must be held.
+ */
+static void rest_http_pool_expire(rest_http_pool_t *pool, int64_t now, size_t room)
+{
+    size_t i = 0;
+
+    while (i < pool->idle_count)
+    {
+        if (now - pool->idle[i]->last_used < (int64_t)pool->idle_timeout * 1000000)
+        {
+            i++;
+            continue;
+        }
+
+        rest_http_connection_delete(pool->idle[i]);
+        pool->idle[i] = pool->idle[--pool->idle_count];
+    }
+
+    // Idle connections are appended on release, so the oldest ones are in front
+    while (pool->idle_count > 0 && pool->idle_count + room > pool->size)
+    {
+        rest_http_connection_delete(pool->idle[0]);
+        memmove(&pool->idle[0], &pool->idle[1],
+                (pool->idle_count - 1) * sizeof(rest_http_connection_t *));
+        pool->idle_count--;
+    }
+
+    rest_http_pool_report(pool);
+}
+
+static rest_http_connection_t *rest_http_pool_acquire(rest_http_pool_t *pool, const char *url)
+{
+    rest_http_connection_t *connection = NULL;
+    char *origin;
+    size_t i;
+
+    origin = rest_http_origin(url);
+    if (origin == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    rest_http_pool_expire(pool, metrics_time_us(), 0);
+
+    // Most recently used connection is the most likely to be still alive
+    for (i = pool->idle_count; i > 0; i--)
+    {
+        if (strcasecmp(pool->idle[i - 1]->origin, origin) == 0)
+        {
+            connection = pool->idle[i - 1];
+            memmove(&pool->idle[i - 1], &pool->idle[i],
+                    (pool->idle_count - i) * sizeof(rest_http_connection_t *));
+            pool->idle_count--;
+            break;
+        }
+    }
+    rest_http_pool_report(pool);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (connection != NULL)
+    {
+        free(origin);
+        // Options are reset, but open connection and session caches are kept
+        curl_easy_reset(connection->curl);
+        return connection;
+    }
+
+    return rest_http_connection_new(origin);
+}
+
+static void rest_http_pool_release(rest_http_pool_t *pool, rest_http_connection_t *connection,
+                                   bool reusable)
+{
+    pthread_mutex_lock(&pool->mutex);
+
+    connection->last_used = metrics_time_us();
+    rest_http_pool_expire(pool, connection->last_used, 1);
+
+    if (reusable && pool->idle_count < pool->size)
+    {
+        pool->idle[pool->idle_count++] = connection;
+        connection = NULL;
+    }
+    rest_http_pool_report(pool);
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (connection != NULL)
+    {
+        rest_http_connection_delete(connection);
+    }
+}
+
+rest_http_pool_t *rest_http_pool_new(void)
+{
+    rest_http_pool_t *pool;
+    int i;
+
+    pool = malloc(sizeof(rest_http_pool_t));
+    if (pool == NULL)
+    {
+        return NULL;
+    }
+    memset(pool, 0, sizeof(rest_http_pool_t));
+
+    pool->idle = malloc(REST_HTTP_POOL_SIZE * sizeof(rest_http_connection_t *));
+    pool->share = curl_share_init();
+    if (pool->idle == NULL || pool->share == NULL)
+    {
+        curl_share_cleanup(pool->share);
+        free(pool->idle);
+        free(pool);
+        return NULL;
+    }
+    pool->size = REST_HTTP_POOL_SIZE;
+    pool->idle_timeout = REST_HTTP_POOL_IDLE_TIMEOUT;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    {
+        pthread_mutex_init(&pool->share_mutex[i], NULL);
+    }
+
+    // Connections to the same receiver resume TLS sessions instead of full handshakes
+    curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, rest_http_share_lock);
+    curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, rest_http_share_unlock);
+    curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+
+    metrics_register(&metric_connections_opened);
+    metrics_register(&metric_connections_reused);
+    metrics_register(&metric_connect_time_us);
+    metrics_register(&metric_idle_connections);
+
+    return pool;
+}
+
+void rest_http_pool_delete(rest_http_pool_t *pool)
+{
+    size_t i;
+
+    for (i = 0; i < pool->idle_count; i++)
+    {
+        rest_http_connection_delete(pool->idle[i]);
+    }
+    pool->idle_count = 0;
+    rest_http_pool_report(pool);
+
+    // Share must outlive every handle which uses it
+    curl_share_cleanup(pool->share);
+
+    for (i = 0; i < CURL_LOCK_DATA_LAST; i++)
+    {
+        pthread_mutex_destroy(&pool->share_mutex[i]);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+
+    free(pool->idle);
+    free(pool);
+}
+
+int rest_http_pool_set_limits(rest_http_pool_t *pool, size_t size, int idle_timeout)
+{
+    rest_http_connection_t **idle;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    pool->size = size;
+    pool->idle_timeout = idle_timeout;
+    rest_http_pool_expire(pool, metrics_time_us(), 0);
+
+    idle = realloc(pool->idle, (size > 0 ? size : 1) * sizeof(rest_http_connection_t *));
+    if (idle != NULL)
+    {
+        pool->idle = idle;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return idle != NULL ? 0 : -1;
+}
+
+int rest_http_pool_put(rest_http_pool_t *pool, const char *url, const json_t *headers,
+                       const char *content_type, const char *encoding, const uint8_t *data,
+                       size_t length, long timeout, long *status)
+{
+    rest_http_connection_t *connection;
+    struct curl_slist *header_list = NULL, *next;
+    const char *header;
+    json_t *value;
+    char *line;
+    curl_off_t connect_time, appconnect_time;
+    long connects = 0;
+    CURLcode res;
+
+    *status = 0;
+
+    connection = rest_http_pool_acquire(pool, url);
+    if (connection == NULL)
+    {
+        log_message(LOG_LEVEL_ERROR, "[CALLBACK] Failed to open connection to %s\n", url);
+        return -1;
+    }
+
+    json_object_foreach((json_t *)headers, header, value)
+    {
+        // Content type and encoding are determined by the body
+        if (strcasecmp(header, "Content-Type") == 0 || strcasecmp(header, "Content-Encoding") == 0
+            || asprintf(&line, "%s: %s", header, json_string_value(value)) < 0)
+        {
+            continue;
+        }
+        next = curl_slist_append(header_list, line);
+        free(line);
+        header_list = next != NULL ? next : header_list;
+    }
+    if (asprintf(&line, "Content-Type: %s", content_type) >= 0)
+    {
+        next = curl_slist_append(header_list, line);
+        free(line);
+        header_list = next != NULL ? next : header_list;
+    }
+    if (encoding != NULL && asprintf(&line, "Content-Encoding: %s", encoding) >= 0)
+    {
+        next = curl_slist_append(header_list, line);
+        free(line);
+        header_list = next != NULL ? next : header_list;
+    }
+    // Waiting for "100 Continue" would cost another round trip per batch
+    next = curl_slist_append(header_list, "Expect:");
+    header_list = next != NULL ? next : header_list;
+
+    curl_easy_setopt(connection->curl, CURLOPT_URL, url);
+    curl_easy_setopt(connection->curl, CURLOPT_CUSTOMREQUEST, "PUT");
+    curl_easy_setopt(connection->curl, CURLOPT_POSTFIELDS, data);
+    curl_easy_setopt(connection->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)length);
+    curl_easy_setopt(connection->curl, CURLOPT_HTTPHEADER, header_list);
+    curl_easy_setopt(connection->curl, CURLOPT_TIMEOUT, timeout);
+    curl_easy_setopt(connection->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(connection->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(connection->curl, CURLOPT_SHARE, pool->share);
+    curl_easy_setopt(connection->curl, CURLOPT_WRITEFUNCTION, rest_http_discard_cb);
+#if LIBCURL_VERSION_NUM >= 0x074100
+    // Receiver may have closed a connection which idled for longer
+    curl_easy_setopt(connection->curl, CURLOPT_MAXAGE_CONN, (long)pool->idle_timeout);
+#endif
+
+    res = curl_easy_perform(connection->curl);
+
+    curl_easy_getinfo(connection->curl, CURLINFO_NUM_CONNECTS, &connects);
+    if (connects > 0)
+    {
+        metrics_add(&metric_connections_opened, connects);
+
+        // Includes TLS handshake for HTTPS receivers
+        if (curl_easy_getinfo(connection->curl, CURLINFO_CONNECT_TIME_T, &connect_time) == CURLE_OK
+            && curl_easy_getinfo(connection->curl, CURLINFO_APPCONNECT_TIME_T,
+                                 &appconnect_time) == CURLE_OK)
+        {
+            metrics_add(&metric_connect_time_us,
+                        appconnect_time > connect_time ? appconnect_time : connect_time);
+        }
+    }
+    else if (res == CURLE_OK)
+    {
+        metrics_add(&metric_connections_reused, 1);
+    }
+
+    curl_slist_free_all(header_list);
+
+    if (res != CURLE_OK)
+    {
+        log_message(LOG_LEVEL_WARN, "[CALLBACK] Request to %s failed: %s\n", url,
+                    curl_easy_strerror(res));
+    }
+    else
+    {
+        curl_easy_getinfo(connection->curl, CURLINFO_RESPONSE_CODE, status);
+    }
+
+    // Failed connection is not kept, as it is likely to be broken
+    rest_http_pool_release(pool, connection, res == CURLE_OK);
+
+    if (res != CURLE_OK)
+    {
+        return -1;
+    }
+
+    if (*status < 200 || *status > 299)
+    {
+        log_message(LOG_LEVEL_WARN, "[CALLBACK] Request to %s failed with status %ld\n", url,
+                    *status);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_HTTP_POOL_H
+#define REST_HTTP_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <curl/curl.h>
+#include <jansson.h>
+
+#define REST_HTTP_POOL_SIZE         4
+#define REST_HTTP_POOL_IDLE_TIMEOUT 60
+
+typedef struct
+{
+    CURL *curl;
+    char *origin;
+    int64_t last_used;
+} rest_http_connection_t;
+
+/*
+ * Pool of idle keep-alive connections (curl handles) to callback receivers,
+ * keyed by origin (scheme, host and port). A connection is taken out of the
+ * pool for the duration of a request, so the pool is safe to use from
+ * several threads. TLS sessions and DNS lookups are shared by all
+ * connections of the pool.
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_mutex_t share_mutex[CURL_LOCK_DATA_LAST];
+    CURLSH *share;
+    rest_http_connection_t **idle;
+    size_t idle_count;
+    size_t reported_count;
+    size_t size;
+    int idle_timeout;
+} rest_http_pool_t;
+
+/**
+ * Creates connection pool with default limits.
+ *
+ * @return Pointer to a new pool or NULL on error
+ */
+rest_http_pool_t *rest_http_pool_new(void);
+
+/**
+ * Closes pooled connections and releases pool resources. There must be no
+ * requests in progress.
+ *
+ * @param[in]  pool  Pointer to the pool
+ */
+void rest_http_pool_delete(rest_http_pool_t *pool);
+
+/**
+ * Sets pool limits, idle connections over the new limits are closed.
+ *
+ * @param[in]  pool          Pointer to the pool
+ * @param[in]  size          Number of idle connections kept open (0 disables reuse)
+ * @param[in]  idle_timeout  Seconds after which an idle connection is closed
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_http_pool_set_limits(rest_http_pool_t *pool, size_t size, int idle_timeout);
+
+/**
+ * Sends PUT request over a pooled connection (a new one is opened if there
+ * is no idle connection to the same origin).
+ *
+ * @param[in]  pool          Pointer to the pool
+ * @param[in]  url           Request URL
+ * @param[in]  headers       Object of additional string headers or NULL
+ * @param[in]  content_type  Content type of the body
+ * @param[in]  encoding      Content encoding of the body or NULL
+ * @param[in]  data          Request body
+ * @param[in]  length        Length of the body
+ * @param[in]  timeout       Request timeout in seconds
+ * @param[out] status        HTTP status of the response, 0 if there was no response
+ *
+ * @return 0 if the receiver accepted the request (2xx status), -1 on error
+ */
+int rest_http_pool_put(rest_http_pool_t *pool, const char *url, const json_t *headers,
+                       const char *content_type, const char *encoding, const uint8_t *data,
+                       size_t length, long timeout, long *status);
+
+#endif // REST_HTTP_POOL_H
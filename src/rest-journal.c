@@ -0,0 +1,692 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define LOG_MODULE LOG_MODULE_JOURNAL
+
+#include "rest-journal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "metrics.h"
+#include "rest-core-types.h"
+
+#define REST_JOURNAL_MAGIC "PUNJRNL3"
+#define REST_JOURNAL_ACK_FILE "ack"
+#define REST_JOURNAL_SUFFIX ".journal"
+#define REST_JOURNAL_MIN_SEGMENT_SIZE (64 * 1024)
+#define REST_JOURNAL_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+typedef struct
+{
+    char magic[8];
+    uint64_t first_seq;
+} rest_journal_header_t;
+
+/*
+ * Record is committed by storing non-zero length last, checksum covers the
+ * whole record, so torn records at the end of a segment are ignored.
+ */
+typedef struct
+{
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t seq;
+    uint32_t type;
+    uint32_t flags; // reserved
+} rest_journal_record_t;
+
+typedef struct
+{
+    uint64_t seq;
+    uint64_t check;
+} rest_journal_ack_t;
+
+static metric_t metric_records = METRIC_COUNTER_INIT("journal.records");
+static metric_t metric_bytes = METRIC_COUNTER_INIT("journal.bytes");
+static metric_t metric_syncs = METRIC_COUNTER_INIT("journal.syncs");
+static metric_t metric_sync_us_max = METRIC_GAUGE_INIT("journal.sync_us_max");
+static metric_t metric_segments = METRIC_GAUGE_INIT("journal.segments");
+
+
+static uint32_t rest_journal_fnv(uint32_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t rest_journal_checksum(const rest_journal_record_t *record, uint32_t length)
+{
+    uint32_t hash = 2166136261u;
+
+    hash = rest_journal_fnv(hash, &length, sizeof(length));
+    hash = rest_journal_fnv(hash, &record->seq, sizeof(*record) - offsetof(rest_journal_record_t,
+                                                                           seq));
+    return rest_journal_fnv(hash, record + 1, length);
+}
+
+static char *rest_journal_path(const rest_journal_t *journal, const char *name)
+{
+    size_t length = strlen(journal->directory) + strlen(name) + 2;
+    char *path = malloc(length);
+
+    if (path != NULL)
+    {
+        snprintf(path, length, "%s/%s", journal->directory, name);
+    }
+
+    return path;
+}
+
+/*
+ * Walks valid records of the segment, updates its last sequence number and
+ * replays records newer than acknowledged if callback is given.
+ */
+static size_t rest_journal_scan(rest_journal_t *journal, rest_journal_segment_t *segment,
+                                rest_journal_replay_cb_t callback, void *context)
+{
+    const rest_journal_header_t *header;
+    const rest_journal_record_t *record;
+    struct stat st;
+    uint8_t *map;
+    size_t offset, replayed = 0;
+    void *data;
+    int fd;
+
+    fd = open(segment->path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header))
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to map %s: %s\n", segment->path,
+                    strerror(errno));
+        return 0;
+    }
+
+    header = (const rest_journal_header_t *)map;
+    if (memcmp(header->magic, REST_JOURNAL_MAGIC, sizeof(header->magic)) != 0)
+    {
+        log_message(LOG_LEVEL_WARN, "[JOURNAL] Ignoring invalid segment %s\n", segment->path);
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    for (offset = sizeof(*header); offset + sizeof(*record) <= (size_t)st.st_size;
+         offset += REST_JOURNAL_ALIGN(sizeof(*record) + record->length))
+    {
+        record = (const rest_journal_record_t *)(map + offset);
+        if (record->length == 0
+            || record->length > st.st_size - offset - sizeof(*record)
+            || record->seq <= segment->last_seq
+            || rest_journal_checksum(record, record->length) != record->checksum)
+        {
+            break;
+        }
+
+        segment->last_seq = record->seq;
+
+        if (callback != NULL && record->seq > journal->acked)
+        {
+            data = rest_notification_decode(record->type, (const uint8_t *)(record + 1),
+                                            record->length);
+            if (data == NULL)
+            {
+                log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to decode record %" PRIu64 "\n",
+                            record->seq);
+                continue;
+            }
+
+            callback(record->type, data, context);
+            replayed++;
+        }
+    }
+
+    munmap(map, st.st_size);
+
+    return replayed;
+}
+
+static int rest_journal_compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int rest_journal_load(rest_journal_t *journal)
+{
+    rest_journal_segment_t *segment;
+    struct dirent *entry;
+    char **names = NULL, **grown;
+    size_t count = 0, capacity = 0, i;
+    uint64_t first_seq;
+    char suffix[16];
+    DIR *dir;
+
+    dir = opendir(journal->directory);
+    if (dir == NULL)
+    {
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strlen(entry->d_name) != 20 + strlen(REST_JOURNAL_SUFFIX)
+            || sscanf(entry->d_name, "%20" SCNu64 "%15s", &first_seq, suffix) != 2
+            || strcmp(suffix, REST_JOURNAL_SUFFIX) != 0)
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 16;
+            grown = realloc(names, capacity * sizeof(char *));
+            if (grown == NULL)
+            {
+                break;
+            }
+            names = grown;
+        }
+
+        names[count] = strdup(entry->d_name);
+        if (names[count] != NULL)
+        {
+            count++;
+        }
+    }
+    closedir(dir);
+
+    // Zero padded sequence numbers sort lexicographically
+    if (count > 0)
+    {
+        qsort(names, count, sizeof(char *), rest_journal_compare_names);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        segment = calloc(1, sizeof(rest_journal_segment_t));
+        if (segment == NULL || (segment->path = rest_journal_path(journal, names[i])) == NULL)
+        {
+            free(segment);
+            free(names[i]);
+            continue;
+        }
+
+        segment->fd = -1;
+        rest_journal_scan(journal, segment, NULL, NULL);
+        if (segment->last_seq > journal->last_seq)
+        {
+            journal->last_seq = segment->last_seq;
+        }
+
+        if (journal->tail != NULL)
+        {
+            journal->tail->next = segment;
+        }
+        else
+        {
+            journal->head = segment;
+        }
+        journal->tail = segment;
+
+        metrics_add(&metric_segments, 1);
+        free(names[i]);
+    }
+    free(names);
+
+    return 0;
+}
+
+static void rest_journal_segment_delete(rest_journal_t *journal, rest_journal_segment_t *segment)
+{
+    if (segment->map != NULL)
+    {
+        munmap(segment->map, journal->segment_size);
+    }
+
+    if (segment->fd >= 0)
+    {
+        close(segment->fd);
+    }
+
+    free(segment->path);
+    free(segment);
+
+    metrics_add(&metric_segments, -1);
+}
+
+static rest_journal_segment_t *rest_journal_segment_create(rest_journal_t *journal,
+                                                           uint64_t first_seq)
+{
+    rest_journal_segment_t *segment;
+    rest_journal_header_t *header;
+    char name[32];
+    int res, dir_fd;
+
+    segment = calloc(1, sizeof(rest_journal_segment_t));
+    if (segment == NULL)
+    {
+        return NULL;
+    }
+
+    snprintf(name, sizeof(name), "%020" PRIu64 REST_JOURNAL_SUFFIX, first_seq);
+    segment->path = rest_journal_path(journal, name);
+    segment->fd = segment->path ? open(segment->path, O_RDWR | O_CREAT | O_TRUNC, 0640) : -1;
+    if (segment->fd < 0)
+    {
+        free(segment->path);
+        free(segment);
+        return NULL;
+    }
+    metrics_add(&metric_segments, 1);
+
+    // Allocate blocks up front, running out of space must not SIGBUS the writer
+    res = posix_fallocate(segment->fd, 0, journal->segment_size);
+    if (res != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to allocate %s: %s\n", segment->path,
+                    strerror(res));
+        unlink(segment->path);
+        rest_journal_segment_delete(journal, segment);
+        return NULL;
+    }
+
+    segment->map = mmap(NULL, journal->segment_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, segment->fd, 0);
+    if (segment->map == MAP_FAILED)
+    {
+        segment->map = NULL;
+        unlink(segment->path);
+        rest_journal_segment_delete(journal, segment);
+        return NULL;
+    }
+
+    header = (rest_journal_header_t *)segment->map;
+    memcpy(header->magic, REST_JOURNAL_MAGIC, sizeof(header->magic));
+    header->first_seq = first_seq;
+    segment->offset = sizeof(*header);
+    segment->dirty = true;
+
+    // Make the new directory entry durable as well
+    dir_fd = open(journal->directory, O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0)
+    {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
+
+    return segment;
+}
+
+/*
+ * Syncs dirty segments and acknowledged sequence number, then deletes fully
+ * acknowledged segments. Called with the journal mutex held, which is
+ * released while waiting for the disk.
+ */
+static void rest_journal_sync(rest_journal_t *journal)
+{
+    rest_journal_segment_t *segment;
+    rest_journal_ack_t ack;
+    int fds[64];
+    size_t count = 0, i;
+    int64_t start;
+
+    for (segment = journal->head; segment != NULL && count < 64; segment = segment->next)
+    {
+        if (segment->dirty && segment->fd >= 0)
+        {
+            segment->dirty = false;
+            fds[count++] = segment->fd;
+        }
+    }
+    ack.seq = journal->acked;
+
+    if (count == 0 && ack.seq == journal->acked_persisted)
+    {
+        return;
+    }
+
+    // Sealed segment descriptors are closed only below, by this thread
+    pthread_mutex_unlock(&journal->mutex);
+
+    start = metrics_time_us();
+    for (i = 0; i < count; i++)
+    {
+        if (fdatasync(fds[i]) != 0)
+        {
+            log_message(LOG_LEVEL_ERROR, "[JOURNAL] fdatasync() failed: %s\n", strerror(errno));
+        }
+    }
+
+    if (ack.seq != journal->acked_persisted)
+    {
+        ack.check = ack.seq ^ 0x50554e4943414b21ull;
+        if (pwrite(journal->ack_fd, &ack, sizeof(ack), 0) != sizeof(ack)
+            || fdatasync(journal->ack_fd) != 0)
+        {
+            log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to persist acknowledgement: %s\n",
+                        strerror(errno));
+            ack.seq = journal->acked_persisted;
+        }
+    }
+
+    metrics_add(&metric_syncs, 1);
+    metrics_max(&metric_sync_us_max, metrics_time_us() - start);
+
+    pthread_mutex_lock(&journal->mutex);
+
+    journal->acked_persisted = ack.seq;
+
+    for (segment = journal->head; segment != NULL; segment = segment->next)
+    {
+        if (segment != journal->tail && !segment->dirty && segment->fd >= 0)
+        {
+            close(segment->fd);
+            segment->fd = -1;
+        }
+    }
+
+    // Compaction: drop leading segments which contain only acknowledged records
+    while (journal->head != NULL && journal->head != journal->tail
+           && journal->head->fd < 0 && journal->head->last_seq <= journal->acked_persisted)
+    {
+        segment = journal->head;
+        journal->head = segment->next;
+
+        log_message(LOG_LEVEL_DEBUG, "[JOURNAL] Removing segment %s\n", segment->path);
+        unlink(segment->path);
+        rest_journal_segment_delete(journal, segment);
+    }
+}
+
+static void *rest_journal_thread(void *context)
+{
+    rest_journal_t *journal = (rest_journal_t *)context;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&journal->mutex);
+
+    while (journal->running)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long)journal->sync_interval * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+
+        pthread_cond_timedwait(&journal->cond, &journal->mutex, &deadline);
+
+        rest_journal_sync(journal);
+    }
+
+    pthread_mutex_unlock(&journal->mutex);
+
+    return NULL;
+}
+
+rest_journal_t *rest_journal_open(const char *directory, size_t segment_size, int sync_interval)
+{
+    rest_journal_t *journal;
+    rest_journal_ack_t ack;
+    char *path;
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    if (mkdir(directory, 0750) != 0 && errno != EEXIST)
+    {
+        log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to create %s: %s\n", directory,
+                    strerror(errno));
+        return NULL;
+    }
+
+    journal = calloc(1, sizeof(rest_journal_t));
+    if (journal == NULL)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_init(&journal->mutex, NULL);
+    pthread_cond_init(&journal->cond, NULL);
+
+    if (segment_size < REST_JOURNAL_MIN_SEGMENT_SIZE)
+    {
+        segment_size = REST_JOURNAL_MIN_SEGMENT_SIZE;
+    }
+    journal->segment_size = (segment_size + page_size - 1) / page_size * page_size;
+    journal->sync_interval = sync_interval > 0 ? sync_interval : REST_JOURNAL_SYNC_INTERVAL;
+    journal->directory = strdup(directory);
+
+    path = journal->directory ? rest_journal_path(journal, REST_JOURNAL_ACK_FILE) : NULL;
+    journal->ack_fd = path ? open(path, O_RDWR | O_CREAT, 0640) : -1;
+    free(path);
+    if (journal->ack_fd < 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to open acknowledgement file: %s\n",
+                    strerror(errno));
+        rest_journal_close(journal);
+        return NULL;
+    }
+
+    if (pread(journal->ack_fd, &ack, sizeof(ack), 0) == sizeof(ack)
+        && ack.check == (ack.seq ^ 0x50554e4943414b21ull))
+    {
+        journal->acked = ack.seq;
+        journal->acked_persisted = ack.seq;
+    }
+
+    metrics_register(&metric_records);
+    metrics_register(&metric_bytes);
+    metrics_register(&metric_syncs);
+    metrics_register(&metric_sync_us_max);
+    metrics_register(&metric_segments);
+
+    if (rest_journal_load(journal) != 0)
+    {
+        rest_journal_close(journal);
+        return NULL;
+    }
+
+    log_message(LOG_LEVEL_INFO, "[JOURNAL] Opened %s, acknowledged %" PRIu64 " of %" PRIu64 "\n",
+                directory, journal->acked, journal->last_seq);
+
+    return journal;
+}
+
+void rest_journal_close(rest_journal_t *journal)
+{
+    rest_journal_segment_t *segment;
+    bool running;
+
+    pthread_mutex_lock(&journal->mutex);
+    running = journal->running;
+    journal->running = false;
+    pthread_cond_signal(&journal->cond);
+    pthread_mutex_unlock(&journal->mutex);
+
+    if (running)
+    {
+        pthread_join(journal->thread, NULL);
+    }
+
+    pthread_mutex_lock(&journal->mutex);
+    if (journal->ack_fd >= 0)
+    {
+        rest_journal_sync(journal);
+        close(journal->ack_fd);
+    }
+    pthread_mutex_unlock(&journal->mutex);
+
+    while (journal->head != NULL)
+    {
+        segment = journal->head;
+        journal->head = segment->next;
+        rest_journal_segment_delete(journal, segment);
+    }
+
+    pthread_cond_destroy(&journal->cond);
+    pthread_mutex_destroy(&journal->mutex);
+
+    free(journal->directory);
+    free(journal);
+}
+
+uint64_t rest_journal_next_seq(const rest_journal_t *journal)
+{
+    return (journal->last_seq > journal->acked ? journal->last_seq : journal->acked) + 1;
+}
+
+size_t rest_journal_replay(rest_journal_t *journal, rest_journal_replay_cb_t callback,
+                           void *context)
+{
+    rest_journal_segment_t *segment, *last = journal->tail;
+    size_t replayed = 0;
+
+    // Callback may append (creating new segments), those must not be replayed
+    for (segment = journal->head; last != NULL; segment = segment->next)
+    {
+        if (segment->last_seq > journal->acked)
+        {
+            segment->last_seq = 0;
+            replayed += rest_journal_scan(journal, segment, callback, context);
+        }
+
+        if (segment == last)
+        {
+            break;
+        }
+    }
+
+    return replayed;
+}
+
+int rest_journal_start(rest_journal_t *journal)
+{
+    journal->running = true;
+
+    if (pthread_create(&journal->thread, NULL, rest_journal_thread, journal) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to start sync thread: %s\n",
+                    strerror(errno));
+        journal->running = false;
+        return -1;
+    }
+
+    return 0;
+}
+
+int rest_journal_append(rest_journal_t *journal, const rest_notification_t *notification)
+{
+    rest_journal_segment_t *segment;
+    rest_journal_record_t *record;
+    size_t length, size;
+
+    length = rest_notification_encoded_size(notification);
+    size = REST_JOURNAL_ALIGN(sizeof(rest_journal_record_t) + length);
+    if (size > journal->segment_size - sizeof(rest_journal_header_t))
+    {
+        log_message(LOG_LEVEL_ERROR, "[JOURNAL] Record %" PRIu64 " is too large (%zu bytes)\n",
+                    notification->seq, size);
+        return -1;
+    }
+
+    pthread_mutex_lock(&journal->mutex);
+
+    segment = journal->tail;
+    if (segment == NULL || segment->map == NULL || segment->offset + size > journal->segment_size)
+    {
+        segment = rest_journal_segment_create(journal, notification->seq);
+        if (segment == NULL)
+        {
+            pthread_mutex_unlock(&journal->mutex);
+            log_message(LOG_LEVEL_ERROR, "[JOURNAL] Failed to create segment: %s\n",
+                        strerror(errno));
+            return -1;
+        }
+
+        // Seal previous segment, its descriptor stays open until synced
+        if (journal->tail != NULL)
+        {
+            if (journal->tail->map != NULL)
+            {
+                munmap(journal->tail->map, journal->segment_size);
+                journal->tail->map = NULL;
+            }
+            journal->tail->next = segment;
+        }
+        else
+        {
+            journal->head = segment;
+        }
+        journal->tail = segment;
+    }
+
+    record = (rest_journal_record_t *)(segment->map + segment->offset);
+    record->seq = notification->seq;
+    record->type = notification->type;
+    record->flags = 0;
+    rest_notification_encode(notification, (uint8_t *)(record + 1));
+    record->checksum = rest_journal_checksum(record, length);
+    __atomic_store_n(&record->length, length, __ATOMIC_RELEASE);
+
+    segment->offset += size;
+    segment->last_seq = notification->seq;
+    segment->dirty = true;
+    journal->last_seq = notification->seq;
+
+    pthread_mutex_unlock(&journal->mutex);
+
+    metrics_add(&metric_records, 1);
+    metrics_add(&metric_bytes, size);
+
+    return 0;
+}
+
+void rest_journal_ack(rest_journal_t *journal, uint64_t seq)
+{
+    pthread_mutex_lock(&journal->mutex);
+    if (seq > journal->acked)
+    {
+        journal->acked = seq;
+    }
+    pthread_mutex_unlock(&journal->mutex);
+}
@@ -0,0 +1,148 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_JOURNAL_H
+#define REST_JOURNAL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rest-notification-log.h"
+
+#define REST_JOURNAL_SEGMENT_SIZE (16 * 1024 * 1024)
+#define REST_JOURNAL_SYNC_INTERVAL 50 // milliseconds
+
+
+typedef struct rest_journal_segment_t
+{
+    struct rest_journal_segment_t *next;
+    char *path;
+    uint64_t last_seq;
+    int fd;
+    uint8_t *map;
+    size_t offset;
+    bool dirty;
+} rest_journal_segment_t;
+
+/*
+ * Append-only notification journal. Records are copied into memory mapped
+ * segment files and made durable by a background thread, which fsyncs all
+ * dirty segments together every sync interval, persists acknowledged
+ * sequence number and deletes segments whose records are all acknowledged.
+ * Journal is thread-safe.
+ */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    bool running;
+    char *directory;
+    int ack_fd;
+    size_t segment_size;
+    int sync_interval;
+    rest_journal_segment_t *head;
+    rest_journal_segment_t *tail;
+    uint64_t last_seq;
+    uint64_t acked;
+    uint64_t acked_persisted;
+} rest_journal_t;
+
+/**
+ * Callback, which receives unacknowledged notification on replay.
+ *
+ * @param[in]  type     Notification type
+ * @param[in]  data     Notification of the corresponding rest_notif_*_t type,
+ *                      ownership is transferred to the callback
+ * @param[in]  context  Replay context
+ */
+typedef void (*rest_journal_replay_cb_t)(rest_notification_type_t type, void *data,
+                                         void *context);
+
+/**
+ * Opens (creating if needed) journal directory and scans existing segments.
+ *
+ * @param[in]  directory      Journal directory
+ * @param[in]  segment_size   Segment file size in bytes
+ * @param[in]  sync_interval  Group sync interval in milliseconds
+ *
+ * @return Pointer to a new journal instance or NULL on error
+ */
+rest_journal_t *rest_journal_open(const char *directory, size_t segment_size, int sync_interval);
+
+/**
+ * Stops the sync thread, syncs pending records and closes the journal.
+ *
+ * @param[in]  journal  Pointer to the journal
+ */
+void rest_journal_close(rest_journal_t *journal);
+
+/**
+ * Returns sequence number, which is greater than any journaled or
+ * acknowledged one.
+ *
+ * @param[in]  journal  Pointer to the journal
+ *
+ * @return Next free sequence number
+ */
+uint64_t rest_journal_next_seq(const rest_journal_t *journal);
+
+/**
+ * Passes every unacknowledged record found by rest_journal_open() to the
+ * callback in journal order.
+ *
+ * @param[in]  journal   Pointer to the journal
+ * @param[in]  callback  Replay callback
+ * @param[in]  context   Replay context
+ *
+ * @return Number of replayed records
+ */
+size_t rest_journal_replay(rest_journal_t *journal, rest_journal_replay_cb_t callback,
+                           void *context);
+
+/**
+ * Starts the sync thread.
+ *
+ * @param[in]  journal  Pointer to the journal
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_journal_start(rest_journal_t *journal);
+
+/**
+ * Appends notification record. Sequence numbers must be increasing.
+ *
+ * @param[in]  journal       Pointer to the journal
+ * @param[in]  notification  Notification to be journaled
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_journal_append(rest_journal_t *journal, const rest_notification_t *notification);
+
+/**
+ * Acknowledges all records up to (and including) the sequence number.
+ *
+ * @param[in]  journal  Pointer to the journal
+ * @param[in]  seq      Sequence number
+ */
+void rest_journal_ack(rest_journal_t *journal, uint64_t seq);
+
+#endif // REST_JOURNAL_H
@@ -0,0 +1,368 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rest-json.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rest-base64.h"
+
+#define REST_JSON_INITIAL_CAPACITY 4096
+
+// Longest decimal representation of a 64-bit integer with sign
+#define REST_JSON_INT_MAX_LENGTH 20
+
+
+static char *rest_json_grow(rest_json_writer_t *writer, size_t length)
+{
+    size_t capacity;
+    char *data;
+
+    if (writer->failed)
+    {
+        return NULL;
+    }
+
+    capacity = writer->capacity > 0 ? writer->capacity : REST_JSON_INITIAL_CAPACITY;
+    while (capacity < writer->length + length)
+    {
+        capacity *= 2;
+    }
+
+    data = realloc(writer->data, capacity);
+    if (data == NULL)
+    {
+        writer->failed = true;
+        return NULL;
+    }
+
+    writer->data = data;
+    writer->capacity = capacity;
+
+    return data + writer->length;
+}
+
+/*
+ * Returns space for at most length bytes at the end of the buffer, the
+ * caller advances writer->length by the number of bytes actually used.
+ * One separator byte is reserved and written if a value precedes.
+ */
+static inline char *rest_json_value(rest_json_writer_t *writer, size_t length)
+{
+    char *data;
+
+    length += 1;
+    if (writer->length + length <= writer->capacity)
+    {
+        data = writer->data + writer->length;
+    }
+    else
+    {
+        data = rest_json_grow(writer, length);
+        if (data == NULL)
+        {
+            return NULL;
+        }
+    }
+
+    if (writer->separator)
+    {
+        *data++ = ',';
+        writer->length++;
+    }
+    writer->separator = true;
+
+    return data;
+}
+
+static inline void rest_json_byte(rest_json_writer_t *writer, char byte, bool separator)
+{
+    char *data = rest_json_value(writer, 1);
+
+    if (data != NULL)
+    {
+        data[0] = byte;
+        writer->length++;
+    }
+    writer->separator = separator;
+}
+
+static size_t rest_json_escaped_length(const char *string, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        if ((unsigned char)string[i] < 0x20 || string[i] == '"' || string[i] == '\\')
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static char *rest_json_escape(char *output, const char *string, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    unsigned char c;
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        c = string[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
+        {
+            *output++ = c;
+            continue;
+        }
+
+        *output++ = '\\';
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            *output++ = c;
+            break;
+        case '\b':
+            *output++ = 'b';
+            break;
+        case '\f':
+            *output++ = 'f';
+            break;
+        case '\n':
+            *output++ = 'n';
+            break;
+        case '\r':
+            *output++ = 'r';
+            break;
+        case '\t':
+            *output++ = 't';
+            break;
+        default:
+            *output++ = 'u';
+            *output++ = '0';
+            *output++ = '0';
+            *output++ = hex[c >> 4];
+            *output++ = hex[c & 0xf];
+            break;
+        }
+    }
+
+    return output;
+}
+
+void rest_json_writer_init(rest_json_writer_t *writer)
+{
+    memset(writer, 0, sizeof(rest_json_writer_t));
+}
+
+void rest_json_writer_cleanup(rest_json_writer_t *writer)
+{
+    free(writer->data);
+    rest_json_writer_init(writer);
+}
+
+bool rest_json_writer_failed(const rest_json_writer_t *writer)
+{
+    return writer->failed;
+}
+
+void rest_json_writer_reserve(rest_json_writer_t *writer, size_t length)
+{
+    if (writer->length + length > writer->capacity)
+    {
+        rest_json_grow(writer, length);
+    }
+}
+
+void rest_json_object_start(rest_json_writer_t *writer)
+{
+    rest_json_byte(writer, '{', false);
+}
+
+void rest_json_object_end(rest_json_writer_t *writer)
+{
+    writer->separator = false;
+    rest_json_byte(writer, '}', true);
+}
+
+void rest_json_array_start(rest_json_writer_t *writer)
+{
+    rest_json_byte(writer, '[', false);
+}
+
+void rest_json_array_end(rest_json_writer_t *writer)
+{
+    writer->separator = false;
+    rest_json_byte(writer, ']', true);
+}
+
+void rest_json_key(rest_json_writer_t *writer, const char *key)
+{
+    rest_json_string(writer, key);
+    writer->separator = false;
+    rest_json_byte(writer, ':', false);
+}
+
+void rest_json_string(rest_json_writer_t *writer, const char *string)
+{
+    rest_json_stringn(writer, string, strlen(string));
+}
+
+void rest_json_stringn(rest_json_writer_t *writer, const char *string, size_t length)
+{
+    size_t plain = rest_json_escaped_length(string, length);
+    char *data, *end;
+
+    if (plain == length)
+    {
+        // Nothing to escape, which is the common case
+        data = rest_json_value(writer, length + 2);
+        if (data == NULL)
+        {
+            return;
+        }
+
+        data[0] = '"';
+        memcpy(data + 1, string, length);
+        data[length + 1] = '"';
+        writer->length += length + 2;
+        return;
+    }
+
+    // Worst case every remaining character becomes \u00XX
+    data = rest_json_value(writer, plain + 6 * (length - plain) + 2);
+    if (data == NULL)
+    {
+        return;
+    }
+
+    data[0] = '"';
+    memcpy(data + 1, string, plain);
+    end = rest_json_escape(data + 1 + plain, string + plain, length - plain);
+    *end++ = '"';
+    writer->length += end - data;
+}
+
+static void rest_json_digits(rest_json_writer_t *writer, uint64_t value, bool negative)
+{
+    char digits[REST_JSON_INT_MAX_LENGTH];
+    size_t count = 0, i;
+    char *data;
+
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    data = rest_json_value(writer, count + negative);
+    if (data == NULL)
+    {
+        return;
+    }
+
+    if (negative)
+    {
+        *data++ = '-';
+        writer->length++;
+    }
+    for (i = 0; i < count; i++)
+    {
+        data[i] = digits[count - 1 - i];
+    }
+    writer->length += count;
+}
+
+void rest_json_int(rest_json_writer_t *writer, int64_t value)
+{
+    if (value < 0)
+    {
+        // Magnitude without overflowing on INT64_MIN
+        rest_json_digits(writer, ~(uint64_t)value + 1, true);
+    }
+    else
+    {
+        rest_json_digits(writer, value, false);
+    }
+}
+
+void rest_json_uint(rest_json_writer_t *writer, uint64_t value)
+{
+    rest_json_digits(writer, value, false);
+}
+
+void rest_json_bool(rest_json_writer_t *writer, bool value)
+{
+    const char *text = value ? "true" : "false";
+    size_t length = value ? 4 : 5;
+    char *data = rest_json_value(writer, length);
+
+    if (data != NULL)
+    {
+        memcpy(data, text, length);
+        writer->length += length;
+    }
+}
+
+void rest_json_null(rest_json_writer_t *writer)
+{
+    char *data = rest_json_value(writer, 4);
+
+    if (data != NULL)
+    {
+        memcpy(data, "null", 4);
+        writer->length += 4;
+    }
+}
+
+void rest_json_base64(rest_json_writer_t *writer, const uint8_t *data, size_t length)
+{
+    // Encoder writes a null-terminator, which is overwritten by the closing quote
+    size_t encoded = rest_base64_encoded_length(length);
+    char *output = rest_json_value(writer, encoded + 2);
+
+    if (output == NULL)
+    {
+        return;
+    }
+
+    output[0] = '"';
+    rest_base64_encode(data, length, output + 1);
+    output[encoded + 1] = '"';
+    writer->length += encoded + 2;
+}
+
+void rest_json_raw(rest_json_writer_t *writer, const char *text)
+{
+    rest_json_rawn(writer, text, strlen(text));
+}
+
+void rest_json_rawn(rest_json_writer_t *writer, const char *text, size_t length)
+{
+    char *data = rest_json_value(writer, length);
+
+    if (data != NULL)
+    {
+        memcpy(data, text, length);
+        writer->length += length;
+    }
+}
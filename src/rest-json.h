@@ -0,0 +1,120 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_JSON_H
+#define REST_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming JSON writer, text is appended directly into a growing buffer
+ * without building a jansson tree. Separators are inserted automatically.
+ * Allocation failure is sticky and reported by rest_json_writer_failed().
+ */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    bool separator;
+    bool failed;
+} rest_json_writer_t;
+
+/**
+ * Initializes empty writer.
+ *
+ * @param[in]  writer  Pointer to the writer
+ */
+void rest_json_writer_init(rest_json_writer_t *writer);
+
+/**
+ * Releases buffer of the writer.
+ *
+ * @param[in]  writer  Pointer to the writer
+ */
+void rest_json_writer_cleanup(rest_json_writer_t *writer);
+
+/**
+ * Checks whether any of the values failed to be written.
+ *
+ * @param[in]  writer  Pointer to the writer
+ *
+ * @return true if the buffer is incomplete
+ */
+bool rest_json_writer_failed(const rest_json_writer_t *writer);
+
+/**
+ * Grows the buffer upfront, so that writing up to the given number of
+ * additional bytes does not reallocate.
+ *
+ * @param[in]  writer  Pointer to the writer
+ * @param[in]  length  Expected number of additional bytes
+ */
+void rest_json_writer_reserve(rest_json_writer_t *writer, size_t length);
+
+void rest_json_object_start(rest_json_writer_t *writer);
+void rest_json_object_end(rest_json_writer_t *writer);
+void rest_json_array_start(rest_json_writer_t *writer);
+void rest_json_array_end(rest_json_writer_t *writer);
+
+/**
+ * Writes object member name, which must be followed by its value.
+ *
+ * @param[in]  writer  Pointer to the writer
+ * @param[in]  key     Member name
+ */
+void rest_json_key(rest_json_writer_t *writer, const char *key);
+
+void rest_json_string(rest_json_writer_t *writer, const char *string);
+void rest_json_stringn(rest_json_writer_t *writer, const char *string, size_t length);
+void rest_json_int(rest_json_writer_t *writer, int64_t value);
+void rest_json_uint(rest_json_writer_t *writer, uint64_t value);
+void rest_json_bool(rest_json_writer_t *writer, bool value);
+void rest_json_null(rest_json_writer_t *writer);
+
+/**
+ * Writes data as a base64 encoded string.
+ *
+ * @param[in]  writer  Pointer to the writer
+ * @param[in]  data    Data to encode
+ * @param[in]  length  Length of the data
+ */
+void rest_json_base64(rest_json_writer_t *writer, const uint8_t *data, size_t length);
+
+/**
+ * Writes already serialized JSON value as is.
+ *
+ * @param[in]  writer  Pointer to the writer
+ * @param[in]  text    Valid JSON text
+ */
+void rest_json_raw(rest_json_writer_t *writer, const char *text);
+
+/**
+ * Writes already serialized JSON text of the given length as is, e.g. a
+ * comma separated sequence of array elements.
+ *
+ * @param[in]  writer  Pointer to the writer
+ * @param[in]  text    Valid JSON text
+ * @param[in]  length  Length of the text
+ */
+void rest_json_rawn(rest_json_writer_t *writer, const char *text, size_t length);
+
+#endif // REST_JSON_H
@@ -0,0 +1,150 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "restserver.h"
+#include "logging.h"
+
+#include <string.h>
+
+static bool validate_level(json_t *jlevel)
+{
+    return json_is_integer(jlevel)
+           && json_integer_value(jlevel) >= LOG_LEVEL_FATAL
+           && json_integer_value(jlevel) <= LOG_LEVEL_TRACE;
+}
+
+static bool validate_levels(json_t *jlevels)
+{
+    const char *key;
+    json_t *jvalue;
+    logging_module_t module;
+
+    if (!json_is_object(jlevels) || json_object_size(jlevels) == 0)
+    {
+        return false;
+    }
+
+    json_object_foreach(jlevels, key, jvalue)
+    {
+        if (strcmp(key, "level") == 0)
+        {
+            if (!validate_level(jvalue))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(key, "modules") == 0)
+        {
+            const char *name;
+            json_t *jlevel;
+
+            if (!json_is_object(jvalue))
+            {
+                return false;
+            }
+
+            json_object_foreach(jvalue, name, jlevel)
+            {
+                if (logging_module_parse(name, &module) != 0 || !validate_level(jlevel))
+                {
+                    return false;
+                }
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int rest_logging_get_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
+{
+    json_t *jlevels, *jmodules;
+    logging_module_t module;
+
+    jmodules = json_object();
+    for (module = 0; module < LOG_MODULE_COUNT; module++)
+    {
+        json_object_set_new(jmodules, logging_module_name(module),
+                            json_integer(logging_get_level(module)));
+    }
+
+    jlevels = json_pack("{s:i, s:i, s:o}",
+                        "level", logging_get_level(LOG_MODULE_CORE),
+                        "compile_level", LOGGING_COMPILE_LEVEL,
+                        "modules", jmodules);
+
+    rest_set_body_response(req, resp, 200, jlevels);
+    json_decref(jlevels);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_logging_put_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
+{
+    const char *ct;
+    const char *name;
+    json_t *jlevels, *jlevel;
+    logging_module_t module;
+
+    ct = u_map_get_case(req->map_header, "Content-Type");
+    if (ct == NULL || strcmp(ct, "application/json") != 0)
+    {
+        ulfius_set_empty_body_response(resp, 415);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    jlevels = json_loadb(req->binary_body, req->binary_body_length, 0, NULL);
+    if (!validate_levels(jlevels))
+    {
+        if (jlevels != NULL)
+        {
+            json_decref(jlevels);
+        }
+
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    // Global level is applied first, so that module levels override it
+    jlevel = json_object_get(jlevels, "level");
+    if (jlevel != NULL)
+    {
+        for (module = 0; module < LOG_MODULE_COUNT; module++)
+        {
+            logging_set_level(module, json_integer_value(jlevel));
+        }
+    }
+
+    json_object_foreach(json_object_get(jlevels, "modules"), name, jlevel)
+    {
+        logging_module_parse(name, &module);
+        logging_set_level(module, json_integer_value(jlevel));
+    }
+
+    log_message(LOG_LEVEL_INFO, "[LOGGING] Log levels changed\n");
+
+    json_decref(jlevels);
+    ulfius_set_empty_body_response(resp, 204);
+
+    return U_CALLBACK_COMPLETE;
+}
@@ -0,0 +1,32 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "restserver.h"
+#include "metrics.h"
+
+
+int rest_metrics_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
+{
+    json_t *jmetrics = metrics_json();
+
+    rest_set_body_response(req, resp, 200, jmetrics);
+    json_decref(jmetrics);
+
+    return U_CALLBACK_COMPLETE;
+}
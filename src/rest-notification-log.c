@@ -0,0 +1,641 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE // O_TMPFILE
+
+#define LOG_MODULE LOG_MODULE_NOTIFY
+
+#include "rest-notification-log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "metrics.h"
+#include "rest-core-types.h"
+
+// Approximate allocator and bookkeeping overhead of an in-memory notification
+#define REST_NOTIFICATION_OVERHEAD 64
+
+// Spilled notification still occupies its ring slot
+#define REST_NOTIFICATION_SPILLED_OVERHEAD sizeof(rest_notification_t)
+
+// Overflow file space is given back in whole file system blocks
+#define REST_NOTIFICATION_SPILL_BLOCK 4096
+
+#define REST_NOTIFICATION_HAS_PAYLOAD 0x1
+#define REST_NOTIFICATION_HAS_VALUES 0x2
+
+typedef struct
+{
+    int64_t timestamp;
+    int32_t status;
+    uint32_t flags;
+    uint32_t payload_length;
+    uint32_t values_length;
+    char id[40];
+} rest_notification_async_t;
+
+static metric_t metric_memory_bytes = METRIC_GAUGE_INIT("notifications.memory_bytes");
+static metric_t metric_memory_records = METRIC_GAUGE_INIT("notifications.memory_records");
+static metric_t metric_spilled_bytes = METRIC_GAUGE_INIT("notifications.spilled_bytes");
+static metric_t metric_spilled_records = METRIC_GAUGE_INIT("notifications.spilled_records");
+static metric_t metric_spilled_total = METRIC_COUNTER_INIT("notifications.spilled_total");
+static metric_t metric_dropped = METRIC_COUNTER_INIT("notifications.dropped");
+static metric_t metric_rejected = METRIC_COUNTER_INIT("notifications.rejected");
+
+
+void rest_notification_data_free(rest_notification_type_t type, void *data)
+{
+    switch (type)
+    {
+    case REST_NOTIFICATION_REGISTRATION:
+        rest_notif_registration_delete(data);
+        break;
+    case REST_NOTIFICATION_UPDATE:
+        rest_notif_update_delete(data);
+        break;
+    case REST_NOTIFICATION_DEREGISTRATION:
+        rest_notif_deregistration_delete(data);
+        break;
+    case REST_NOTIFICATION_ASYNC_RESPONSE:
+        rest_async_response_delete(data);
+        break;
+    }
+}
+
+static const char *rest_notification_name(const rest_notification_t *notification)
+{
+    // Registration, update and deregistration notifications share the layout
+    return ((const rest_notif_registration_t *)notification->data)->name;
+}
+
+size_t rest_notification_encoded_size(const rest_notification_t *notification)
+{
+    const rest_async_response_t *async;
+    const char *name;
+
+    if (notification->type == REST_NOTIFICATION_ASYNC_RESPONSE)
+    {
+        async = notification->data;
+        return sizeof(rest_notification_async_t) + (async->payload ? async->payload_length : 0)
+               + (async->values ? strlen(async->values) : 0);
+    }
+
+    name = rest_notification_name(notification);
+
+    return name != NULL ? strlen(name) : 0;
+}
+
+void rest_notification_encode(const rest_notification_t *notification, uint8_t *buffer)
+{
+    const rest_async_response_t *async;
+    rest_notification_async_t header;
+    const char *name;
+
+    if (notification->type == REST_NOTIFICATION_ASYNC_RESPONSE)
+    {
+        async = notification->data;
+
+        memset(&header, 0, sizeof(header));
+        header.timestamp = async->timestamp;
+        header.status = async->status;
+        header.flags = (async->payload != NULL ? REST_NOTIFICATION_HAS_PAYLOAD : 0)
+                       | (async->values != NULL ? REST_NOTIFICATION_HAS_VALUES : 0);
+        header.payload_length = async->payload != NULL ? async->payload_length : 0;
+        header.values_length = async->values != NULL ? strlen(async->values) : 0;
+        memcpy(header.id, async->id, sizeof(header.id));
+
+        memcpy(buffer, &header, sizeof(header));
+        if (async->payload != NULL)
+        {
+            memcpy(buffer + sizeof(header), async->payload, header.payload_length);
+        }
+        if (async->values != NULL)
+        {
+            memcpy(buffer + sizeof(header) + header.payload_length, async->values,
+                   header.values_length);
+        }
+
+        return;
+    }
+
+    name = rest_notification_name(notification);
+    if (name != NULL)
+    {
+        memcpy(buffer, name, strlen(name));
+    }
+}
+
+void *rest_notification_decode(rest_notification_type_t type, const uint8_t *buffer,
+                               size_t size)
+{
+    rest_async_response_t *async;
+    rest_notification_async_t header;
+    rest_notif_registration_t *named;
+    uint8_t *payload;
+
+    switch (type)
+    {
+    case REST_NOTIFICATION_REGISTRATION:
+        named = rest_notif_registration_new();
+        break;
+    case REST_NOTIFICATION_UPDATE:
+        named = (rest_notif_registration_t *)rest_notif_update_new();
+        break;
+    case REST_NOTIFICATION_DEREGISTRATION:
+        named = (rest_notif_registration_t *)rest_notif_deregistration_new();
+        break;
+    case REST_NOTIFICATION_ASYNC_RESPONSE:
+        if (size < sizeof(header))
+        {
+            return NULL;
+        }
+        memcpy(&header, buffer, sizeof(header));
+        if (header.payload_length > size - sizeof(header)
+            || header.values_length > size - sizeof(header) - header.payload_length)
+        {
+            return NULL;
+        }
+
+        async = calloc(1, sizeof(rest_async_response_t));
+        if (async == NULL)
+        {
+            return NULL;
+        }
+
+        async->timestamp = header.timestamp;
+        async->status = header.status;
+        memcpy(async->id, header.id, sizeof(async->id));
+        async->id[sizeof(async->id) - 1] = '\0';
+        if (header.flags & REST_NOTIFICATION_HAS_PAYLOAD)
+        {
+            payload = malloc(header.payload_length > 0 ? header.payload_length : 1);
+            if (payload == NULL)
+            {
+                free(async);
+                return NULL;
+            }
+            memcpy(payload, buffer + sizeof(header), header.payload_length);
+            async->payload = payload;
+            async->payload_length = header.payload_length;
+        }
+        if (header.flags & REST_NOTIFICATION_HAS_VALUES)
+        {
+            async->values = strndup((const char *)buffer + sizeof(header) + header.payload_length,
+                                    header.values_length);
+        }
+
+        return async;
+    default:
+        return NULL;
+    }
+
+    if (named != NULL)
+    {
+        named->name = strndup((const char *)buffer, size);
+    }
+
+    return named;
+}
+
+static rest_notification_t *rest_notification_log_slot(const rest_notification_log_t *log,
+                                                       uint64_t seq)
+{
+    return &log->ring[seq & (log->capacity - 1)];
+}
+
+static void rest_notification_log_update_metrics(const rest_notification_log_t *log)
+{
+    metrics_set(&metric_memory_bytes, log->memory);
+    metrics_set(&metric_memory_records, log->memory_count);
+    metrics_set(&metric_spilled_bytes, log->spill_end - log->spill_start);
+    metrics_set(&metric_spilled_records, log->spill_count);
+}
+
+/*
+ * Gives back overflow file space of the oldest spilled notification. Space
+ * before it belongs to already released notifications, so the hole is
+ * extended back to the block boundary.
+ */
+static void rest_notification_log_unspill(rest_notification_log_t *log,
+                                          rest_notification_t *notification)
+{
+    off_t start = notification->spill_offset & ~(off_t)(REST_NOTIFICATION_SPILL_BLOCK - 1);
+
+    log->spill_count--;
+    log->spill_start = notification->spill_offset + notification->size;
+    log->memory -= REST_NOTIFICATION_SPILLED_OVERHEAD;
+
+    if (log->spill_count == 0)
+    {
+        // Whole overflow file is unused
+        if (ftruncate(log->spill_fd, 0) != 0)
+        {
+            log_message(LOG_LEVEL_WARN, "[NOTIFY] Failed to truncate overflow file: %s\n",
+                        strerror(errno));
+        }
+        log->spill_start = 0;
+        log->spill_end = 0;
+    }
+    else if (fallocate(log->spill_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start,
+                       log->spill_start - start) != 0
+             && errno != EOPNOTSUPP)
+    {
+        log_message(LOG_LEVEL_WARN, "[NOTIFY] Failed to release overflow file space: %s\n",
+                    strerror(errno));
+    }
+}
+
+/*
+ * Releases notification (resident, spilled or dropped), the slot itself is
+ * left as a dropped placeholder. Spilled notifications must be released in
+ * sequence order.
+ */
+static void rest_notification_log_release(rest_notification_log_t *log,
+                                          rest_notification_t *notification)
+{
+    if (notification->spilled)
+    {
+        rest_notification_log_unspill(log, notification);
+    }
+    else if (notification->data != NULL)
+    {
+        log->memory -= notification->size + REST_NOTIFICATION_OVERHEAD;
+        log->memory_count--;
+        rest_notification_data_free(notification->type, notification->data);
+    }
+
+    notification->data = NULL;
+    notification->spilled = false;
+}
+
+static int rest_notification_log_spill(rest_notification_log_t *log,
+                                       rest_notification_t *notification)
+{
+    uint8_t *buffer;
+    ssize_t written;
+
+    if (log->spill_fd < 0 || notification->data == NULL
+        || (size_t)(log->spill_end - log->spill_start) + notification->size > log->spill_limit)
+    {
+        return -1;
+    }
+
+    buffer = malloc(notification->size > 0 ? notification->size : 1);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    rest_notification_encode(notification, buffer);
+    written = pwrite(log->spill_fd, buffer, notification->size, log->spill_end);
+    free(buffer);
+
+    if (written != (ssize_t)notification->size)
+    {
+        log_message(LOG_LEVEL_ERROR, "[NOTIFY] Failed to spill notification: %s\n",
+                    written < 0 ? strerror(errno) : "short write");
+        return -1;
+    }
+
+    log->memory -= notification->size + REST_NOTIFICATION_OVERHEAD;
+    log->memory += REST_NOTIFICATION_SPILLED_OVERHEAD;
+    log->memory_count--;
+    rest_notification_data_free(notification->type, notification->data);
+
+    notification->data = NULL;
+    notification->spilled = true;
+    notification->spill_offset = log->spill_end;
+
+    log->spill_end += notification->size;
+    log->spill_count++;
+
+    metrics_add(&metric_spilled_total, 1);
+
+    return 0;
+}
+
+static bool rest_notification_log_over_budget(const rest_notification_log_t *log)
+{
+    return log->memory > log->memory_limit || log->memory_count > log->count_limit;
+}
+
+static void rest_notification_log_enforce(rest_notification_log_t *log)
+{
+    while (rest_notification_log_over_budget(log))
+    {
+        // History of already drained notifications goes first
+        if (log->first < log->drained)
+        {
+            rest_notification_log_release(log, rest_notification_log_slot(log, log->first));
+            log->first++;
+            continue;
+        }
+
+        if (log->policy == REST_NOTIFICATION_POLICY_REJECT)
+        {
+            break;
+        }
+
+        // The newest notification always stays in memory
+        if (log->policy == REST_NOTIFICATION_POLICY_SPILL && log->resident + 1 < log->next
+            && rest_notification_log_spill(log, rest_notification_log_slot(log, log->resident))
+               == 0)
+        {
+            log->resident++;
+            continue;
+        }
+
+        // Drop-oldest policy, also the fallback if spilling fails or spill limit is reached
+        if (log->first + 1 >= log->next)
+        {
+            break;
+        }
+
+        rest_notification_log_release(log, rest_notification_log_slot(log, log->first));
+        metrics_add(&metric_dropped, 1);
+
+        log->first++;
+        log->drained++;
+        if (log->resident < log->first)
+        {
+            log->resident = log->first;
+        }
+    }
+}
+
+static int rest_notification_log_grow(rest_notification_log_t *log)
+{
+    rest_notification_t *ring;
+    size_t capacity = log->capacity * 2;
+    uint64_t seq;
+
+    ring = malloc(capacity * sizeof(rest_notification_t));
+    if (ring == NULL)
+    {
+        return -1;
+    }
+
+    for (seq = log->first; seq < log->next; seq++)
+    {
+        ring[seq & (capacity - 1)] = *rest_notification_log_slot(log, seq);
+    }
+
+    free(log->ring);
+    log->ring = ring;
+    log->capacity = capacity;
+
+    return 0;
+}
+
+rest_notification_log_t *rest_notification_log_new(void)
+{
+    rest_notification_log_t *log;
+
+    log = calloc(1, sizeof(rest_notification_log_t));
+    if (log == NULL)
+    {
+        return NULL;
+    }
+
+    log->capacity = REST_NOTIFICATION_LOG_INITIAL_CAPACITY;
+    log->ring = malloc(log->capacity * sizeof(rest_notification_t));
+    if (log->ring == NULL)
+    {
+        free(log);
+        return NULL;
+    }
+
+    log->first = 1;
+    log->drained = 1;
+    log->next = 1;
+    log->resident = 1;
+    log->memory_limit = REST_NOTIFICATION_LOG_MEMORY_LIMIT;
+    log->count_limit = REST_NOTIFICATION_LOG_COUNT_LIMIT;
+    log->policy = REST_NOTIFICATION_POLICY_DROP_OLDEST;
+    log->spill_fd = -1;
+    log->spill_limit = REST_NOTIFICATION_LOG_SPILL_LIMIT;
+
+    metrics_register(&metric_memory_bytes);
+    metrics_register(&metric_memory_records);
+    metrics_register(&metric_spilled_bytes);
+    metrics_register(&metric_spilled_records);
+    metrics_register(&metric_spilled_total);
+    metrics_register(&metric_dropped);
+    metrics_register(&metric_rejected);
+
+    return log;
+}
+
+void rest_notification_log_delete(rest_notification_log_t *log)
+{
+    for (; log->first < log->next; log->first++)
+    {
+        rest_notification_log_release(log, rest_notification_log_slot(log, log->first));
+    }
+
+    if (log->spill_fd >= 0)
+    {
+        close(log->spill_fd);
+    }
+
+    rest_notification_log_update_metrics(log);
+
+    free(log->ring);
+    free(log);
+}
+
+int rest_notification_log_set_limits(rest_notification_log_t *log, size_t memory_limit,
+                                     size_t count_limit, rest_notification_policy_t policy,
+                                     const char *spill_directory, size_t spill_limit)
+{
+    log->memory_limit = memory_limit;
+    log->count_limit = count_limit;
+    log->policy = policy;
+    log->spill_limit = spill_limit;
+
+    if (policy == REST_NOTIFICATION_POLICY_SPILL && log->spill_fd < 0)
+    {
+        // Anonymous file, disappears together with the process
+        log->spill_fd = open(spill_directory, O_TMPFILE | O_RDWR | O_EXCL, 0600);
+        if (log->spill_fd < 0)
+        {
+            log_message(LOG_LEVEL_ERROR, "[NOTIFY] Failed to create overflow file in %s: %s\n",
+                        spill_directory, strerror(errno));
+            return -1;
+        }
+    }
+
+    rest_notification_log_enforce(log);
+    rest_notification_log_update_metrics(log);
+
+    return 0;
+}
+
+uint64_t rest_notification_log_append(rest_notification_log_t *log,
+                                      rest_notification_type_t type, void *data)
+{
+    rest_notification_t *notification;
+
+    if (log->next - log->first == log->capacity)
+    {
+        if (log->first < log->drained)
+        {
+            // Oldest history record gives its slot away
+            rest_notification_log_release(log, rest_notification_log_slot(log, log->first));
+            log->first++;
+        }
+        else if (rest_notification_log_grow(log) != 0)
+        {
+            rest_notification_data_free(type, data);
+            return 0;
+        }
+    }
+
+    notification = rest_notification_log_slot(log, log->next);
+    notification->seq = log->next;
+    notification->type = type;
+    notification->data = data;
+    notification->spilled = false;
+    notification->size = rest_notification_encoded_size(notification);
+
+    log->memory += notification->size + REST_NOTIFICATION_OVERHEAD;
+    log->memory_count++;
+    log->next++;
+
+    rest_notification_log_enforce(log);
+    rest_notification_log_update_metrics(log);
+
+    return notification->seq;
+}
+
+bool rest_notification_log_admit(const rest_notification_log_t *log)
+{
+    if (log->policy == REST_NOTIFICATION_POLICY_REJECT && rest_notification_log_over_budget(log))
+    {
+        metrics_add(&metric_rejected, 1);
+        return false;
+    }
+
+    return true;
+}
+
+const rest_notification_t *rest_notification_log_get(const rest_notification_log_t *log,
+                                                     uint64_t seq)
+{
+    if (seq < log->first || seq >= log->next)
+    {
+        return NULL;
+    }
+
+    return rest_notification_log_slot(log, seq);
+}
+
+int rest_notification_log_read(const rest_notification_log_t *log, uint64_t seq,
+                               rest_notification_t *notification)
+{
+    const rest_notification_t *retained;
+    uint8_t *buffer;
+
+    retained = rest_notification_log_get(log, seq);
+    if (retained == NULL || (retained->data == NULL && !retained->spilled))
+    {
+        return -1;
+    }
+
+    *notification = *retained;
+    if (!retained->spilled)
+    {
+        return 0;
+    }
+
+    buffer = malloc(retained->size > 0 ? retained->size : 1);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    if (pread(log->spill_fd, buffer, retained->size, retained->spill_offset)
+        != (ssize_t)retained->size)
+    {
+        log_message(LOG_LEVEL_ERROR, "[NOTIFY] Failed to read spilled notification %" PRIu64 "\n",
+                    seq);
+        free(buffer);
+        return -1;
+    }
+
+    notification->data = rest_notification_decode(retained->type, buffer, retained->size);
+    free(buffer);
+
+    return notification->data != NULL ? 0 : -1;
+}
+
+void rest_notification_log_put(rest_notification_t *notification)
+{
+    // Only copies loaded from the overflow file are owned by the reader
+    if (notification->spilled && notification->data != NULL)
+    {
+        rest_notification_data_free(notification->type, notification->data);
+        notification->data = NULL;
+    }
+}
+
+void rest_notification_log_reset(rest_notification_log_t *log, uint64_t next)
+{
+    if (log->first == log->next)
+    {
+        log->first = next;
+        log->drained = next;
+        log->next = next;
+        log->resident = next;
+    }
+}
+
+size_t rest_notification_log_pending(const rest_notification_log_t *log)
+{
+    return log->next - log->drained;
+}
+
+void rest_notification_log_drain(rest_notification_log_t *log)
+{
+    rest_notification_log_drain_to(log, log->next);
+}
+
+void rest_notification_log_drain_to(rest_notification_log_t *log, uint64_t end)
+{
+    if (end <= log->drained || end > log->next)
+    {
+        return;
+    }
+
+    log->drained = end;
+    if (log->resident < end)
+    {
+        log->resident = end;
+    }
+
+    rest_notification_log_enforce(log);
+    rest_notification_log_update_metrics(log);
+}
@@ -0,0 +1,251 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_NOTIFICATION_LOG_H
+#define REST_NOTIFICATION_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define REST_NOTIFICATION_LOG_INITIAL_CAPACITY 1024
+#define REST_NOTIFICATION_LOG_MEMORY_LIMIT (64 * 1024 * 1024)
+#define REST_NOTIFICATION_LOG_COUNT_LIMIT 100000
+#define REST_NOTIFICATION_LOG_SPILL_LIMIT (1024 * 1024 * 1024)
+
+
+typedef enum
+{
+    REST_NOTIFICATION_REGISTRATION,
+    REST_NOTIFICATION_UPDATE,
+    REST_NOTIFICATION_DEREGISTRATION,
+    REST_NOTIFICATION_ASYNC_RESPONSE,
+} rest_notification_type_t;
+
+/*
+ * What happens to pending notifications, once the in-memory budget is
+ * exhausted (already drained notifications are always released first).
+ */
+typedef enum
+{
+    REST_NOTIFICATION_POLICY_DROP_OLDEST,
+    REST_NOTIFICATION_POLICY_SPILL,
+    REST_NOTIFICATION_POLICY_REJECT,
+} rest_notification_policy_t;
+
+typedef struct
+{
+    uint64_t seq;
+    rest_notification_type_t type;
+    void *data;
+    size_t size;
+    bool spilled;
+    off_t spill_offset;
+} rest_notification_t;
+
+/*
+ * Ordered ring of notifications with monotonically increasing sequence
+ * numbers (starting from 1). Records which are not yet drained (delivered to
+ * the callback or returned by the draining pull) are kept, unless memory
+ * budget policy says otherwise, already drained ones are kept as history
+ * for cursor based consumers, until their slots or memory are needed.
+ * Pending records over the budget may be spilled to an unlinked overflow
+ * file, their ring slots still count against the memory budget. Records are
+ * spilled and released in sequence order, so the live part of the file is
+ * [spill_start, spill_end) and space before it is given back to the file
+ * system. The log is not thread-safe.
+ */
+typedef struct
+{
+    rest_notification_t *ring;
+    size_t capacity;
+    uint64_t first;
+    uint64_t drained;
+    uint64_t next;
+    uint64_t resident;
+    size_t memory;
+    size_t memory_count;
+    size_t memory_limit;
+    size_t count_limit;
+    rest_notification_policy_t policy;
+    int spill_fd;
+    off_t spill_start;
+    off_t spill_end;
+    size_t spill_count;
+    size_t spill_limit;
+} rest_notification_log_t;
+
+/**
+ * This function creates new notification log with default limits and
+ * drop-oldest policy.
+ *
+ * @return Pointer to a new log instance or NULL on error
+ */
+rest_notification_log_t *rest_notification_log_new(void);
+
+/**
+ * This function deletes notification log and all retained notifications.
+ *
+ * @param[in]  log  Pointer to the log which will be deleted
+ */
+void rest_notification_log_delete(rest_notification_log_t *log);
+
+/**
+ * Configures in-memory budget of retained notifications.
+ *
+ * @param[in]  log              Pointer to the log
+ * @param[in]  memory_limit     Approximate memory limit in bytes
+ * @param[in]  count_limit      Limit of notifications kept in memory
+ * @param[in]  policy           Policy applied to pending notifications over the limits
+ * @param[in]  spill_directory  Directory of overflow file (used by spill policy)
+ * @param[in]  spill_limit      Limit of spilled notification bytes, the oldest pending
+ *                              notifications are dropped once it is reached
+ *
+ * @return 0 on success, -1 if overflow file can not be created
+ */
+int rest_notification_log_set_limits(rest_notification_log_t *log, size_t memory_limit,
+                                     size_t count_limit, rest_notification_policy_t policy,
+                                     const char *spill_directory, size_t spill_limit);
+
+/**
+ * Appends notification to the log, log takes ownership of the data (which is
+ * freed if it can not be stored). The newest notification is always kept in
+ * memory, older ones may be released or spilled according to the policy.
+ *
+ * @param[in]  log   Pointer to the log
+ * @param[in]  type  Notification type
+ * @param[in]  data  Notification of the corresponding rest_notif_*_t type
+ *
+ * @return Sequence number of the notification or 0 on allocation error
+ */
+uint64_t rest_notification_log_append(rest_notification_log_t *log,
+                                      rest_notification_type_t type, void *data);
+
+/**
+ * Checks whether optional notifications (e.g. observations) are accepted,
+ * refusals are counted by notifications.rejected metric.
+ *
+ * @param[in]  log  Pointer to the log
+ *
+ * @return false if reject policy is configured and memory budget is exhausted
+ */
+bool rest_notification_log_admit(const rest_notification_log_t *log);
+
+/**
+ * Finds retained notification. Data of a spilled notification is NULL, use
+ * rest_notification_log_read() to access it.
+ *
+ * @param[in]  log  Pointer to the log
+ * @param[in]  seq  Sequence number
+ *
+ * @return Notification or NULL if it is not (or no longer) retained
+ */
+const rest_notification_t *rest_notification_log_get(const rest_notification_log_t *log,
+                                                     uint64_t seq);
+
+/**
+ * Reads retained notification, loading it from overflow file if needed.
+ *
+ * @param[in]  log           Pointer to the log
+ * @param[in]  seq           Sequence number
+ * @param[out] notification  Notification copy, release with rest_notification_log_put()
+ *
+ * @return 0 on success, -1 if notification is not retained or can not be read
+ */
+int rest_notification_log_read(const rest_notification_log_t *log, uint64_t seq,
+                               rest_notification_t *notification);
+
+/**
+ * Releases notification copy obtained with rest_notification_log_read().
+ *
+ * @param[in]  notification  Notification copy
+ */
+void rest_notification_log_put(rest_notification_t *notification);
+
+/**
+ * Restarts sequence numbering of an empty log.
+ *
+ * @param[in]  log   Pointer to the log
+ * @param[in]  next  Sequence number of the next notification
+ */
+void rest_notification_log_reset(rest_notification_log_t *log, uint64_t next);
+
+/**
+ * Returns number of notifications, which are not drained yet.
+ *
+ * @param[in]  log  Pointer to the log
+ *
+ * @return Number of pending notifications
+ */
+size_t rest_notification_log_pending(const rest_notification_log_t *log);
+
+/**
+ * Marks all notifications as drained, their memory may be reused.
+ *
+ * @param[in]  log  Pointer to the log
+ */
+void rest_notification_log_drain(rest_notification_log_t *log);
+
+/**
+ * Marks notifications before the given sequence number as drained.
+ *
+ * @param[in]  log  Pointer to the log
+ * @param[in]  end  Sequence number of the first notification, which stays pending
+ */
+void rest_notification_log_drain_to(rest_notification_log_t *log, uint64_t end);
+
+/**
+ * Returns size of serialized notification.
+ *
+ * @param[in]  notification  Notification (with data)
+ *
+ * @return Size in bytes
+ */
+size_t rest_notification_encoded_size(const rest_notification_t *notification);
+
+/**
+ * Serializes notification data.
+ *
+ * @param[in]  notification  Notification (with data)
+ * @param[out] buffer        Buffer of rest_notification_encoded_size() bytes
+ */
+void rest_notification_encode(const rest_notification_t *notification, uint8_t *buffer);
+
+/**
+ * Deserializes notification data.
+ *
+ * @param[in]  type    Notification type
+ * @param[in]  buffer  Serialized data
+ * @param[in]  size    Size of serialized data
+ *
+ * @return Notification of the corresponding rest_notif_*_t type or NULL on error
+ */
+void *rest_notification_decode(rest_notification_type_t type, const uint8_t *buffer,
+                               size_t size);
+
+/**
+ * Frees notification data.
+ *
+ * @param[in]  type  Notification type
+ * @param[in]  data  Notification of the corresponding rest_notif_*_t type
+ */
+void rest_notification_data_free(rest_notification_type_t type, void *data);
+
+#endif // REST_NOTIFICATION_LOG_H
@@ -17,40 +17,82 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_CALLBACK
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "logging.h"
+#include "metrics.h"
 #include "restserver.h"
 
+// Approximate JSON size of keys and punctuation of a single notification
+#define REST_NOTIFICATIONS_JSON_OVERHEAD 64
+
+static const char *rest_notification_types[] =
+{
+    [REST_NOTIFICATION_REGISTRATION] = "registration",
+    [REST_NOTIFICATION_UPDATE] = "reg-update",
+    [REST_NOTIFICATION_DEREGISTRATION] = "de-registration",
+    [REST_NOTIFICATION_ASYNC_RESPONSE] = "async-response",
+};
+
 bool valid_callback_url(const char *url)
 {
     // TODO: implement
     return true;
 }
 
-bool validate_callback(json_t *jcallback)
+/*
+ * Empty batch in either encoding, sent to check that the callback is reachable
+ */
+static const char rest_notifications_probe_json[] =
+    "{\"registrations\":[],\"reg-updates\":[],"
+    "\"async-responses\":[],\"de-registrations\":[]}";
+static const uint8_t rest_notifications_probe_cbor[] =
 {
-    json_t *url, *jheaders;
+    0xa4,
+    0x6d, 'r', 'e', 'g', 'i', 's', 't', 'r', 'a', 't', 'i', 'o', 'n', 's', 0x80,
+    0x6b, 'r', 'e', 'g', '-', 'u', 'p', 'd', 'a', 't', 'e', 's', 0x80,
+    0x6f, 'a', 's', 'y', 'n', 'c', '-', 'r', 'e', 's', 'p', 'o', 'n', 's', 'e', 's', 0x80,
+    0x70, 'd', 'e', '-', 'r', 'e', 'g', 'i', 's', 't', 'r', 'a', 't', 'i', 'o', 'n', 's', 0x80,
+};
+
+bool validate_callback(rest_delivery_t *delivery, json_t *jcallback)
+{
+    json_t *url, *jheaders, *jdecode, *jaccept, *jencoding;
+    rest_decode_t decode;
     const char *header;
     json_t *value;
+    long status;
     int res;
-    const char *callback_url;
-    ulfius_req_t test_request;
-    ulfius_resp_t test_response;
-    struct _u_map headers;
-    bool validation_state = true;
-    json_t *jbody = json_pack("{s:[], s:[], s:[], s:[]}",
-                              "registrations", "reg-updates",
-                              "async-responses", "de-registrations");
-
 
     if (jcallback == NULL)
     {
         return false;
     }
 
-    // Must be an object with "url" and "headers"
-    if (!json_is_object(jcallback) || json_object_size(jcallback) != 2)
+    // Must be an object with "url", "headers" and optional "decode", "accept" and "encoding"
+    if (!json_is_object(jcallback) || json_object_size(jcallback) < 2)
+    {
+        return false;
+    }
+
+    jdecode = json_object_get(jcallback, "decode");
+    jaccept = json_object_get(jcallback, "accept");
+    jencoding = json_object_get(jcallback, "encoding");
+    if (json_object_size(jcallback)
+        != 2 + (size_t)(jdecode != NULL) + (jaccept != NULL) + (jencoding != NULL)
+        || (jencoding != NULL && (!json_is_string(jencoding)
+                                  || strcmp(json_string_value(jencoding), "gzip") != 0))
+        || (jdecode != NULL && (!json_is_string(jdecode)
+                                || rest_decode_parse(json_string_value(jdecode), &decode) != 0))
+        || (jaccept != NULL && (!json_is_string(jaccept)
+                                || (strcmp(json_string_value(jaccept), "application/json") != 0
+                                    && strcmp(json_string_value(jaccept),
+                                              REST_CONTENT_TYPE_CBOR) != 0))))
     {
         return false;
     }
@@ -69,45 +111,39 @@ bool validate_callback(json_t *jcallback)
         return false;
     }
 
-    u_map_init(&headers);
     // ... which contains string key-value pairs
     json_object_foreach(jheaders, header, value)
     {
         if (!json_is_string(value))
         {
-            u_map_clean(&headers);
-
             return false;
         }
-
-        u_map_put(&headers, header, json_string_value(value));
     }
 
-    callback_url = json_string_value(url);
-
-    ulfius_init_request(&test_request);
-    test_request.http_verb = strdup("PUT");
-    test_request.http_url = strdup(callback_url);
-    test_request.timeout = 20;
-    u_map_copy_into(test_request.map_header, &headers);
-    ulfius_set_json_body_request(&test_request, jbody);
-    json_decref(jbody);
-
-    ulfius_init_response(&test_response);
-    res = ulfius_send_http_request(&test_request, &test_response);
+    // Probe goes through the connection pool, so the first batch reuses its connection
+    if (jaccept != NULL && strcmp(json_string_value(jaccept), REST_CONTENT_TYPE_CBOR) == 0)
+    {
+        res = rest_delivery_send_now(delivery, jcallback, REST_CONTENT_TYPE_CBOR,
+                                     rest_notifications_probe_cbor,
+                                     sizeof(rest_notifications_probe_cbor), &status);
+    }
+    else
+    {
+        res = rest_delivery_send_now(delivery, jcallback, REST_CONTENT_TYPE_JSON,
+                                     (const uint8_t *)rest_notifications_probe_json,
+                                     strlen(rest_notifications_probe_json), &status);
+    }
 
-    if (res != U_OK)
+    // Receiver is reachable even if it does not accept the probe
+    if (res != 0 && status == 0)
     {
-        log_message(LOG_LEVEL_WARN, "Callback \"%s\" is not reachable.\n", callback_url);
+        log_message(LOG_LEVEL_WARN, "Callback \"%s\" is not reachable.\n",
+                    json_string_value(url));
 
-        validation_state = false;
+        return false;
     }
 
-    u_map_clean(&headers);
-    ulfius_clean_response(&test_response);
-    ulfius_clean_request(&test_request);
-
-    return validation_state;
+    return true;
 }
 
 int rest_notifications_get_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
@@ -123,7 +159,7 @@ int rest_notifications_get_callback_cb(const ulfius_req_t *req, ulfius_resp_t *r
     }
     else
     {
-        ulfius_set_json_body_response(resp, 200, rest->callback);
+        rest_set_body_response(req, resp, 200, rest->callback);
     }
 
     rest_unlock(rest);
@@ -138,6 +174,7 @@ int rest_notifications_put_callback_cb(const ulfius_req_t *req, ulfius_resp_t *r
     const char *ct;
     const char *callback_url;
     json_t *jcallback;
+    rest_decode_t decode = REST_DECODE_NONE;
 
     ct = u_map_get_case(req->map_header, "Content-Type");
     if (ct == NULL || strcmp(ct, "application/json") != 0)
@@ -147,7 +184,7 @@ int rest_notifications_put_callback_cb(const ulfius_req_t *req, ulfius_resp_t *r
     }
 
     jcallback = json_loadb(req->binary_body, req->binary_body_length, 0, NULL);
-    if (!validate_callback(jcallback))
+    if (!validate_callback(rest->delivery, jcallback))
     {
         if (jcallback != NULL)
         {
@@ -171,10 +208,21 @@ int rest_notifications_put_callback_cb(const ulfius_req_t *req, ulfius_resp_t *r
 
     rest->callback = jcallback;
 
+    if (json_object_get(jcallback, "decode") != NULL)
+    {
+        rest_decode_parse(json_string_value(json_object_get(jcallback, "decode")), &decode);
+    }
+    __atomic_store_n(&rest->callbackDecode, decode, __ATOMIC_RELAXED);
+    rest->callbackCbor = json_object_get(jcallback, "accept") != NULL
+                         && strcmp(json_string_value(json_object_get(jcallback, "accept")),
+                                   REST_CONTENT_TYPE_CBOR) == 0;
+
     ulfius_set_empty_body_response(resp, 204);
 
     rest_unlock(rest);
 
+    rest_wakeup(rest);
+
     return U_CALLBACK_COMPLETE;
 }
 
@@ -192,6 +240,8 @@ int rest_notifications_delete_callback_cb(const ulfius_req_t *req, ulfius_resp_t
 
         json_decref(rest->callback);
         rest->callback = NULL;
+        __atomic_store_n(&rest->callbackDecode, REST_DECODE_NONE, __ATOMIC_RELAXED);
+        rest->callbackCbor = false;
 
         ulfius_set_empty_body_response(resp, 204);
     }
@@ -207,175 +257,1140 @@ int rest_notifications_delete_callback_cb(const ulfius_req_t *req, ulfius_resp_t
     return U_CALLBACK_COMPLETE;
 }
 
+static bool rest_notifications_callback_name_valid(const char *name)
+{
+    size_t length;
+
+    if (name == NULL)
+    {
+        return false;
+    }
+
+    length = strspn(name, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.");
+
+    return length > 0 && length < REST_CALLBACK_NAME_LENGTH && name[length] == '\0';
+}
+
+static rest_callback_t **rest_notifications_find_callback(rest_context_t *rest, const char *name)
+{
+    rest_callback_t **callback;
+
+    for (callback = &rest->callbacks; *callback != NULL; callback = &(*callback)->next)
+    {
+        if (strcmp((*callback)->name, name) == 0)
+        {
+            break;
+        }
+    }
+
+    return callback;
+}
+
+int rest_notifications_get_callbacks_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                        void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    rest_callback_t *callback;
+    json_t *jcallbacks;
+
+    jcallbacks = json_object();
+    if (jcallbacks == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 500);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    rest_lock(rest);
+    for (callback = rest->callbacks; callback != NULL; callback = callback->next)
+    {
+        json_object_set(jcallbacks, callback->name, callback->jcallback);
+    }
+    rest_unlock(rest);
+
+    rest_set_body_response(req, resp, 200, jcallbacks);
+    json_decref(jcallbacks);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_notifications_get_named_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                             void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    const char *name = u_map_get(req->map_url, "name");
+    rest_callback_t *callback;
+
+    rest_lock(rest);
+
+    callback = *rest_notifications_find_callback(rest, name);
+    if (callback == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 404);
+    }
+    else
+    {
+        rest_set_body_response(req, resp, 200, callback->jcallback);
+    }
+
+    rest_unlock(rest);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_notifications_put_named_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                             void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    const char *name = u_map_get(req->map_url, "name");
+    rest_callback_filter_t filter;
+    rest_callback_t *callback;
+    json_t *jcallback, *jfilter;
+    const char *ct;
+    int res;
+
+    ct = u_map_get_case(req->map_header, "Content-Type");
+    if (ct == NULL || strcmp(ct, "application/json") != 0)
+    {
+        ulfius_set_empty_body_response(resp, 415);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    jcallback = json_loadb(req->binary_body, req->binary_body_length, 0, NULL);
+    if (!rest_notifications_callback_name_valid(name) || !json_is_object(jcallback))
+    {
+        json_decref(jcallback);
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    // Filter is validated on its own, the rest is the same as the default callback
+    jfilter = json_incref(json_object_get(jcallback, "filter"));
+    json_object_del(jcallback, "filter");
+
+    // Payloads are decoded once per request, so "decode" can only be set for the default callback
+    if (json_object_get(jcallback, "decode") != NULL
+        || rest_callback_filter_parse(&filter, jfilter) != 0)
+    {
+        json_decref(jfilter);
+        json_decref(jcallback);
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    if (!validate_callback(rest->delivery, jcallback))
+    {
+        rest_callback_filter_cleanup(&filter);
+        json_decref(jfilter);
+        json_decref(jcallback);
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    if (jfilter != NULL)
+    {
+        json_object_set_new(jcallback, "filter", jfilter);
+    }
+
+    rest_lock(rest);
+
+    callback = *rest_notifications_find_callback(rest, name);
+    if (callback != NULL)
+    {
+        // Events collected so far are sent with the previous settings
+        rest_callback_flush(callback);
+        res = 204;
+    }
+    else if (rest->callbackCount >= REST_CALLBACKS_MAX)
+    {
+        res = 400;
+    }
+    else
+    {
+        callback = rest_callback_new(name);
+        if (callback != NULL)
+        {
+            rest_delivery_set_queue_limit(callback->delivery, rest->callbackQueueLimit);
+            callback->next = rest->callbacks;
+            rest->callbacks = callback;
+            rest->callbackCount++;
+        }
+        res = callback != NULL ? 201 : 500;
+    }
+
+    if (callback != NULL)
+    {
+        log_message(LOG_LEVEL_INFO, "[SET-CALLBACK] name=%s url=%s\n", name,
+                    json_string_value(json_object_get(jcallback, "url")));
+
+        rest_callback_set(callback, jcallback, &filter);
+        jcallback = NULL;
+    }
+
+    rest_unlock(rest);
+
+    if (jcallback != NULL)
+    {
+        rest_callback_filter_cleanup(&filter);
+        json_decref(jcallback);
+    }
+
+    ulfius_set_empty_body_response(resp, res);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_notifications_delete_named_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                                void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    const char *name = u_map_get(req->map_url, "name");
+    rest_callback_t **link, *callback;
+
+    rest_lock(rest);
+
+    link = rest_notifications_find_callback(rest, name);
+    callback = *link;
+    if (callback != NULL)
+    {
+        *link = callback->next;
+        rest->callbackCount--;
+    }
+
+    rest_unlock(rest);
+
+    if (callback == NULL)
+    {
+        log_message(LOG_LEVEL_WARN, "[DELETE-CALLBACK] No callback named %s\n", name);
+
+        ulfius_set_empty_body_response(resp, 404);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    log_message(LOG_LEVEL_INFO, "[DELETE-CALLBACK] name=%s url=%s\n", name,
+                json_string_value(json_object_get(callback->jcallback, "url")));
+
+    // Joins the delivery thread, which may be in the middle of a request
+    rest_callback_delete(callback);
+
+    ulfius_set_empty_body_response(resp, 204);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_notifications_get_dead_letters_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                           void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    json_t *jdead;
+
+    jdead = rest_delivery_dead_letters_json(rest->delivery);
+    if (jdead == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 500);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    rest_set_body_response(req, resp, 200, jdead);
+    json_decref(jdead);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_notifications_replay_dead_letters_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                              void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    json_t *jreplayed;
+    size_t count;
+
+    count = rest_delivery_replay_dead_letters(rest->delivery);
+    log_message(LOG_LEVEL_INFO, "[DEAD-LETTERS] Replaying %zu batches\n", count);
+
+    jreplayed = json_pack("{s:I}", "replayed", (json_int_t)count);
+    if (jreplayed == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 500);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    rest_set_body_response(req, resp, 200, jreplayed);
+    json_decref(jreplayed);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+int rest_notifications_delete_dead_letters_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                              void *context)
+{
+    rest_context_t *rest = (rest_context_t *)context;
+    size_t count;
+
+    count = rest_delivery_clear_dead_letters(rest->delivery);
+    log_message(LOG_LEVEL_INFO, "[DEAD-LETTERS] Discarded %zu batches\n", count);
+
+    ulfius_set_empty_body_response(resp, 204);
+
+    return U_CALLBACK_COMPLETE;
+}
+
+static int rest_notifications_parse_uint(const char *string, uint64_t *value)
+{
+    char *end;
+
+    if (string == NULL || *string < '0' || *string > '9')
+    {
+        return -1;
+    }
+
+    errno = 0;
+    *value = strtoull(string, &end, 10);
+    if (errno != 0 || *end != '\0')
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void rest_notifications_page_json(rest_context_t *rest, uint64_t since, uint64_t limit,
+                                         rest_json_writer_t *writer)
+{
+    rest_notification_log_t *log = rest->notificationLog;
+    rest_notification_t notification;
+    uint64_t seq, cursor = since, count = 0;
+
+    // Consumer which fell behind the retained history continues from the oldest record
+    seq = since + 1 < log->first ? log->first : since + 1;
+
+    rest_json_object_start(writer);
+    rest_json_key(writer, "oldest");
+    rest_json_uint(writer, log->first);
+
+    rest_json_key(writer, "notifications");
+    rest_json_array_start(writer);
+    for (; seq < log->next && count < limit; seq++)
+    {
+        cursor = seq;
+
+        // Notifications dropped by memory budget policy are skipped
+        if (rest_notification_log_read(log, seq, &notification) != 0)
+        {
+            continue;
+        }
+        rest_notification_to_json(writer, &notification, true);
+        rest_notification_log_put(&notification);
+        count++;
+    }
+    rest_json_array_end(writer);
+
+    rest_json_key(writer, "cursor");
+    rest_json_uint(writer, cursor);
+    rest_json_object_end(writer);
+}
+
+static void rest_notifications_page_cbor(rest_context_t *rest, uint64_t since, uint64_t limit,
+                                         rest_cbor_t *cbor)
+{
+    rest_notification_log_t *log = rest->notificationLog;
+    rest_notification_t notification;
+    uint64_t seq, cursor = since, count = 0;
+
+    seq = since + 1 < log->first ? log->first : since + 1;
+
+    // Cursor is known only once the page is written, so it goes last
+    rest_cbor_map(cbor, 3);
+    rest_cbor_text(cbor, "oldest");
+    rest_cbor_uint(cbor, log->first);
+
+    rest_cbor_text(cbor, "notifications");
+    rest_cbor_array_start(cbor);
+    for (; seq < log->next && count < limit; seq++)
+    {
+        cursor = seq;
+
+        if (rest_notification_log_read(log, seq, &notification) != 0)
+        {
+            continue;
+        }
+        rest_notification_to_cbor(cbor, &notification, true);
+        rest_notification_log_put(&notification);
+        count++;
+    }
+    rest_cbor_break(cbor);
+
+    rest_cbor_text(cbor, "cursor");
+    rest_cbor_uint(cbor, cursor);
+}
+
 int rest_notifications_pull_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
 {
     rest_context_t *rest = (rest_context_t *)context;
+    const char *since_param = u_map_get(req->map_url, "since");
+    const char *limit_param = u_map_get(req->map_url, "limit");
+    uint64_t since, limit = REST_NOTIFICATIONS_PULL_LIMIT;
+    uint64_t ack, completed;
+    bool cbor = rest_accepts_cbor(req);
+    rest_cbor_t cbody;
+    rest_json_writer_t jbody;
+
+    rest_cbor_init(&cbody);
+    rest_json_writer_init(&jbody);
+
+    if (since_param == NULL)
+    {
+        // Draining pull, returns everything which was not yet delivered
+        rest_lock(rest);
+
+        if (cbor)
+        {
+            rest_notifications_cbor(rest, rest->notificationLog->next, &cbody);
+        }
+        else
+        {
+            rest_notifications_json(rest, rest->notificationLog->next, &jbody);
+        }
+
+        rest_notifications_clear(rest);
+
+        if (rest->journal != NULL)
+        {
+            // Batches queued for the callback are acknowledged once they are delivered
+            ack = rest->notificationLog->next - 1;
+            if (rest_delivery_pending(rest->delivery, &completed) && completed < ack)
+            {
+                ack = completed;
+            }
+            rest_journal_ack(rest->journal, ack);
+        }
 
+        rest_unlock(rest);
+
+        if (cbor)
+        {
+            rest_set_cbor_response(resp, 200, &cbody);
+            rest_cbor_cleanup(&cbody);
+        }
+        else
+        {
+            rest_set_json_writer_response(resp, 200, &jbody);
+            rest_json_writer_cleanup(&jbody);
+        }
+
+        return U_CALLBACK_COMPLETE;
+    }
+
+    if (rest_notifications_parse_uint(since_param, &since) != 0
+        || (limit_param != NULL
+            && (rest_notifications_parse_uint(limit_param, &limit) != 0
+                || limit == 0 || limit > REST_NOTIFICATIONS_PULL_LIMIT_MAX)))
+    {
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    // Cursor based pull, does not affect other consumers
     rest_lock(rest);
+    if (cbor)
+    {
+        rest_notifications_page_cbor(rest, since, limit, &cbody);
+    }
+    else
+    {
+        rest_notifications_page_json(rest, since, limit, &jbody);
+    }
+    rest_unlock(rest);
+
+    if (cbor)
+    {
+        rest_set_cbor_response(resp, 200, &cbody);
+        rest_cbor_cleanup(&cbody);
+    }
+    else
+    {
+        rest_set_json_writer_response(resp, 200, &jbody);
+        rest_json_writer_cleanup(&jbody);
+    }
+
+    return U_CALLBACK_COMPLETE;
+}
+
+/*
+ * Stream filter uses the callback filter syntax, passed as query parameters
+ * with comma separated "events".
+ */
+static int rest_notifications_stream_filter(const ulfius_req_t *req,
+                                            rest_callback_filter_t *filter)
+{
+    static const char *keys[] = {"endpoint", "endpoint_type", "path"};
+    const char *events = u_map_get(req->map_url, "events");
+    const char *value, *end;
+    json_t *jfilter, *jevents;
+    size_t i;
+    int result;
+
+    jfilter = json_object();
+    if (jfilter == NULL)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+    {
+        value = u_map_get(req->map_url, keys[i]);
+        if (value != NULL)
+        {
+            json_object_set_new(jfilter, keys[i], json_string(value));
+        }
+    }
+
+    if (events != NULL)
+    {
+        jevents = json_array();
+        json_object_set_new(jfilter, "events", jevents);
+        for (value = events; ; value = end + 1)
+        {
+            end = strchr(value, ',');
+            if (end == NULL)
+            {
+                json_array_append_new(jevents, json_string(value));
+                break;
+            }
+            json_array_append_new(jevents, json_stringn(value, end - value));
+        }
+    }
+
+    result = rest_callback_filter_parse(filter, jfilter);
+    json_decref(jfilter);
+
+    return result;
+}
+
+static ssize_t rest_notifications_stream_read_cb(void *context, uint64_t offset, char *buffer,
+                                                 size_t size)
+{
+    ssize_t length;
+
+    length = rest_stream_read((rest_stream_t *)context, buffer, size, REST_STREAM_KEEPALIVE);
+
+    return length < 0 ? U_STREAM_END : length;
+}
+
+static void rest_notifications_stream_free_cb(void *context)
+{
+    rest_stream_t *stream = (rest_stream_t *)context;
+    rest_context_t *rest = (rest_context_t *)stream->context;
+    rest_stream_t **entry;
+
+    rest_lock(rest);
+    for (entry = &rest->streams; *entry != NULL; entry = &(*entry)->next)
+    {
+        if (*entry == stream)
+        {
+            *entry = stream->next;
+            rest->streamCount--;
+            break;
+        }
+    }
+    rest_unlock(rest);
+
+    rest_stream_delete(stream);
+}
 
-    json_t *jbody = rest_notifications_json(rest);
+int rest_notifications_stream_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
+{
+    static const char connected[] = ":connected\n\n";
+    rest_context_t *rest = (rest_context_t *)context;
+    rest_callback_filter_t filter;
+    rest_stream_t *stream;
 
-    rest_notifications_clear(rest);
+    if (rest_notifications_stream_filter(req, &filter) != 0)
+    {
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    stream = rest_stream_new(rest->streamBufferSize, &filter, rest);
+    if (stream == NULL)
+    {
+        rest_callback_filter_cleanup(&filter);
+        ulfius_set_empty_body_response(resp, 500);
+        return U_CALLBACK_COMPLETE;
+    }
 
-    ulfius_set_json_body_response(resp, 200, jbody);
-    json_decref(jbody);
+    // Headers are sent together with the first chunk
+    rest_stream_push(stream, connected, sizeof(connected) - 1);
 
+    rest_lock(rest);
+    if (rest->streamCount >= REST_STREAMS_MAX)
+    {
+        rest_unlock(rest);
+        rest_stream_delete(stream);
+        ulfius_set_empty_body_response(resp, 503);
+        return U_CALLBACK_COMPLETE;
+    }
+    stream->next = rest->streams;
+    rest->streams = stream;
+    rest->streamCount++;
     rest_unlock(rest);
 
+    u_map_put(resp->map_header, "Content-Type", "text/event-stream");
+    u_map_put(resp->map_header, "Cache-Control", "no-cache");
+
+    if (ulfius_set_stream_response(resp, 200, rest_notifications_stream_read_cb,
+                                   rest_notifications_stream_free_cb, U_STREAM_SIZE_UNKOWN,
+                                   REST_STREAM_CHUNK_SIZE, stream) != U_OK)
+    {
+        rest_notifications_stream_free_cb(stream);
+        ulfius_set_empty_body_response(resp, 500);
+    }
+
     return U_CALLBACK_COMPLETE;
 }
 
-void rest_notify_registration(rest_context_t *rest, rest_notif_registration_t *reg)
+void rest_notifications_close_streams(rest_context_t *rest)
 {
-    rest_list_add(rest->registrationList, reg);
+    rest_stream_t *stream;
+
+    rest_lock(rest);
+    for (stream = rest->streams; stream != NULL; stream = stream->next)
+    {
+        rest_stream_close(stream);
+    }
+    rest_unlock(rest);
 }
 
-void rest_notify_update(rest_context_t *rest, rest_notif_update_t *update)
+/*
+ * Offers the new notification to the named callbacks, every filter is
+ * evaluated once and matching notifications are serialized right away.
+ */
+static void rest_notify_callbacks(rest_context_t *rest, const rest_notification_t *notification,
+                                  const rest_notification_source_t *source)
 {
-    rest_list_add(rest->updateList, update);
+    rest_callback_t *callback;
+    int64_t now;
+    bool full;
+
+    if (rest->callbacks == NULL)
+    {
+        return;
+    }
+
+    now = metrics_time_us();
+    for (callback = rest->callbacks; callback != NULL; callback = callback->next)
+    {
+        // Full batch waits while the delivery is busy, later events are dropped
+        full = callback->records >= rest->callbackBatchRecords
+               || callback->bytes >= rest->callbackBatchBytes;
+        if (full && !rest_delivery_busy(callback->delivery))
+        {
+            rest_callback_flush(callback);
+            full = false;
+        }
+
+        if (rest_callback_append(callback, notification, source, now, !full)
+            && (callback->records >= rest->callbackBatchRecords
+                || callback->bytes >= rest->callbackBatchBytes)
+            && !rest_delivery_busy(callback->delivery))
+        {
+            rest_callback_flush(callback);
+        }
+    }
 }
 
-void rest_notify_deregistration(rest_context_t *rest, rest_notif_deregistration_t *dereg)
+/*
+ * Every stream receives the same frame, so it is serialized at most once and
+ * only if some stream filter matches.
+ */
+static void rest_notify_streams(rest_context_t *rest, const rest_notification_t *notification,
+                                const rest_notification_source_t *source)
 {
-    rest_list_add(rest->deregistrationList, dereg);
+    rest_stream_t *stream;
+    rest_json_writer_t writer;
+    char header[64];
+    char *frame = NULL;
+    size_t length = 0;
+    int header_length;
+
+    for (stream = rest->streams; stream != NULL; stream = stream->next)
+    {
+        if (!rest_callback_filter_match(&stream->filter, notification->type, source))
+        {
+            continue;
+        }
+
+        if (frame == NULL)
+        {
+            // Compact JSON never spans several lines, so a single data field is enough
+            header_length = snprintf(header, sizeof(header),
+                                     "id: %" PRIu64 "\nevent: %s\ndata: ", notification->seq,
+                                     rest_notification_types[notification->type]);
+
+            rest_json_writer_init(&writer);
+            rest_notification_to_json(&writer, notification, true);
+            if (rest_json_writer_failed(&writer)
+                || (frame = malloc(header_length + writer.length + 2)) == NULL)
+            {
+                log_module_message(LOG_MODULE_NOTIFY, LOG_LEVEL_ERROR,
+                                   "[STREAM] Failed to serialize notification!\n");
+                rest_json_writer_cleanup(&writer);
+                return;
+            }
+
+            memcpy(frame, header, header_length);
+            memcpy(frame + header_length, writer.data, writer.length);
+            length = header_length + writer.length;
+            frame[length++] = '\n';
+            frame[length++] = '\n';
+            rest_json_writer_cleanup(&writer);
+        }
+
+        // Slow consumer is closed by the stream itself and unlinked by its connection
+        rest_stream_push(stream, frame, length);
+    }
+
+    free(frame);
 }
 
-void rest_notify_timeout(rest_context_t *rest, rest_notif_timeout_t *timeout)
+static void rest_notify_unsafe(rest_context_t *rest, rest_notification_type_t type, void *data,
+                               const rest_notification_source_t *source)
 {
-    rest_list_add(rest->timeoutList, timeout);
+    const rest_notification_t *notification;
+    uint64_t seq;
+
+    seq = rest_notification_log_append(rest->notificationLog, type, data);
+    if (seq == 0)
+    {
+        log_module_message(LOG_MODULE_NOTIFY, LOG_LEVEL_ERROR,
+                           "[NOTIFY] Failed to store notification!\n");
+        return;
+    }
+
+    if (rest->journal != NULL
+        && rest_journal_append(rest->journal,
+                               rest_notification_log_get(rest->notificationLog, seq)) != 0)
+    {
+        log_module_message(LOG_MODULE_NOTIFY, LOG_LEVEL_ERROR,
+                           "[NOTIFY] Failed to journal notification %" PRIu64 "!\n", seq);
+    }
+
+    notification = rest_notification_log_get(rest->notificationLog, seq);
+    rest_notify_callbacks(rest, notification, source);
+    rest_notify_streams(rest, notification, source);
+}
+
+static void rest_notify(rest_context_t *rest, rest_notification_type_t type, void *data,
+                        const rest_notification_source_t *source)
+{
+    rest_lock(rest);
+    rest_notify_unsafe(rest, type, data, source);
+    rest_unlock(rest);
 }
 
-void rest_notify_async_response(rest_context_t *rest, rest_notif_async_response_t *resp)
+static void rest_notifications_replay_cb(rest_notification_type_t type, void *data,
+                                         void *context)
 {
-    rest_list_add(rest->asyncResponseList, resp);
+    // Replayed notifications are journaled again under new sequence numbers
+    rest_notify_unsafe((rest_context_t *)context, type, data, NULL);
 }
 
-static json_t *rest_async_response_to_json(rest_async_response_t *async)
+static void rest_notifications_ack_cb(uint64_t seq, void *context)
 {
-    json_t *jasync = json_object();
+    rest_journal_ack((rest_journal_t *)context, seq);
+}
+
+int rest_notifications_journal_open(rest_context_t *rest, const char *directory,
+                                    size_t segment_size, int sync_interval)
+{
+    rest_journal_t *journal;
+    size_t replayed;
+
+    journal = rest_journal_open(directory, segment_size, sync_interval);
+    if (journal == NULL)
+    {
+        return -1;
+    }
+
+    rest_lock(rest);
 
-    json_object_set_new(jasync, "timestamp", json_integer(async->timestamp));
-    json_object_set_new(jasync, "id", json_string(async->id));
-    json_object_set_new(jasync, "status", json_integer(async->status));
-    json_object_set_new(jasync, "payload", json_string(async->payload));
+    rest->journal = journal;
+    rest_notification_log_reset(rest->notificationLog, rest_journal_next_seq(journal));
+    replayed = rest_journal_replay(journal, rest_notifications_replay_cb, rest);
 
-    return jasync;
+    rest_unlock(rest);
+
+    if (replayed > 0)
+    {
+        log_module_message(LOG_MODULE_JOURNAL, LOG_LEVEL_INFO,
+                           "[JOURNAL] Replayed %zu unacknowledged notifications\n", replayed);
+    }
+
+    rest_delivery_set_ack(rest->delivery, rest_notifications_ack_cb, journal);
+
+    return rest_journal_start(journal);
+}
+void rest_notify_registration(rest_context_t *rest, rest_notif_registration_t *reg,
+                              const rest_notification_source_t *source)
+{
+    rest_notify(rest, REST_NOTIFICATION_REGISTRATION, reg, source);
 }
 
-static json_t *rest_registration_notification_to_json(rest_notif_registration_t *registration)
+void rest_notify_update(rest_context_t *rest, rest_notif_update_t *update,
+                        const rest_notification_source_t *source)
 {
-    json_t *jreg = json_object();
+    rest_notify(rest, REST_NOTIFICATION_UPDATE, update, source);
+}
 
-    json_object_set_new(jreg, "name", json_string(registration->name));
+void rest_notify_deregistration(rest_context_t *rest, rest_notif_deregistration_t *dereg,
+                                const rest_notification_source_t *source)
+{
+    rest_notify(rest, REST_NOTIFICATION_DEREGISTRATION, dereg, source);
+}
 
-    return jreg;
+void rest_notify_timeout(rest_context_t *rest, rest_notif_timeout_t *timeout)
+{
+    rest_lock(rest);
+    rest_list_add(rest->timeoutList, timeout);
+    rest_unlock(rest);
 }
 
-static json_t *rest_update_notification_to_json(rest_notif_update_t *update)
+void rest_notify_async_response(rest_context_t *rest, rest_notif_async_response_t *resp,
+                                const rest_notification_source_t *source)
 {
-    json_t *jupdate = json_object();
+    rest_notify(rest, REST_NOTIFICATION_ASYNC_RESPONSE, resp, source);
+}
 
-    json_object_set_new(jupdate, "name", json_string(update->name));
+rest_decode_t rest_notifications_decode(rest_context_t *rest, rest_decode_t decode)
+{
+    if (decode != REST_DECODE_DEFAULT)
+    {
+        return decode;
+    }
 
-    return jupdate;
+    // Read on every response, without taking the lock notifying takes right after
+    return __atomic_load_n(&rest->callbackDecode, __ATOMIC_RELAXED);
 }
 
-static json_t *rest_deregistration_notification_to_json(rest_notif_deregistration_t *deregistration)
+void rest_notify_observation(rest_context_t *rest, rest_notif_async_response_t *resp,
+                             const rest_notification_source_t *source)
 {
-    json_t *jdereg = json_object();
+    rest_lock(rest);
 
-    json_object_set_new(jdereg, "name", json_string(deregistration->name));
+    // Observations are the only notifications, which may be refused under load
+    if (!rest_notification_log_admit(rest->notificationLog))
+    {
+        rest_unlock(rest);
 
-    return jdereg;
+        rest_async_response_delete(resp);
+        return;
+    }
+
+    rest_notify_unsafe(rest, REST_NOTIFICATION_ASYNC_RESPONSE, resp, source);
+
+    rest_unlock(rest);
 }
 
-json_t *rest_notifications_json(rest_context_t *rest)
+const char *rest_notification_group(rest_notification_type_t type)
 {
-    json_t *jnotifs;
-    json_t *jarray;
-    rest_list_entry_t *entry;
-    rest_notif_registration_t *reg;
-    rest_notif_update_t *upd;
-    rest_notif_deregistration_t *dereg;
-    rest_notif_async_response_t *async;
+    switch (type)
+    {
+    case REST_NOTIFICATION_REGISTRATION:
+        return "registrations";
+    case REST_NOTIFICATION_UPDATE:
+        return "reg-updates";
+    case REST_NOTIFICATION_DEREGISTRATION:
+        return "de-registrations";
+    case REST_NOTIFICATION_ASYNC_RESPONSE:
+        return "async-responses";
+    }
 
-    jnotifs = json_object();
+    return NULL;
+}
 
-    if (rest->registrationList)
+// Order of the groups in draining pull and callback batches
+static const rest_notification_type_t rest_notification_groups[] =
+{
+    REST_NOTIFICATION_REGISTRATION,
+    REST_NOTIFICATION_UPDATE,
+    REST_NOTIFICATION_DEREGISTRATION,
+    REST_NOTIFICATION_ASYNC_RESPONSE,
+};
+
+int rest_notification_type_parse(const char *string, rest_notification_type_t *type)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(rest_notification_types) / sizeof(rest_notification_types[0]); i++)
     {
-        jarray = json_array();
-        for (entry = rest->registrationList->head; entry != NULL; entry = entry->next)
+        if (strcmp(string, rest_notification_types[i]) == 0)
         {
-            reg = entry->data;
-            json_array_append_new(jarray, rest_registration_notification_to_json(reg));
+            *type = i;
+            return 0;
         }
-        json_object_set_new(jnotifs, "registrations", jarray);
     }
 
-    if (rest->updateList)
+    return -1;
+}
+
+void rest_notification_to_json(rest_json_writer_t *writer, const rest_notification_t *notification,
+                               bool with_seq)
+{
+    const rest_async_response_t *async;
+    const char *name;
+
+    rest_json_object_start(writer);
+
+    if (notification->type == REST_NOTIFICATION_ASYNC_RESPONSE)
     {
-        jarray = json_array();
-        for (entry = rest->updateList->head; entry != NULL; entry = entry->next)
+        async = notification->data;
+
+        rest_json_key(writer, "timestamp");
+        rest_json_int(writer, async->timestamp);
+        rest_json_key(writer, "id");
+        rest_json_string(writer, async->id);
+        rest_json_key(writer, "status");
+        rest_json_int(writer, async->status);
+        if (async->payload != NULL)
+        {
+            rest_json_key(writer, "payload");
+            rest_json_base64(writer, async->payload, async->payload_length);
+        }
+        if (async->values != NULL)
         {
-            upd = entry->data;
-            json_array_append_new(jarray, rest_update_notification_to_json(upd));
+            // Decoded values are kept serialized
+            rest_json_key(writer, "values");
+            rest_json_raw(writer, async->values);
         }
-        json_object_set_new(jnotifs, "reg-updates", jarray);
     }
+    else
+    {
+        // Registration, update and deregistration notifications share the layout
+        name = ((const rest_notif_registration_t *)notification->data)->name;
 
-    if (rest->deregistrationList)
+        rest_json_key(writer, "name");
+        if (name != NULL)
+        {
+            rest_json_string(writer, name);
+        }
+        else
+        {
+            rest_json_null(writer);
+        }
+    }
+
+    if (with_seq)
     {
-        jarray = json_array();
-        for (entry = rest->deregistrationList->head; entry != NULL; entry = entry->next)
+        rest_json_key(writer, "seq");
+        rest_json_uint(writer, notification->seq);
+        rest_json_key(writer, "type");
+        rest_json_string(writer, rest_notification_types[notification->type]);
+    }
+
+    rest_json_object_end(writer);
+}
+
+/*
+ * Same layout as the JSON representation, but payload is a raw byte string.
+ */
+void rest_notification_to_cbor(rest_cbor_t *cbor, const rest_notification_t *notification,
+                               bool with_seq)
+{
+    const rest_async_response_t *async;
+    const char *name;
+    json_t *jvalues = NULL;
+    size_t extra = with_seq ? 2 : 0;
+
+    if (notification->type == REST_NOTIFICATION_ASYNC_RESPONSE)
+    {
+        async = notification->data;
+        if (async->values != NULL)
         {
-            dereg = entry->data;
-            json_array_append_new(jarray, rest_deregistration_notification_to_json(dereg));
+            jvalues = json_loads(async->values, 0, NULL);
         }
-        json_object_set_new(jnotifs, "de-registrations", jarray);
+
+        rest_cbor_map(cbor, 3 + (async->payload != NULL) + (jvalues != NULL) + extra);
+        rest_cbor_text(cbor, "timestamp");
+        rest_cbor_int(cbor, async->timestamp);
+        rest_cbor_text(cbor, "id");
+        rest_cbor_text(cbor, async->id);
+        rest_cbor_text(cbor, "status");
+        rest_cbor_int(cbor, async->status);
+        if (async->payload != NULL)
+        {
+            rest_cbor_text(cbor, "payload");
+            rest_cbor_bytes(cbor, async->payload, async->payload_length);
+        }
+        if (jvalues != NULL)
+        {
+            rest_cbor_text(cbor, "values");
+            rest_cbor_json(cbor, jvalues);
+            json_decref(jvalues);
+        }
+    }
+    else
+    {
+        // Registration, update and deregistration notifications share the layout
+        name = ((const rest_notif_registration_t *)notification->data)->name;
+
+        rest_cbor_map(cbor, 1 + extra);
+        rest_cbor_text(cbor, "name");
+        if (name != NULL)
+        {
+            rest_cbor_text(cbor, name);
+        }
+        else
+        {
+            rest_cbor_null(cbor);
+        }
+    }
+
+    if (with_seq)
+    {
+        rest_cbor_text(cbor, "seq");
+        rest_cbor_uint(cbor, notification->seq);
+        rest_cbor_text(cbor, "type");
+        rest_cbor_text(cbor, rest_notification_types[notification->type]);
     }
+}
+
+static size_t rest_notification_json_estimate(const rest_notification_t *notification)
+{
+    return notification->size + notification->size / 3 + REST_NOTIFICATIONS_JSON_OVERHEAD;
+}
 
-    if (rest->asyncResponseList)
+uint64_t rest_notifications_batch_end(rest_context_t *rest, size_t max_records, size_t max_bytes,
+                                      bool *full)
+{
+    rest_notification_log_t *log = rest->notificationLog;
+    const rest_notification_t *retained;
+    size_t records = 0, bytes = 0;
+    uint64_t seq;
+
+    *full = false;
+
+    for (seq = log->drained; seq < log->next; seq++)
     {
-        jarray = json_array();
-        for (entry = rest->asyncResponseList->head; entry != NULL; entry = entry->next)
+        retained = rest_notification_log_get(log, seq);
+
+        // Dropped notifications take no space in the batch
+        if (retained->data == NULL && !retained->spilled)
         {
-            async = entry->data;
-            json_array_append_new(jarray, rest_async_response_to_json(async));
+            continue;
+        }
+
+        // Single notification over the byte limit still makes a batch of its own
+        if (records > 0 && bytes + rest_notification_json_estimate(retained) > max_bytes)
+        {
+            *full = true;
+            break;
+        }
+
+        records++;
+        bytes += rest_notification_json_estimate(retained);
+        if (records >= max_records || bytes >= max_bytes)
+        {
+            *full = true;
+            seq++;
+            break;
         }
-        json_object_set_new(jnotifs, "async-responses", jarray);
     }
 
-    return jnotifs;
+    return seq;
 }
 
-void rest_notifications_clear(rest_context_t *rest)
+void rest_notifications_json(rest_context_t *rest, uint64_t end, rest_json_writer_t *writer)
 {
-    while (rest->registrationList->head != NULL)
+    rest_notification_log_t *log = rest->notificationLog;
+    const rest_notification_t *retained;
+    rest_notification_t notification;
+    size_t i, estimate = 0;
+    uint64_t seq;
+
+    /*
+     * Encoded size of a notification is close to its JSON size (payload grows
+     * by a third in base64), so the whole batch usually fits the buffer
+     * reserved upfront and is written without reallocations.
+     */
+    for (seq = log->drained; seq < end; seq++)
     {
-        rest_notif_registration_t *reg = rest->registrationList->head->data;
-        rest_list_remove(rest->registrationList, reg);
-        rest_notif_registration_delete(reg);
+        estimate += rest_notification_json_estimate(rest_notification_log_get(log, seq));
     }
+    rest_json_writer_reserve(writer, estimate);
 
-    while (rest->updateList->head != NULL)
+    rest_json_object_start(writer);
+    for (i = 0; i < sizeof(rest_notification_groups) / sizeof(rest_notification_groups[0]); i++)
     {
-        rest_notif_update_t *upd = rest->updateList->head->data;
-        rest_list_remove(rest->updateList, upd);
-        rest_notif_update_delete(upd);
+        rest_json_key(writer, rest_notification_group(rest_notification_groups[i]));
+        rest_json_array_start(writer);
+
+        for (seq = log->drained; seq < end; seq++)
+        {
+            retained = rest_notification_log_get(log, seq);
+            if (retained->type != rest_notification_groups[i])
+            {
+                continue;
+            }
+
+            // Notifications dropped by memory budget policy are skipped
+            if (rest_notification_log_read(log, seq, &notification) != 0)
+            {
+                continue;
+            }
+            rest_notification_to_json(writer, &notification, false);
+            rest_notification_log_put(&notification);
+        }
+
+        rest_json_array_end(writer);
     }
+    rest_json_object_end(writer);
+}
 
-    while (rest->deregistrationList->head != NULL)
+void rest_notifications_cbor(rest_context_t *rest, uint64_t end, rest_cbor_t *cbor)
+{
+    rest_notification_log_t *log = rest->notificationLog;
+    const rest_notification_t *retained;
+    rest_notification_t notification;
+    size_t counts[4] = { 0 };
+    size_t i;
+    uint64_t seq;
+
+    // Group sizes are counted first, spilled notifications are not loaded for that
+    for (seq = log->drained; seq < end; seq++)
     {
-        rest_notif_deregistration_t *dereg = rest->deregistrationList->head->data;
-        rest_list_remove(rest->deregistrationList, dereg);
-        rest_notif_deregistration_delete(dereg);
+        retained = rest_notification_log_get(log, seq);
+        if (retained->data != NULL || retained->spilled)
+        {
+            counts[retained->type]++;
+        }
     }
 
-    while (rest->asyncResponseList->head != NULL)
+    rest_cbor_map(cbor, sizeof(rest_notification_groups) / sizeof(rest_notification_groups[0]));
+    for (i = 0; i < sizeof(rest_notification_groups) / sizeof(rest_notification_groups[0]); i++)
     {
-        rest_notif_async_response_t *async = rest->asyncResponseList->head->data;
-        rest_list_remove(rest->asyncResponseList, async);
-        rest_async_response_delete(async);
+        rest_cbor_text(cbor, rest_notification_group(rest_notification_groups[i]));
+        rest_cbor_array(cbor, counts[rest_notification_groups[i]]);
+
+        for (seq = log->drained; seq < end; seq++)
+        {
+            retained = rest_notification_log_get(log, seq);
+            if (retained->type != rest_notification_groups[i]
+                || (retained->data == NULL && !retained->spilled))
+            {
+                continue;
+            }
+
+            // Array length is already written, unreadable notification becomes null
+            if (rest_notification_log_read(log, seq, &notification) != 0)
+            {
+                rest_cbor_null(cbor);
+                continue;
+            }
+            rest_notification_to_cbor(cbor, &notification, false);
+            rest_notification_log_put(&notification);
+        }
     }
 }
 
+void rest_notifications_clear(rest_context_t *rest)
+{
+    rest_notification_log_drain(rest->notificationLog);
+}
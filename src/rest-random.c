@@ -0,0 +1,180 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rest-random.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/random.h>
+
+#define REST_RANDOM_BLOCK_SIZE 64
+#define REST_RANDOM_BLOCKS 4
+#define REST_RANDOM_KEY_SIZE 32
+
+#define REST_RANDOM_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define REST_RANDOM_QUARTER(a, b, c, d)                                 \
+    do                                                                  \
+    {                                                                   \
+        a += b; d ^= a; d = REST_RANDOM_ROTL(d, 16);                    \
+        c += d; b ^= c; b = REST_RANDOM_ROTL(b, 12);                    \
+        a += b; d ^= a; d = REST_RANDOM_ROTL(d, 8);                     \
+        c += d; b ^= c; b = REST_RANDOM_ROTL(b, 7);                     \
+    } while (0)
+
+typedef struct
+{
+    uint8_t key[REST_RANDOM_KEY_SIZE];
+    uint8_t buffer[REST_RANDOM_BLOCKS * REST_RANDOM_BLOCK_SIZE];
+    size_t available;
+    bool seeded;
+} rest_random_state_t;
+
+static __thread rest_random_state_t rest_random_state;
+
+
+static uint32_t rest_random_load32(const uint8_t *bytes)
+{
+    return bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16
+           | (uint32_t)bytes[3] << 24;
+}
+
+static void rest_random_store32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = value;
+    bytes[1] = value >> 8;
+    bytes[2] = value >> 16;
+    bytes[3] = value >> 24;
+}
+
+static void rest_random_block(const uint8_t *key, uint32_t counter, uint8_t *output)
+{
+    uint32_t input[16], x[16];
+    int i;
+
+    // "expand 32-byte k", key, block counter and zero nonce
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    for (i = 0; i < 8; i++)
+    {
+        input[4 + i] = rest_random_load32(key + 4 * i);
+    }
+    input[12] = counter;
+    input[13] = 0;
+    input[14] = 0;
+    input[15] = 0;
+
+    memcpy(x, input, sizeof(x));
+    for (i = 0; i < 10; i++)
+    {
+        REST_RANDOM_QUARTER(x[0], x[4], x[8], x[12]);
+        REST_RANDOM_QUARTER(x[1], x[5], x[9], x[13]);
+        REST_RANDOM_QUARTER(x[2], x[6], x[10], x[14]);
+        REST_RANDOM_QUARTER(x[3], x[7], x[11], x[15]);
+        REST_RANDOM_QUARTER(x[0], x[5], x[10], x[15]);
+        REST_RANDOM_QUARTER(x[1], x[6], x[11], x[12]);
+        REST_RANDOM_QUARTER(x[2], x[7], x[8], x[13]);
+        REST_RANDOM_QUARTER(x[3], x[4], x[9], x[14]);
+    }
+
+    for (i = 0; i < 16; i++)
+    {
+        rest_random_store32(output + 4 * i, x[i] + input[i]);
+    }
+}
+
+static int rest_random_seed(rest_random_state_t *state)
+{
+    size_t offset = 0;
+    ssize_t length;
+
+    while (offset < sizeof(state->key))
+    {
+        length = getrandom(state->key + offset, sizeof(state->key) - offset, 0);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        offset += length;
+    }
+
+    state->seeded = true;
+
+    return 0;
+}
+
+static int rest_random_refill(rest_random_state_t *state)
+{
+    uint32_t block;
+
+    if (!state->seeded && rest_random_seed(state) != 0)
+    {
+        return -1;
+    }
+
+    for (block = 0; block < REST_RANDOM_BLOCKS; block++)
+    {
+        rest_random_block(state->key, block, state->buffer + block * REST_RANDOM_BLOCK_SIZE);
+    }
+
+    /*
+     * Fast key erasure: beginning of the keystream becomes the next key and
+     * is wiped, so already returned bytes can not be recovered from the state.
+     */
+    memcpy(state->key, state->buffer, REST_RANDOM_KEY_SIZE);
+    memset(state->buffer, 0, REST_RANDOM_KEY_SIZE);
+    state->available = sizeof(state->buffer) - REST_RANDOM_KEY_SIZE;
+
+    return 0;
+}
+
+int rest_random_fill(void *buffer, size_t length)
+{
+    rest_random_state_t *state = &rest_random_state;
+    uint8_t *output = buffer;
+    uint8_t *source;
+    size_t chunk;
+
+    while (length > 0)
+    {
+        if (state->available == 0 && rest_random_refill(state) != 0)
+        {
+            return -1;
+        }
+
+        chunk = length < state->available ? length : state->available;
+        source = state->buffer + sizeof(state->buffer) - state->available;
+
+        memcpy(output, source, chunk);
+        memset(source, 0, chunk);
+
+        output += chunk;
+        length -= chunk;
+        state->available -= chunk;
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_RANDOM_H
+#define REST_RANDOM_H
+
+#include <stddef.h>
+
+/**
+ * Fills buffer with cryptographically secure random bytes. Every thread has
+ * its own ChaCha20 generator, seeded from getrandom() on first use, so the
+ * kernel is not involved on the hot path.
+ *
+ * @param[out] buffer  Buffer to fill
+ * @param[in]  length  Number of bytes
+ *
+ * @return 0 on success, -1 if the generator can not be seeded
+ */
+int rest_random_fill(void *buffer, size_t length);
+
+#endif // REST_RANDOM_H
@@ -17,6 +17,8 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_RESOURCE
+
 #include <assert.h>
 #include <errno.h>
 #include <stdio.h>
@@ -30,8 +32,10 @@
 typedef struct
 {
     rest_context_t *rest;
+    rest_shard_t *shard;
     uint8_t *payload;
     rest_async_response_t *response;
+    rest_decode_t decode;
 } rest_async_context_t;
 
 static int http_to_coap_format(const char *type)
@@ -64,6 +68,7 @@ static void rest_async_cb(uint16_t clientID, lwm2m_uri_t *uriP, int status,
                           void *context)
 {
     rest_async_context_t *ctx = (rest_async_context_t *)context;
+    rest_notification_source_t source;
     int err;
 
     log_message(LOG_LEVEL_INFO, "[ASYNC-RESPONSE] id=%s status=%d\n",
@@ -74,7 +79,12 @@ static void rest_async_cb(uint16_t clientID, lwm2m_uri_t *uriP, int status,
     err = rest_async_response_set(ctx->response, coap_to_http_status(status), data, dataLength);
     assert(err == 0);
 
-    rest_notify_async_response(ctx->rest, ctx->response);
+    rest_values_set(ctx->response, rest_notifications_decode(ctx->rest, ctx->decode), uriP,
+                    format, data, dataLength);
+
+    rest_notification_source_set(&source, client_registry_find_id(&ctx->shard->clients, clientID),
+                                 uriP);
+    rest_notify_async_response(ctx->rest, ctx->response, &source);
 
     // Free rest_async_context_t which was allocated in rest_resources_read_cb
     if (ctx->payload != NULL)
@@ -85,7 +95,7 @@ static void rest_async_cb(uint16_t clientID, lwm2m_uri_t *uriP, int status,
     free(ctx);
 }
 
-static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
+static int rest_resources_rwe_cb_unsafe(rest_context_t *rest, rest_shard_t *shard,
                                         const ulfius_req_t *req, ulfius_resp_t *resp)
 {
     enum
@@ -103,6 +113,8 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
     json_t *jresponse;
     rest_async_context_t *async_context = NULL;
     lwm2m_media_type_t format;
+    rest_decode_t decode = REST_DECODE_DEFAULT;
+    const char *decode_param;
     int res;
 
     /*
@@ -165,9 +177,16 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
         return U_CALLBACK_COMPLETE;
     }
 
+    decode_param = u_map_get(req->map_url, "decode");
+    if (decode_param != NULL && rest_decode_parse(decode_param, &decode) != 0)
+    {
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
     /* Find requested client */
     name = u_map_get(req->map_url, "name");
-    client = rest_endpoints_find_client(rest->lwm2m->clientList, name);
+    client = rest_endpoints_find_client(shard, name);
     if (client == NULL)
     {
         ulfius_set_empty_body_response(resp, 410);
@@ -190,8 +209,9 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
         return U_CALLBACK_COMPLETE;
     }
 
-    /* Extract and convert resource path */
+    /* Extract and convert resource path (without query string) */
     strcpy(path, &req->http_url[len - 1]);
+    path[strcspn(path, "?")] = '\0';
 
     if (lwm2m_stringToUri(path, strlen(path), &uri) == 0)
     {
@@ -213,6 +233,8 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
     }
 
     async_context->rest = rest;
+    async_context->shard = shard;
+    async_context->decode = decode;
 
     async_context->payload = malloc(req->binary_body_length);
     if (async_context->payload == NULL)
@@ -231,14 +253,14 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
     {
     case RES_ACTION_READ:
         res = lwm2m_dm_read(
-                  rest->lwm2m, client->internalID, &uri,
+                  shard->lwm2m, client->internalID, &uri,
                   rest_async_cb, async_context
               );
         break;
 
     case RES_ACTION_WRITE:
         res = lwm2m_dm_write(
-                  rest->lwm2m, client->internalID, &uri,
+                  shard->lwm2m, client->internalID, &uri,
                   format, async_context->payload, req->binary_body_length,
                   rest_async_cb, async_context
               );
@@ -246,7 +268,7 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
 
     case RES_ACTION_EXEC:
         res = lwm2m_dm_execute(
-                  rest->lwm2m, client->internalID, &uri,
+                  shard->lwm2m, client->internalID, &uri,
                   format, async_context->payload, req->binary_body_length,
                   rest_async_cb, async_context
               );
@@ -265,7 +287,7 @@ static int rest_resources_rwe_cb_unsafe(rest_context_t *rest,
 
     jresponse = json_object();
     json_object_set_new(jresponse, "async-response-id", json_string(async_context->response->id));
-    ulfius_set_json_body_response(resp, 202, jresponse);
+    rest_set_body_response(req, resp, 202, jresponse);
     json_decref(jresponse);
 
     return U_CALLBACK_COMPLETE;
@@ -295,11 +317,21 @@ exit:
 int rest_resources_rwe_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
 {
     rest_context_t *rest = (rest_context_t *)context;
+    rest_shard_t *shard;
     int ret;
 
-    rest_lock(rest);
-    ret = rest_resources_rwe_cb_unsafe(rest, req, resp);
-    rest_unlock(rest);
+    shard = rest_endpoints_find_shard(rest, u_map_get(req->map_url, "name"));
+    if (shard == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 410);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    rest_shard_lock(shard);
+    ret = rest_resources_rwe_cb_unsafe(rest, shard, req, resp);
+    rest_shard_unlock(shard);
+
+    rest_shard_wakeup(shard);
 
     return ret;
 }
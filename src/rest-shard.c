@@ -0,0 +1,420 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE // recvmmsg()
+
+#define LOG_MODULE LOG_MODULE_COAP
+
+#include "rest-shard.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+
+#include "logging.h"
+#include "metrics.h"
+#include "restserver.h"
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+static metric_t metric_rx_packets = METRIC_COUNTER_INIT("coap.rx_packets");
+static metric_t metric_rx_syscalls = METRIC_COUNTER_INIT("coap.rx_syscalls");
+static metric_t metric_rx_batch_max = METRIC_GAUGE_INIT("coap.rx_batch_max");
+
+static int rest_shard_socket(uint16_t port, bool reuseport)
+{
+    struct sockaddr_in6 addr;
+    int sock;
+    int on = 1, off = 0;
+
+    sock = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "socket() error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // Accept IPv4 datagrams as well (IPv4-mapped addresses)
+    setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    if (reuseport && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "SO_REUSEPORT error: %s\n", strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "bind() error: %s\n", strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/*
+ * Classic BPF program which selects reuseport group socket by hashing packet
+ * source address (IPv4 or IPv6), source port is ignored on purpose to survive
+ * NAT rebinding.
+ */
+static int rest_shard_attach_steering(int sock, size_t count)
+{
+    struct sock_filter code[] =
+    {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 11),
+        // IPv6: fold 128-bit source address
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 16),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 20),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_JMP | BPF_JA, 1),
+        // IPv4: 32-bit source address
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + 12),
+        // A = (A ^ (A >> 16)) % count
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, count),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog program =
+    {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0)
+    {
+        log_message(LOG_LEVEL_WARN, "Failed to attach shard steering program: %s\n",
+                    strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+int rest_shard_create_sockets(int *socks, size_t count, uint16_t port)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        socks[i] = rest_shard_socket(port, count > 1);
+        if (socks[i] < 0)
+        {
+            while (i > 0)
+            {
+                close(socks[--i]);
+            }
+            return -1;
+        }
+    }
+
+    if (count > 1 && rest_shard_attach_steering(socks[0], count) != 0)
+    {
+        // Kernel falls back to 4-tuple hashing, which still pins most devices
+        log_message(LOG_LEVEL_WARN, "Devices will be steered by address and port\n");
+    }
+
+    return 0;
+}
+
+static int rest_shard_receive(rest_shard_t *shard)
+{
+    struct mmsghdr messages[REST_SHARD_RECEIVE_BATCH];
+    struct iovec iovecs[REST_SHARD_RECEIVE_BATCH];
+    struct sockaddr_storage addrs[REST_SHARD_RECEIVE_BATCH];
+    packet_buffer_t *buffers[REST_SHARD_RECEIVE_BATCH];
+    connection_t *con;
+    time_t now;
+    int count, index, received;
+
+    memset(messages, 0, sizeof(messages));
+
+    for (count = 0; count < REST_SHARD_RECEIVE_BATCH; count++)
+    {
+        buffers[count] = packet_pool_acquire(&shard->pool);
+        if (buffers[count] == NULL)
+        {
+            break;
+        }
+
+        iovecs[count].iov_base = buffers[count]->data;
+        iovecs[count].iov_len = sizeof(buffers[count]->data);
+        messages[count].msg_hdr.msg_iov = &iovecs[count];
+        messages[count].msg_hdr.msg_iovlen = 1;
+        messages[count].msg_hdr.msg_name = &addrs[count];
+        messages[count].msg_hdr.msg_namelen = sizeof(addrs[count]);
+    }
+
+    received = recvmmsg(shard->sock, messages, count, MSG_DONTWAIT, NULL);
+
+    if (received < 0)
+    {
+        for (index = 0; index < count; index++)
+        {
+            packet_pool_release(&shard->pool, buffers[index]);
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return 0;
+        }
+
+        log_message(LOG_LEVEL_FATAL, "recvmmsg() error: %s\n", strerror(errno));
+        return -1;
+    }
+
+    metrics_add(&metric_rx_syscalls, 1);
+    metrics_add(&metric_rx_packets, received);
+    metrics_max(&metric_rx_batch_max, received);
+
+    // Whole batch is handled under a single lock acquisition
+    rest_shard_lock(shard);
+
+    now = lwm2m_gettime();
+
+    for (index = 0; index < received; index++)
+    {
+        if (messages[index].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            log_message(LOG_LEVEL_WARN, "Dropping truncated datagram (%u bytes)\n",
+                        messages[index].msg_len);
+            continue;
+        }
+
+        con = connection_table_get(&shard->connections, shard->sock, &addrs[index],
+                                   messages[index].msg_hdr.msg_namelen, now);
+
+        if (con)
+        {
+            lwm2m_handle_packet(shard->lwm2m, buffers[index]->data,
+                                messages[index].msg_len, con);
+        }
+    }
+
+    rest_shard_unlock(shard);
+
+    for (index = 0; index < count; index++)
+    {
+        packet_pool_release(&shard->pool, buffers[index]);
+    }
+
+    return 0;
+}
+
+static void rest_shard_socket_cb(int fd, uint32_t events, void *context)
+{
+    rest_shard_receive((rest_shard_t *)context);
+}
+
+static bool rest_shard_running(rest_shard_t *shard)
+{
+    return __atomic_load_n(&shard->running, __ATOMIC_ACQUIRE);
+}
+
+static void *rest_shard_thread(void *context)
+{
+    rest_shard_t *shard = (rest_shard_t *)context;
+    struct timeval tv;
+    struct timespec timeout;
+    int64_t publish_us;
+    int res;
+
+    while (rest_shard_running(shard))
+    {
+        tv.tv_sec = 5;
+        tv.tv_usec = 0;
+
+        rest_shard_lock(shard);
+        res = lwm2m_step(shard->lwm2m, &tv.tv_sec);
+        if (res)
+        {
+            log_message(LOG_LEVEL_ERROR, "lwm2m_step() error: %d\n", res);
+        }
+
+        connection_table_sweep(&shard->connections, lwm2m_gettime());
+        rest_shard_unlock(shard);
+
+        rest_lock(shard->rest);
+        res = rest_step(shard->rest, &tv);
+        if (res)
+        {
+            log_message(LOG_LEVEL_ERROR, "rest_step() error: %d\n", res);
+        }
+        rest_unlock(shard->rest);
+
+        publish_us = client_publisher_publish(&shard->publisher, metrics_time_us());
+
+        /*
+         * Sleep until a packet arrives, a REST handler requests attention
+         * (see rest_shard_wakeup()), next lwm2m_step() deadline expires or
+         * deferred client snapshot has to be published.
+         */
+        timeout.tv_sec = tv.tv_sec;
+        timeout.tv_nsec = tv.tv_usec * 1000;
+        if (publish_us >= 0 && publish_us < (int64_t)tv.tv_sec * 1000000 + tv.tv_usec)
+        {
+            timeout.tv_sec = publish_us / 1000000;
+            timeout.tv_nsec = (publish_us % 1000000) * 1000;
+        }
+        event_loop_set_timeout(&shard->loop, &timeout);
+
+        if (event_loop_run(&shard->loop) < 0)
+        {
+            log_message(LOG_LEVEL_ERROR, "event_loop_run() error\n");
+        }
+    }
+
+    return NULL;
+}
+
+int rest_shard_init(rest_shard_t *shard, struct rest_context_t *rest, size_t index, int sock,
+                    time_t connection_timeout, lwm2m_result_callback_t monitor)
+{
+    memset(shard, 0, sizeof(rest_shard_t));
+
+    shard->rest = rest;
+    shard->index = index;
+    shard->sock = sock;
+    shard->loop.epoll_fd = -1;
+    shard->loop.wakeup_fd = -1;
+    shard->loop.timer_fd = -1;
+
+    pthread_mutex_init(&shard->mutex, NULL);
+
+    shard->lwm2m = lwm2m_init(NULL);
+    if (shard->lwm2m == NULL)
+    {
+        log_message(LOG_LEVEL_ERROR, "Failed to create LwM2M server!\n");
+        return -1;
+    }
+
+    lwm2m_set_monitoring_callback(shard->lwm2m, monitor, shard);
+
+    if (event_loop_init(&shard->loop) != 0
+        || packet_pool_init(&shard->pool, REST_SHARD_RECEIVE_BATCH) != 0
+        || client_registry_init(&shard->clients) != 0
+        || client_publisher_init(&shard->publisher) != 0
+        || connection_table_init(&shard->connections, connection_timeout) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "Failed to allocate shard resources!\n");
+        return -1;
+    }
+
+    if (event_loop_add(&shard->loop, sock, rest_shard_socket_cb, shard) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "Failed to watch coap socket!\n");
+        return -1;
+    }
+
+    metrics_register(&metric_rx_packets);
+    metrics_register(&metric_rx_syscalls);
+    metrics_register(&metric_rx_batch_max);
+
+    return 0;
+}
+
+void rest_shard_cleanup(rest_shard_t *shard)
+{
+    event_loop_cleanup(&shard->loop);
+    packet_pool_cleanup(&shard->pool);
+
+    if (shard->lwm2m != NULL)
+    {
+        lwm2m_close(shard->lwm2m);
+        shard->lwm2m = NULL;
+    }
+
+    client_registry_cleanup(&shard->clients);
+    client_publisher_cleanup(&shard->publisher);
+
+    connection_table_cleanup(&shard->connections);
+
+    if (shard->sock >= 0)
+    {
+        close(shard->sock);
+        shard->sock = -1;
+    }
+
+    pthread_mutex_destroy(&shard->mutex);
+}
+
+int rest_shard_start(rest_shard_t *shard)
+{
+    __atomic_store_n(&shard->running, true, __ATOMIC_RELEASE);
+
+    if (pthread_create(&shard->thread, NULL, rest_shard_thread, shard) != 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "Failed to start shard %zu thread: %s\n",
+                    shard->index, strerror(errno));
+        __atomic_store_n(&shard->running, false, __ATOMIC_RELEASE);
+        return -1;
+    }
+
+    return 0;
+}
+
+void rest_shard_stop(rest_shard_t *shard)
+{
+    if (!rest_shard_running(shard))
+    {
+        return;
+    }
+
+    __atomic_store_n(&shard->running, false, __ATOMIC_RELEASE);
+    event_loop_wakeup(&shard->loop);
+
+    pthread_join(shard->thread, NULL);
+}
+
+void rest_shard_lock(rest_shard_t *shard)
+{
+    pthread_mutex_lock(&shard->mutex);
+}
+
+void rest_shard_unlock(rest_shard_t *shard)
+{
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+void rest_shard_wakeup(rest_shard_t *shard)
+{
+    event_loop_wakeup(&shard->loop);
+}
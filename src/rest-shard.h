@@ -0,0 +1,125 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_SHARD_H
+#define REST_SHARD_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <liblwm2m.h>
+
+#include "client-registry.h"
+#include "client-snapshot.h"
+#include "connection-table.h"
+#include "event-loop.h"
+#include "packet-pool.h"
+
+#define REST_SHARD_RECEIVE_BATCH 32
+
+struct rest_context_t;
+
+/*
+ * Shard is an independent CoAP engine: it owns a SO_REUSEPORT socket, LwM2M
+ * context, client registry, connection table and a thread, which runs the
+ * event loop. Every access to the LwM2M context must be done while holding
+ * the shard lock. Read-only client listings are served from snapshots
+ * published by the shard thread and do not need the shard lock.
+ */
+typedef struct rest_shard_t
+{
+    pthread_mutex_t mutex;
+    struct rest_context_t *rest;
+    size_t index;
+    int sock;
+    lwm2m_context_t *lwm2m;
+    client_registry_t clients;
+    client_publisher_t publisher;
+    event_loop_t loop;
+    packet_pool_t pool;
+    connection_table_t connections;
+    pthread_t thread;
+    bool running;
+} rest_shard_t;
+
+/**
+ * Creates UDP sockets bound to the same port, incoming datagrams are steered
+ * between them by the source address, so that every device is always served
+ * by the same shard.
+ *
+ * @param[out] socks  Array which receives created sockets
+ * @param[in]  count  Number of sockets to create
+ * @param[in]  port   CoAP port
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_shard_create_sockets(int *socks, size_t count, uint16_t port);
+
+/**
+ * Initialises shard resources. Socket ownership is passed to the shard.
+ *
+ * @param[in]  shard               Pointer to the shard
+ * @param[in]  rest                REST context the shard belongs to
+ * @param[in]  index               Shard index
+ * @param[in]  sock                CoAP socket
+ * @param[in]  connection_timeout  Idle connection eviction timeout in seconds
+ * @param[in]  monitor             LwM2M client monitoring callback (user data is the shard)
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_shard_init(rest_shard_t *shard, struct rest_context_t *rest, size_t index, int sock,
+                    time_t connection_timeout, lwm2m_result_callback_t monitor);
+
+/**
+ * Releases shard resources. Shard must be stopped.
+ *
+ * @param[in]  shard  Pointer to the shard
+ */
+void rest_shard_cleanup(rest_shard_t *shard);
+
+/**
+ * Starts shard thread.
+ *
+ * @param[in]  shard  Pointer to the shard
+ *
+ * @return 0 on success, -1 on error
+ */
+int rest_shard_start(rest_shard_t *shard);
+
+/**
+ * Stops shard thread and waits for it to exit.
+ *
+ * @param[in]  shard  Pointer to the shard
+ */
+void rest_shard_stop(rest_shard_t *shard);
+
+void rest_shard_lock(rest_shard_t *shard);
+void rest_shard_unlock(rest_shard_t *shard);
+
+/**
+ * Requests shard thread to run lwm2m_step() as soon as possible, e.g. after
+ * a new transaction was queued.
+ *
+ * @param[in]  shard  Pointer to the shard
+ */
+void rest_shard_wakeup(rest_shard_t *shard);
+
+#endif // REST_SHARD_H
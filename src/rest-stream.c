@@ -0,0 +1,221 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#define LOG_MODULE LOG_MODULE_NOTIFY
+
+#include "rest-stream.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logging.h"
+#include "metrics.h"
+
+#define REST_STREAM_INITIAL_CAPACITY 4096
+
+static const char rest_stream_keepalive[] = ":keep-alive\n\n";
+static const char rest_stream_overflow[] = "event: overflow\ndata: {}\n\n";
+
+static metric_t metric_connections = METRIC_GAUGE_INIT("stream.connections");
+static metric_t metric_bytes = METRIC_COUNTER_INIT("stream.bytes");
+static metric_t metric_slow_consumers = METRIC_COUNTER_INIT("stream.slow_consumers");
+
+rest_stream_t *rest_stream_new(size_t limit, rest_callback_filter_t *filter, void *context)
+{
+    rest_stream_t *stream;
+
+    stream = calloc(1, sizeof(rest_stream_t));
+    if (stream == NULL)
+    {
+        return NULL;
+    }
+
+    stream->context = context;
+    stream->limit = limit;
+    stream->filter = *filter;
+    memset(filter, 0, sizeof(rest_callback_filter_t));
+
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+
+    metrics_register(&metric_connections);
+    metrics_register(&metric_bytes);
+    metrics_register(&metric_slow_consumers);
+    metrics_add(&metric_connections, 1);
+
+    return stream;
+}
+
+void rest_stream_delete(rest_stream_t *stream)
+{
+    metrics_add(&metric_connections, -1);
+
+    rest_callback_filter_cleanup(&stream->filter);
+
+    pthread_cond_destroy(&stream->cond);
+    pthread_mutex_destroy(&stream->mutex);
+
+    free(stream->data);
+    free(stream);
+}
+
+static int rest_stream_reserve(rest_stream_t *stream, size_t length)
+{
+    size_t capacity;
+    char *data;
+
+    // Compact first, read position only moves forward
+    if (stream->start + stream->length + length > stream->capacity && stream->start > 0)
+    {
+        memmove(stream->data, stream->data + stream->start, stream->length);
+        stream->start = 0;
+    }
+
+    if (stream->length + length <= stream->capacity)
+    {
+        return 0;
+    }
+
+    capacity = stream->capacity > 0 ? stream->capacity : REST_STREAM_INITIAL_CAPACITY;
+    while (capacity < stream->length + length)
+    {
+        capacity *= 2;
+    }
+    if (capacity > stream->limit)
+    {
+        capacity = stream->limit;
+    }
+
+    data = realloc(stream->data, capacity);
+    if (data == NULL)
+    {
+        return -1;
+    }
+
+    stream->data = data;
+    stream->capacity = capacity;
+
+    return 0;
+}
+
+int rest_stream_push(rest_stream_t *stream, const char *data, size_t length)
+{
+    pthread_mutex_lock(&stream->mutex);
+
+    if (stream->closed)
+    {
+        pthread_mutex_unlock(&stream->mutex);
+        return -1;
+    }
+
+    if (stream->length + length > stream->limit || rest_stream_reserve(stream, length) != 0)
+    {
+        log_message(LOG_LEVEL_WARN, "[STREAM] Disconnecting slow consumer (%zu bytes pending)\n",
+                    stream->length);
+        metrics_add(&metric_slow_consumers, 1);
+
+        // Pending events are lost anyway, the consumer resumes with a cursor based pull
+        stream->length = 0;
+        stream->start = 0;
+        stream->overflow = true;
+        stream->closed = true;
+        pthread_cond_signal(&stream->cond);
+
+        pthread_mutex_unlock(&stream->mutex);
+        return -1;
+    }
+
+    memcpy(stream->data + stream->start + stream->length, data, length);
+    stream->length += length;
+
+    pthread_cond_signal(&stream->cond);
+
+    pthread_mutex_unlock(&stream->mutex);
+
+    return 0;
+}
+
+void rest_stream_close(rest_stream_t *stream)
+{
+    pthread_mutex_lock(&stream->mutex);
+    stream->closed = true;
+    pthread_cond_signal(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+static size_t rest_stream_copy(char *buffer, size_t size, const char *data, size_t length)
+{
+    if (length > size)
+    {
+        return 0;
+    }
+
+    memcpy(buffer, data, length);
+
+    return length;
+}
+
+ssize_t rest_stream_read(rest_stream_t *stream, char *buffer, size_t size, int keepalive)
+{
+    struct timespec deadline;
+    size_t length;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += keepalive;
+
+    pthread_mutex_lock(&stream->mutex);
+
+    while (stream->length == 0 && !stream->closed)
+    {
+        if (pthread_cond_timedwait(&stream->cond, &stream->mutex, &deadline) == ETIMEDOUT
+            && stream->length == 0 && !stream->closed)
+        {
+            pthread_mutex_unlock(&stream->mutex);
+            return rest_stream_copy(buffer, size, rest_stream_keepalive,
+                                    sizeof(rest_stream_keepalive) - 1);
+        }
+    }
+
+    if (stream->length == 0)
+    {
+        // Overflow is reported once, then the stream ends
+        length = 0;
+        if (stream->overflow)
+        {
+            stream->overflow = false;
+            length = rest_stream_copy(buffer, size, rest_stream_overflow,
+                                      sizeof(rest_stream_overflow) - 1);
+        }
+        pthread_mutex_unlock(&stream->mutex);
+
+        return length > 0 ? (ssize_t)length : -1;
+    }
+
+    length = stream->length < size ? stream->length : size;
+    memcpy(buffer, stream->data + stream->start, length);
+    stream->start += length;
+    stream->length -= length;
+
+    pthread_mutex_unlock(&stream->mutex);
+
+    metrics_add(&metric_bytes, length);
+
+    return length;
+}
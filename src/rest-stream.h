@@ -0,0 +1,108 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef REST_STREAM_H
+#define REST_STREAM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "rest-callbacks.h"
+
+#define REST_STREAMS_MAX            64
+#define REST_STREAM_BUFFER_SIZE     (1024 * 1024)
+#define REST_STREAM_KEEPALIVE       15
+#define REST_STREAM_CHUNK_SIZE      16384
+
+/*
+ * Buffer of a single event stream connection. Events are pushed by the
+ * thread which produces them and read by the HTTP connection thread. A
+ * consumer which falls behind by more than the buffer limit is disconnected
+ * (the buffered events are discarded and an "overflow" event is sent
+ * instead), so it can never hold back the producers or grow memory.
+ */
+typedef struct rest_stream_t
+{
+    struct rest_stream_t *next;
+    void *context;
+    rest_callback_filter_t filter;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char *data;
+    size_t start;
+    size_t length;
+    size_t capacity;
+    size_t limit;
+    bool closed;
+    bool overflow;
+} rest_stream_t;
+
+/**
+ * Creates stream buffer.
+ *
+ * @param[in]  limit    Maximum number of buffered bytes
+ * @param[in]  filter   Compiled event filter (taken over)
+ * @param[in]  context  User context
+ *
+ * @return Pointer to a new stream or NULL on error
+ */
+rest_stream_t *rest_stream_new(size_t limit, rest_callback_filter_t *filter, void *context);
+
+/**
+ * Releases the stream, there must be no reader.
+ *
+ * @param[in]  stream  Pointer to the stream
+ */
+void rest_stream_delete(rest_stream_t *stream);
+
+/**
+ * Appends data to the stream, never blocks.
+ *
+ * @param[in]  stream  Pointer to the stream
+ * @param[in]  data    Data
+ * @param[in]  length  Length of the data
+ *
+ * @return 0 on success, -1 if the stream is closed or the consumer is too slow
+ */
+int rest_stream_push(rest_stream_t *stream, const char *data, size_t length);
+
+/**
+ * Closes the stream, reader receives the remaining data and then the end of
+ * the stream.
+ *
+ * @param[in]  stream  Pointer to the stream
+ */
+void rest_stream_close(rest_stream_t *stream);
+
+/**
+ * Waits for data and reads it. If nothing arrives for the given time, an SSE
+ * comment is returned to keep the connection alive.
+ *
+ * @param[in]  stream     Pointer to the stream
+ * @param[out] buffer     Output buffer
+ * @param[in]  size       Size of the output buffer
+ * @param[in]  keepalive  Keep-alive period in seconds
+ *
+ * @return Number of bytes read or -1 at the end of the stream
+ */
+ssize_t rest_stream_read(rest_stream_t *stream, char *buffer, size_t size, int keepalive);
+
+#endif // REST_STREAM_H
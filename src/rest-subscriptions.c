@@ -17,6 +17,8 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_OBSERVE
+
 #include <string.h>
 
 #include "restserver.h"
@@ -26,7 +28,9 @@
 typedef struct
 {
     rest_context_t *rest;
+    rest_shard_t *shard;
     rest_async_response_t *response;
+    rest_decode_t decode;
 } rest_observe_context_t;
 
 static void rest_observe_cb(uint16_t clientID, lwm2m_uri_t *uriP, int count,
@@ -35,6 +39,7 @@ static void rest_observe_cb(uint16_t clientID, lwm2m_uri_t *uriP, int count,
 {
     rest_observe_context_t *ctx = (rest_observe_context_t *)context;
     rest_async_response_t *response;
+    rest_notification_source_t source;
 
     log_message(LOG_LEVEL_INFO, "[OBSERVE-RESPONSE] id=%s count=%d data=%p\n",
                 ctx->response->id, count, data);
@@ -51,7 +56,12 @@ static void rest_observe_cb(uint16_t clientID, lwm2m_uri_t *uriP, int count,
                             (data == NULL) ? coap_to_http_status(count) : HTTP_200_OK,
                             data, dataLength);
 
-    rest_notify_async_response(ctx->rest, response);
+    rest_values_set(response, rest_notifications_decode(ctx->rest, ctx->decode), uriP, format,
+                    data, dataLength);
+
+    rest_notification_source_set(&source, client_registry_find_id(&ctx->shard->clients, clientID),
+                                 uriP);
+    rest_notify_observation(ctx->rest, response, &source);
 }
 
 static void rest_unobserve_cb(uint16_t clientID, lwm2m_uri_t *uriP, int count,
@@ -68,7 +78,7 @@ static void rest_unobserve_cb(uint16_t clientID, lwm2m_uri_t *uriP, int count,
     free(ctx);
 }
 
-static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
+static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest, rest_shard_t *shard,
                                             const ulfius_req_t *req,
                                             ulfius_resp_t *resp)
 {
@@ -80,6 +90,8 @@ static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
     json_t *jresponse;
     lwm2m_observation_t *targetP;
     rest_observe_context_t *observe_context = NULL;
+    rest_decode_t decode = REST_DECODE_DEFAULT;
+    const char *decode_param;
     int res;
 
     /*
@@ -91,9 +103,16 @@ static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
      * the end of the function.
      */
 
+    decode_param = u_map_get(req->map_url, "decode");
+    if (decode_param != NULL && rest_decode_parse(decode_param, &decode) != 0)
+    {
+        ulfius_set_empty_body_response(resp, 400);
+        return U_CALLBACK_COMPLETE;
+    }
+
     /* Find requested client */
     name = u_map_get(req->map_url, "name");
-    client = rest_endpoints_find_client(rest->lwm2m->clientList, name);
+    client = rest_endpoints_find_client(shard, name);
     if (client == NULL)
     {
         ulfius_set_empty_body_response(resp, 404);
@@ -116,8 +135,9 @@ static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
         return U_CALLBACK_COMPLETE;
     }
 
-    /* Extract and convert resource path */
+    /* Extract and convert resource path (without query string) */
     strcpy(path, &req->http_url[len - 1]);
+    path[strcspn(path, "?")] = '\0';
 
     if (lwm2m_stringToUri(path, strlen(path), &uri) == 0)
     {
@@ -154,6 +174,8 @@ static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
         }
 
         observe_context->rest = rest;
+        observe_context->shard = shard;
+        observe_context->decode = decode;
         observe_context->response = rest_async_response_new();
         if (observe_context->response == NULL)
         {
@@ -161,7 +183,7 @@ static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
         }
 
         res = lwm2m_observe(
-                  rest->lwm2m, client->internalID, &uri,
+                  shard->lwm2m, client->internalID, &uri,
                   rest_observe_cb, observe_context
               );
         if (res != 0)
@@ -171,10 +193,14 @@ static int rest_subscriptions_put_cb_unsafe(rest_context_t *rest,
 
         rest_list_add(rest->observeList, observe_context->response);
     }
+    else if (decode_param != NULL)
+    {
+        observe_context->decode = decode;
+    }
 
     jresponse = json_object();
     json_object_set_new(jresponse, "async-response-id", json_string(observe_context->response->id));
-    ulfius_set_json_body_response(resp, 202, jresponse);
+    rest_set_body_response(req, resp, 202, jresponse);
     json_decref(jresponse);
 
     return U_CALLBACK_COMPLETE;
@@ -198,16 +224,26 @@ exit:
 int rest_subscriptions_put_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
 {
     rest_context_t *rest = (rest_context_t *)context;
+    rest_shard_t *shard;
     int ret;
 
-    rest_lock(rest);
-    ret = rest_subscriptions_put_cb_unsafe(rest, req, resp);
-    rest_unlock(rest);
+    shard = rest_endpoints_find_shard(rest, u_map_get(req->map_url, "name"));
+    if (shard == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 404);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    rest_shard_lock(shard);
+    ret = rest_subscriptions_put_cb_unsafe(rest, shard, req, resp);
+    rest_shard_unlock(shard);
+
+    rest_shard_wakeup(shard);
 
     return ret;
 }
 
-static int rest_subscriptions_delete_cb_unsafe(rest_context_t *rest,
+static int rest_subscriptions_delete_cb_unsafe(rest_context_t *rest, rest_shard_t *shard,
                                                const ulfius_req_t *req,
                                                ulfius_resp_t *resp)
 {
@@ -231,7 +267,7 @@ static int rest_subscriptions_delete_cb_unsafe(rest_context_t *rest,
 
     /* Find requested client */
     name = u_map_get(req->map_url, "name");
-    client = rest_endpoints_find_client(rest->lwm2m->clientList, name);
+    client = rest_endpoints_find_client(shard, name);
     if (client == NULL)
     {
         ulfius_set_empty_body_response(resp, 404);
@@ -254,8 +290,9 @@ static int rest_subscriptions_delete_cb_unsafe(rest_context_t *rest,
         return U_CALLBACK_COMPLETE;
     }
 
-    /* Extract and convert resource path */
+    /* Extract and convert resource path (without query string) */
     strcpy(path, &req->http_url[len - 1]);
+    path[strcspn(path, "?")] = '\0';
 
     if (lwm2m_stringToUri(path, strlen(path), &uri) == 0)
     {
@@ -290,7 +327,7 @@ static int rest_subscriptions_delete_cb_unsafe(rest_context_t *rest,
 
     // using dummy callback (rest_unobserve_cb), because NULL callback causes segmentation fault
     res = lwm2m_observe_cancel(
-              rest->lwm2m, client->internalID, &uri,
+              shard->lwm2m, client->internalID, &uri,
               rest_unobserve_cb, observe_context
           );
 
@@ -315,11 +352,21 @@ exit:
 int rest_subscriptions_delete_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context)
 {
     rest_context_t *rest = (rest_context_t *)context;
+    rest_shard_t *shard;
     int ret;
 
-    rest_lock(rest);
-    ret = rest_subscriptions_delete_cb_unsafe(rest, req, resp);
-    rest_unlock(rest);
+    shard = rest_endpoints_find_shard(rest, u_map_get(req->map_url, "name"));
+    if (shard == NULL)
+    {
+        ulfius_set_empty_body_response(resp, 404);
+        return U_CALLBACK_COMPLETE;
+    }
+
+    rest_shard_lock(shard);
+    ret = rest_subscriptions_delete_cb_unsafe(rest, shard, req, resp);
+    rest_shard_unlock(shard);
+
+    rest_shard_wakeup(shard);
 
     return ret;
 }
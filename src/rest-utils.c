@@ -17,8 +17,12 @@
  *
  */
 
+#define _GNU_SOURCE // strcasestr()
+
 #include "rest-utils.h"
 
+#include <string.h>
+
 #include "restserver.h"
 
 
@@ -38,3 +42,52 @@ int coap_to_http_status(int status)
     }
 }
 
+
+bool rest_accepts_cbor(const ulfius_req_t *req)
+{
+    const char *accept = u_map_get_case(req->map_header, "Accept");
+
+    return accept != NULL && strcasestr(accept, REST_CONTENT_TYPE_CBOR) != NULL;
+}
+
+void rest_set_cbor_response(ulfius_resp_t *resp, unsigned int status, const rest_cbor_t *cbor)
+{
+    if (rest_cbor_failed(cbor))
+    {
+        ulfius_set_empty_body_response(resp, 500);
+        return;
+    }
+
+    ulfius_set_binary_body_response(resp, status, (const char *)cbor->data, cbor->length);
+    u_map_put(resp->map_header, "Content-Type", REST_CONTENT_TYPE_CBOR);
+}
+
+void rest_set_json_writer_response(ulfius_resp_t *resp, unsigned int status,
+                                   const rest_json_writer_t *writer)
+{
+    if (rest_json_writer_failed(writer))
+    {
+        ulfius_set_empty_body_response(resp, 500);
+        return;
+    }
+
+    ulfius_set_binary_body_response(resp, status, writer->data, writer->length);
+    u_map_put(resp->map_header, "Content-Type", REST_CONTENT_TYPE_JSON);
+}
+
+void rest_set_body_response(const ulfius_req_t *req, ulfius_resp_t *resp, unsigned int status,
+                            const json_t *body)
+{
+    rest_cbor_t cbor;
+
+    if (!rest_accepts_cbor(req))
+    {
+        ulfius_set_json_body_response(resp, status, body);
+        return;
+    }
+
+    rest_cbor_init(&cbor);
+    rest_cbor_json(&cbor, body);
+    rest_set_cbor_response(resp, status, &cbor);
+    rest_cbor_cleanup(&cbor);
+}
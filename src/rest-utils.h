@@ -20,8 +20,62 @@
 #ifndef REST_UTILS_H
 #define REST_UTILS_H
 
+#include <stdbool.h>
+
+#include <jansson.h>
+
+#include "rest-cbor.h"
+#include "rest-json.h"
+
+#define REST_CONTENT_TYPE_JSON "application/json"
+#define REST_CONTENT_TYPE_CBOR "application/cbor"
+
+struct _u_request;
+struct _u_response;
+
 
 int coap_to_http_status(int status);
 
+/**
+ * Checks whether client prefers CBOR response (Accept: application/cbor).
+ *
+ * @param[in]  req  HTTP request
+ *
+ * @return true if response should be encoded as CBOR
+ */
+bool rest_accepts_cbor(const struct _u_request *req);
+
+/**
+ * Sets CBOR response body, or 500 error if the writer failed.
+ *
+ * @param[in]  resp    HTTP response
+ * @param[in]  status  HTTP status code
+ * @param[in]  cbor    Encoded body
+ */
+void rest_set_cbor_response(struct _u_response *resp, unsigned int status,
+                            const rest_cbor_t *cbor);
+
+/**
+ * Sets JSON response body produced by the streaming writer, or 500 error if
+ * the writer failed.
+ *
+ * @param[in]  resp    HTTP response
+ * @param[in]  status  HTTP status code
+ * @param[in]  writer  Writer holding the body
+ */
+void rest_set_json_writer_response(struct _u_response *resp, unsigned int status,
+                                   const rest_json_writer_t *writer);
+
+/**
+ * Sets response body as JSON or CBOR, according to the Accept header.
+ *
+ * @param[in]  req     HTTP request
+ * @param[in]  resp    HTTP response
+ * @param[in]  status  HTTP status code
+ * @param[in]  body    Response body
+ */
+void rest_set_body_response(const struct _u_request *req, struct _u_response *resp,
+                            unsigned int status, const json_t *body);
+
 #endif // REST_UTILS_H
 
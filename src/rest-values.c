@@ -0,0 +1,216 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rest-values.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "rest-base64.h"
+
+// "/65535/65535/65535/65535" and null-terminator
+#define REST_VALUES_PATH_LENGTH 32
+
+
+int rest_decode_parse(const char *string, rest_decode_t *decode)
+{
+    if (strcmp(string, "none") == 0)
+    {
+        *decode = REST_DECODE_NONE;
+    }
+    else if (strcmp(string, "values") == 0)
+    {
+        *decode = REST_DECODE_VALUES;
+    }
+    else if (strcmp(string, "values-only") == 0)
+    {
+        *decode = REST_DECODE_VALUES_ONLY;
+    }
+    else
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static json_t *rest_values_opaque(const uint8_t *data, size_t length)
+{
+    json_t *jvalue;
+    char *buffer;
+
+    buffer = malloc(rest_base64_encoded_length(length) + 1);
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+
+    rest_base64_encode(data, length, buffer);
+    jvalue = json_string(buffer);
+    free(buffer);
+
+    return jvalue;
+}
+
+static json_t *rest_values_leaf(const lwm2m_data_t *data, const char **type)
+{
+    char link[12];
+
+    switch (data->type)
+    {
+    case LWM2M_TYPE_STRING:
+        *type = "string";
+        // Strings which are not valid UTF-8 are reported as opaque
+        return json_stringn((const char *)data->value.asBuffer.buffer,
+                            data->value.asBuffer.length);
+    case LWM2M_TYPE_INTEGER:
+        *type = "integer";
+        return json_integer(data->value.asInteger);
+    case LWM2M_TYPE_FLOAT:
+        *type = "float";
+        return isfinite(data->value.asFloat) ? json_real(data->value.asFloat) : json_null();
+    case LWM2M_TYPE_BOOLEAN:
+        *type = "boolean";
+        return json_boolean(data->value.asBoolean);
+    case LWM2M_TYPE_OBJECT_LINK:
+        *type = "objlink";
+        snprintf(link, sizeof(link), "%u:%u", data->value.asObjLink.objectId,
+                 data->value.asObjLink.objectInstanceId);
+        return json_string(link);
+    default:
+        *type = "opaque";
+        return rest_values_opaque(data->value.asBuffer.buffer, data->value.asBuffer.length);
+    }
+}
+
+static int rest_values_append(json_t *jvalues, const char *prefix, const lwm2m_data_t *data,
+                              size_t count)
+{
+    char path[REST_VALUES_PATH_LENGTH];
+    const char *type;
+    json_t *jvalue;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%u", prefix, data[i].id);
+
+        switch (data[i].type)
+        {
+        case LWM2M_TYPE_OBJECT:
+        case LWM2M_TYPE_OBJECT_INSTANCE:
+        case LWM2M_TYPE_MULTIPLE_RESOURCE:
+            if (rest_values_append(jvalues, path, data[i].value.asChildren.array,
+                                   data[i].value.asChildren.count) != 0)
+            {
+                return -1;
+            }
+            continue;
+        case LWM2M_TYPE_UNDEFINED:
+            continue;
+        default:
+            break;
+        }
+
+        jvalue = rest_values_leaf(&data[i], &type);
+        if (jvalue == NULL && data[i].type == LWM2M_TYPE_STRING)
+        {
+            type = "opaque";
+            jvalue = rest_values_opaque(data[i].value.asBuffer.buffer,
+                                        data[i].value.asBuffer.length);
+        }
+        if (jvalue == NULL)
+        {
+            return -1;
+        }
+
+        json_array_append_new(jvalues, json_pack("{s:s, s:s, s:o}",
+                                                 "path", path, "type", type, "value", jvalue));
+    }
+
+    return 0;
+}
+
+char *rest_values_decode(lwm2m_uri_t *uri, lwm2m_media_type_t format,
+                         const uint8_t *data, size_t length)
+{
+    char prefix[REST_VALUES_PATH_LENGTH];
+    lwm2m_data_t *values = NULL;
+    json_t *jvalues;
+    char *serialized = NULL;
+    int count;
+
+    // Top-level records are instances, resources or a single resource
+    if (LWM2M_URI_IS_SET_INSTANCE(uri))
+    {
+        snprintf(prefix, sizeof(prefix), "/%u/%u", uri->objectId, uri->instanceId);
+    }
+    else
+    {
+        snprintf(prefix, sizeof(prefix), "/%u", uri->objectId);
+    }
+
+    count = lwm2m_data_parse(uri, (uint8_t *)data, length, format, &values);
+    if (count <= 0)
+    {
+        return NULL;
+    }
+
+    jvalues = json_array();
+    if (jvalues != NULL && rest_values_append(jvalues, prefix, values, count) == 0)
+    {
+        serialized = json_dumps(jvalues, JSON_COMPACT);
+    }
+
+    json_decref(jvalues);
+    lwm2m_data_free(count, values);
+
+    return serialized;
+}
+
+void rest_values_set(rest_async_response_t *response, rest_decode_t decode, lwm2m_uri_t *uri,
+                     lwm2m_media_type_t format, const uint8_t *data, size_t length)
+{
+    char *values;
+
+    if ((decode != REST_DECODE_VALUES && decode != REST_DECODE_VALUES_ONLY) || data == NULL)
+    {
+        return;
+    }
+
+    values = rest_values_decode(uri, format, data, length);
+    if (values == NULL)
+    {
+        // Consumer still gets the raw payload
+        return;
+    }
+
+    free((void *)response->values);
+    response->values = values;
+
+    if (decode == REST_DECODE_VALUES_ONLY)
+    {
+        free((void *)response->payload);
+        response->payload = NULL;
+        response->payload_length = 0;
+    }
+}
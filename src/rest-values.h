@@ -0,0 +1,78 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REST_VALUES_H
+#define REST_VALUES_H
+
+#include <liblwm2m.h>
+
+#include "rest-core-types.h"
+
+/*
+ * Whether async response payloads are decoded into typed values. Requests
+ * without explicit mode follow the mode of the notification callback.
+ */
+typedef enum
+{
+    REST_DECODE_DEFAULT,
+    REST_DECODE_NONE,
+    REST_DECODE_VALUES,
+    REST_DECODE_VALUES_ONLY,
+} rest_decode_t;
+
+/**
+ * Parses decode mode name ("none", "values" or "values-only").
+ *
+ * @param[in]  string  Mode name
+ * @param[out] decode  Parsed mode
+ *
+ * @return 0 on success, -1 if the name is not valid
+ */
+int rest_decode_parse(const char *string, rest_decode_t *decode);
+
+/**
+ * Decodes LwM2M payload (TLV, JSON, text or opaque) into serialized JSON
+ * array of {"path", "type", "value"} objects, one for each resource
+ * (instance).
+ *
+ * @param[in]  uri     Requested LwM2M path
+ * @param[in]  format  Payload content format
+ * @param[in]  data    Payload
+ * @param[in]  length  Length of the payload
+ *
+ * @return Serialized JSON array (free with free()) or NULL if payload can not be decoded
+ */
+char *rest_values_decode(lwm2m_uri_t *uri, lwm2m_media_type_t format,
+                         const uint8_t *data, size_t length);
+
+/**
+ * Adds decoded values to async response according to decode mode, payload
+ * is dropped in values-only mode (if it could be decoded).
+ *
+ * @param[in]  response  Async response with payload already set
+ * @param[in]  decode    Resolved decode mode
+ * @param[in]  uri       Requested LwM2M path
+ * @param[in]  format    Payload content format
+ * @param[in]  data      Payload (may be NULL)
+ * @param[in]  length    Length of the payload
+ */
+void rest_values_set(rest_async_response_t *response, rest_decode_t decode, lwm2m_uri_t *uri,
+                     lwm2m_media_type_t format, const uint8_t *data, size_t length);
+
+#endif // REST_VALUES_H
@@ -21,12 +21,13 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
+#include <curl/curl.h>
 #include <liblwm2m.h>
 #include <ulfius.h>
 
-#include "connection.h"
 #include "restserver.h"
 #include "logging.h"
 #include "settings.h"
@@ -123,33 +124,66 @@ void client_monitor_cb(uint16_t clientID, lwm2m_uri_t *uriP, int status,
                        lwm2m_media_type_t format, uint8_t *data, int dataLength,
                        void *userData)
 {
-    rest_context_t *rest = (rest_context_t *)userData;
-    lwm2m_context_t *lwm2m = rest->lwm2m;
+    rest_shard_t *shard = (rest_shard_t *)userData;
+    rest_context_t *rest = shard->rest;
+    lwm2m_context_t *lwm2m = shard->lwm2m;
     lwm2m_client_t *client;
     lwm2m_client_object_t *obj;
     lwm2m_list_t *ins;
+    rest_notification_source_t source;
 
-    client = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)lwm2m->clientList, clientID);
+    /*
+     * Deregistered client is already unlinked from the client list (but not
+     * yet freed) when monitor is called, registry still references it. Only
+     * a new registration has to be looked up in the client list.
+     */
+    client = client_registry_find_id(&shard->clients, clientID);
+    if (client == NULL && status == COAP_201_CREATED)
+    {
+        client = (lwm2m_client_t *)lwm2m_list_find((lwm2m_list_t *)lwm2m->clientList, clientID);
+    }
+
+    if (client == NULL)
+    {
+        log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_INFO,
+                           "[MONITOR] Client %d status update %d.\n", clientID, status);
+        return;
+    }
+
+    rest_notification_source_set(&source, client, NULL);
 
     switch (status)
     {
     case COAP_201_CREATED:
     case COAP_204_CHANGED:
+        if (client_registry_add(&shard->clients, client) != 0
+            || client_publisher_update(&shard->publisher, client) != 0)
+        {
+            log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_ERROR,
+                               "[MONITOR] Failed to index client %d!\n", clientID);
+        }
+
+        connection_table_claim(&shard->connections, clientID, client->sessionH, lwm2m_gettime());
+
         if (status == COAP_201_CREATED)
         {
+            rest_endpoints_set_shard(rest, client->name, shard);
+
             rest_notif_registration_t *regNotif = rest_notif_registration_new();
 
             if (regNotif != NULL)
             {
                 rest_notif_registration_set(regNotif, client->name);
-                rest_notify_registration(rest, regNotif);
+                rest_notify_registration(rest, regNotif, &source);
             }
             else
             {
-                log_message(LOG_LEVEL_ERROR, "[MONITOR] Failed to allocate registration notification!\n");
+                log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_ERROR,
+                                   "[MONITOR] Failed to allocate registration notification!\n");
             }
 
-            log_message(LOG_LEVEL_INFO, "[MONITOR] Client %d registered.\n", clientID);
+            log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_INFO,
+                               "[MONITOR] Client %d registered.\n", clientID);
         }
         else
         {
@@ -158,105 +192,79 @@ void client_monitor_cb(uint16_t clientID, lwm2m_uri_t *uriP, int status,
             if (updateNotif != NULL)
             {
                 rest_notif_update_set(updateNotif, client->name);
-                rest_notify_update(rest, updateNotif);
+                rest_notify_update(rest, updateNotif, &source);
             }
             else
             {
-                log_message(LOG_LEVEL_ERROR, "[MONITOR] Failed to allocate update notification!\n");
+                log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_ERROR,
+                                   "[MONITOR] Failed to allocate update notification!\n");
             }
 
-            log_message(LOG_LEVEL_INFO, "[MONITOR] Client %d updated.\n", clientID);
+            log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_INFO,
+                               "[MONITOR] Client %d updated.\n", clientID);
         }
 
-        log_message(LOG_LEVEL_DEBUG, "\tname: '%s'\n", client->name);
-        log_message(LOG_LEVEL_DEBUG, "\tbind: '%s'\n", binding_to_string(client->binding));
-        log_message(LOG_LEVEL_DEBUG, "\tlifetime: %d\n", client->lifetime);
-        log_message(LOG_LEVEL_DEBUG, "\tobjects: ");
-        for (obj = client->objectList; obj != NULL; obj = obj->next)
+        if (log_module_enabled(LOG_MODULE_MONITOR, LOG_LEVEL_DEBUG))
         {
-            if (obj->instanceList == NULL)
-            {
-                log_message(LOG_LEVEL_DEBUG, "/%d, ", obj->id);
-            }
-            else
+            logging_write(LOG_LEVEL_DEBUG, "\tname: '%s'\n", client->name);
+            logging_write(LOG_LEVEL_DEBUG, "\tbind: '%s'\n", binding_to_string(client->binding));
+            logging_write(LOG_LEVEL_DEBUG, "\tlifetime: %d\n", client->lifetime);
+            logging_write(LOG_LEVEL_DEBUG, "\tobjects: ");
+            for (obj = client->objectList; obj != NULL; obj = obj->next)
             {
-                for (ins = obj->instanceList; ins != NULL; ins = ins->next)
+                if (obj->instanceList == NULL)
+                {
+                    logging_write(LOG_LEVEL_DEBUG, "/%d, ", obj->id);
+                }
+                else
                 {
-                    log_message(LOG_LEVEL_DEBUG, "/%d/%d, ", obj->id, ins->id);
+                    for (ins = obj->instanceList; ins != NULL; ins = ins->next)
+                    {
+                        logging_write(LOG_LEVEL_DEBUG, "/%d/%d, ", obj->id, ins->id);
+                    }
                 }
             }
+            logging_write(LOG_LEVEL_DEBUG, "\n");
         }
-        log_message(LOG_LEVEL_DEBUG, "\n");
         break;
 
     case COAP_202_DELETED:
     {
+        connection_table_release(&shard->connections, clientID, lwm2m_gettime());
+        rest_endpoints_unset_shard(rest, client->name, shard);
+        client_registry_remove(&shard->clients, clientID);
+        client_publisher_remove(&shard->publisher, clientID);
+
         rest_notif_deregistration_t *deregNotif = rest_notif_deregistration_new();
 
         if (deregNotif != NULL)
         {
             rest_notif_deregistration_set(deregNotif, client->name);
-            rest_notify_deregistration(rest, deregNotif);
+            rest_notify_deregistration(rest, deregNotif, &source);
         }
         else
         {
-            log_message(LOG_LEVEL_ERROR, "[MONITOR] Failed to allocate deregistration notification!\n");
+            log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_ERROR,
+                               "[MONITOR] Failed to allocate deregistration notification!\n");
         }
 
-        log_message(LOG_LEVEL_INFO, "[MONITOR] Client %d deregistered.\n", clientID);
+        log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_INFO,
+                           "[MONITOR] Client %d deregistered.\n", clientID);
         break;
     }
     default:
-        log_message(LOG_LEVEL_INFO, "[MONITOR] Client %d status update %d.\n", clientID, status);
+        log_module_message(LOG_MODULE_MONITOR, LOG_LEVEL_INFO,
+                           "[MONITOR] Client %d status update %d.\n", clientID, status);
         break;
     }
 }
 
-int socket_receive(lwm2m_context_t *lwm2m, int sock)
-{
-    int nbytes;
-    uint8_t buf[1500];
-    struct sockaddr_storage addr;
-    socklen_t addrLen = sizeof(addr);
-    connection_t *con;
-    static connection_t *connectionList = NULL;
-
-    memset(buf, 0, sizeof(buf));
-
-    nbytes = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&addr, &addrLen);
-
-    if (nbytes < 0)
-    {
-        log_message(LOG_LEVEL_FATAL, "recvfrom() error: %d\n", nbytes);
-        return -1;
-    }
-
-    con = connection_find(connectionList, &addr, addrLen);
-    if (con == NULL)
-    {
-        con = connection_new_incoming(connectionList, sock, (struct sockaddr *)&addr, addrLen);
-        if (con)
-        {
-            connectionList = con;
-        }
-    }
-
-    if (con)
-    {
-        lwm2m_handle_packet(lwm2m, buf, nbytes, con);
-    }
-
-    return 0;
-}
-
 int main(int argc, char *argv[])
 {
-    int sock;
-    fd_set readfds;
-    struct timeval tv;
-    int res;
+    int *socks;
+    sigset_t signal_mask, previous_signal_mask;
     rest_context_t rest;
-    char coap_port[6];
+    size_t i;
 
     static settings_t settings =
     {
@@ -272,22 +280,52 @@ int main(int argc, char *argv[])
                     .algorithm = JWT_ALG_HS512,
                     .secret_key = NULL,
                     .secret_key_length = 32,
-                    .users_list = NULL,
+                    .users = NULL,
+                    .dummy_hash = NULL,
                     .expiration_time = 3600,
+                    .cache_size = JWT_CACHE_SIZE,
+                    .cache = NULL,
                 },
             },
         },
         .coap = {
             .port = 5555,
+            .connection_timeout = 300,
+            .shards = 1,
         },
         .logging = {
             .level = LOG_LEVEL_WARN,
+            .module_levels_set = 0,
             .timestamp = false,
             .human_readable_timestamp = false,
+            .async = true,
+            .overflow_policy = LOGGING_OVERFLOW_DROP,
+            .file = NULL,
+            .file_size = LOGGING_FILE_SIZE,
+            .file_count = LOGGING_FILE_COUNT,
+        },
+        .notifications = {
+            .journal = NULL,
+            .journal_segment_size = REST_JOURNAL_SEGMENT_SIZE,
+            .journal_sync_interval = REST_JOURNAL_SYNC_INTERVAL,
+            .memory_limit = REST_NOTIFICATION_LOG_MEMORY_LIMIT,
+            .count_limit = REST_NOTIFICATION_LOG_COUNT_LIMIT,
+            .overflow_policy = REST_NOTIFICATION_POLICY_SPILL,
+            .spill_directory = "/tmp",
+            .spill_limit = REST_NOTIFICATION_LOG_SPILL_LIMIT,
+            .callback_pool_size = REST_HTTP_POOL_SIZE,
+            .callback_idle_timeout = REST_HTTP_POOL_IDLE_TIMEOUT,
+            .max_batch_records = REST_CALLBACK_BATCH_RECORDS,
+            .max_batch_bytes = REST_CALLBACK_BATCH_BYTES,
+            .max_linger_ms = REST_CALLBACK_LINGER_MS,
+            .callback_max_retries = REST_DELIVERY_MAX_RETRIES,
+            .callback_dead_letter_limit = REST_DELIVERY_DEAD_LETTER_LIMIT,
+            .callback_queue_limit = REST_DELIVERY_QUEUE_LIMIT,
+            .stream_buffer_size = REST_STREAM_BUFFER_SIZE,
         },
     };
 
-    settings.http.security.jwt.users_list = rest_list_new();
+    settings.http.security.jwt.users = rest_hash_new();
     settings.http.security.jwt.secret_key = (unsigned char *) malloc(
                                                 settings.http.security.jwt.secret_key_length * sizeof(unsigned char));
     rest_get_random(settings.http.security.jwt.secret_key,
@@ -298,31 +336,96 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    logging_init(&settings.logging);
-
     init_signals();
 
+    /*
+     * Termination signals are handled by the main thread only, every other
+     * thread inherits blocked signal mask.
+     */
+    sigemptyset(&signal_mask);
+    sigaddset(&signal_mask, SIGINT);
+    sigaddset(&signal_mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signal_mask, &previous_signal_mask);
+
+    // Not thread-safe, must be done before any thread creates curl handles
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK)
+    {
+        fprintf(stderr, "Failed to initialize libcurl!\n");
+        return -1;
+    }
+
+    if (logging_init(&settings.logging) != 0)
+    {
+        return -1;
+    }
+
     rest_init(&rest);
 
+    if (rest_notification_log_set_limits(rest.notificationLog,
+                                         settings.notifications.memory_limit,
+                                         settings.notifications.count_limit,
+                                         settings.notifications.overflow_policy,
+                                         settings.notifications.spill_directory,
+                                         settings.notifications.spill_limit) != 0)
+    {
+        log_message(LOG_LEVEL_FATAL, "Failed to create notification overflow file!\n");
+        return -1;
+    }
+
+    if (rest_delivery_set_pool_limits(rest.delivery, settings.notifications.callback_pool_size,
+                                      settings.notifications.callback_idle_timeout) != 0)
+    {
+        log_message(LOG_LEVEL_FATAL, "Failed to set callback connection pool limits!\n");
+        return -1;
+    }
+
+    rest_set_callback_batching(&rest, settings.notifications.max_batch_records,
+                               settings.notifications.max_batch_bytes,
+                               settings.notifications.max_linger_ms);
+    rest_delivery_set_retry_limits(rest.delivery, settings.notifications.callback_max_retries,
+                                   settings.notifications.callback_dead_letter_limit);
+    rest_set_callback_queue_limit(&rest, settings.notifications.callback_queue_limit);
+    rest.streamBufferSize = settings.notifications.stream_buffer_size;
+
+    if (settings.notifications.journal != NULL
+        && rest_notifications_journal_open(&rest, settings.notifications.journal,
+                                           settings.notifications.journal_segment_size,
+                                           settings.notifications.journal_sync_interval) != 0)
+    {
+        log_message(LOG_LEVEL_FATAL, "Failed to open notification journal!\n");
+        return -1;
+    }
+
     /* Socket section */
-    snprintf(coap_port, sizeof(coap_port), "%d", settings.coap.port);
-    log_message(LOG_LEVEL_INFO, "Creating coap socket on port %s\n", coap_port);
-    sock = create_socket(coap_port, AF_INET6);
-    if (sock < 0)
+    log_message(LOG_LEVEL_INFO, "Creating %zu coap socket(s) on port %d\n",
+                settings.coap.shards, settings.coap.port);
+    socks = malloc(settings.coap.shards * sizeof(int));
+    if (socks == NULL || rest_shard_create_sockets(socks, settings.coap.shards,
+                                                   settings.coap.port) != 0)
     {
         log_message(LOG_LEVEL_FATAL, "Failed to create socket!\n");
         return -1;
     }
 
     /* Server section */
-    rest.lwm2m = lwm2m_init(NULL);
-    if (rest.lwm2m == NULL)
+    rest.shards = calloc(settings.coap.shards, sizeof(rest_shard_t));
+    if (rest.shards == NULL)
     {
-        log_message(LOG_LEVEL_FATAL, "Failed to create LwM2M server!\n");
+        log_message(LOG_LEVEL_FATAL, "Failed to allocate LwM2M server shards!\n");
         return -1;
     }
 
-    lwm2m_set_monitoring_callback(rest.lwm2m, client_monitor_cb, &rest);
+    for (i = 0; i < settings.coap.shards; i++)
+    {
+        if (rest_shard_init(&rest.shards[i], &rest, i, socks[i],
+                            settings.coap.connection_timeout, client_monitor_cb) != 0)
+        {
+            log_message(LOG_LEVEL_FATAL, "Failed to create LwM2M server!\n");
+            return -1;
+        }
+        rest.shardCount++;
+    }
+    free(socks);
 
     /* REST server section */
     struct _u_instance instance;
@@ -356,8 +459,24 @@ int main(int argc, char *argv[])
                                &rest_notifications_put_callback_cb, &rest);
     ulfius_add_endpoint_by_val(&instance, "DELETE", "/notification/callback", NULL, 10,
                                &rest_notifications_delete_callback_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/notification/callbacks", NULL, 10,
+                               &rest_notifications_get_callbacks_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/notification/callbacks/:name", NULL, 10,
+                               &rest_notifications_get_named_callback_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "PUT", "/notification/callbacks/:name", NULL, 10,
+                               &rest_notifications_put_named_callback_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "DELETE", "/notification/callbacks/:name", NULL, 10,
+                               &rest_notifications_delete_named_callback_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/notification/dead-letters", NULL, 10,
+                               &rest_notifications_get_dead_letters_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "POST", "/notification/dead-letters/replay", NULL, 10,
+                               &rest_notifications_replay_dead_letters_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "DELETE", "/notification/dead-letters", NULL, 10,
+                               &rest_notifications_delete_dead_letters_cb, &rest);
     ulfius_add_endpoint_by_val(&instance, "GET", "/notification/pull", NULL, 10,
                                &rest_notifications_pull_cb, &rest);
+    ulfius_add_endpoint_by_val(&instance, "GET", "/notification/stream", NULL, 10,
+                               &rest_notifications_stream_cb, &rest);
 
     // Subscriptions
     ulfius_add_endpoint_by_val(&instance, "PUT", "/subscriptions", ":name/*", 10,
@@ -365,6 +484,13 @@ int main(int argc, char *argv[])
     ulfius_add_endpoint_by_val(&instance, "DELETE", "/subscriptions", ":name/*", 10,
                                &rest_subscriptions_delete_cb, &rest);
 
+    // Metrics
+    ulfius_add_endpoint_by_val(&instance, "GET", "/metrics", NULL, 10, &rest_metrics_cb, NULL);
+
+    // Logging
+    ulfius_add_endpoint_by_val(&instance, "GET", "/logging", NULL, 10, &rest_logging_get_cb, NULL);
+    ulfius_add_endpoint_by_val(&instance, "PUT", "/logging", NULL, 10, &rest_logging_put_cb, NULL);
+
     // Version
     ulfius_add_endpoint_by_val(&instance, "GET", "/version", NULL, 1, &rest_version_cb, NULL);
 
@@ -412,7 +538,7 @@ int main(int argc, char *argv[])
 
     if (settings.http.security.jwt.initialised)
     {
-        if (settings.http.security.jwt.users_list->head == NULL)
+        if (settings.http.security.jwt.users->count == 0)
         {
             log_message(LOG_LEVEL_WARN, "JWT is initialised but no users are configured properly!\n");
         }
@@ -423,56 +549,45 @@ int main(int argc, char *argv[])
     }
 
     /* Main section */
-    while (!restserver_quit)
+    for (i = 0; i < rest.shardCount; i++)
     {
-        FD_ZERO(&readfds);
-        FD_SET(sock, &readfds);
-
-        tv.tv_sec = 5;
-        tv.tv_usec = 0;
-
-        rest_lock(&rest);
-        res = lwm2m_step(rest.lwm2m, &tv.tv_sec);
-        if (res)
-        {
-            log_message(LOG_LEVEL_ERROR, "lwm2m_step() error: %d\n", res);
-        }
-
-        res = rest_step(&rest, &tv);
-        if (res)
+        if (rest_shard_start(&rest.shards[i]) != 0)
         {
-            log_message(LOG_LEVEL_ERROR, "rest_step() error: %d\n", res);
-        }
-        rest_unlock(&rest);
-
-        res = select(FD_SETSIZE, &readfds, NULL, NULL, &tv);
-        if (res < 0)
-        {
-            if (errno == EINTR)
-            {
-                continue;
-            }
-
-            log_message(LOG_LEVEL_ERROR, "select() error: %d\n", res);
+            restserver_quit = 1;
+            break;
         }
+    }
 
-        if (FD_ISSET(sock, &readfds))
-        {
-            rest_lock(&rest);
-            socket_receive(rest.lwm2m, sock);
-            rest_unlock(&rest);
-        }
+    while (!restserver_quit)
+    {
+        sigsuspend(&previous_signal_mask);
+    }
 
+    for (i = 0; i < rest.shardCount; i++)
+    {
+        rest_shard_stop(&rest.shards[i]);
     }
 
+    // Stream readers would otherwise keep their connections open until the next keep-alive
+    rest_notifications_close_streams(&rest);
     ulfius_stop_framework(&instance);
     ulfius_clean_instance(&instance);
 
-    lwm2m_close(rest.lwm2m);
+    for (i = 0; i < rest.shardCount; i++)
+    {
+        rest_shard_cleanup(&rest.shards[i]);
+    }
+    free(rest.shards);
+    rest.shards = NULL;
+    rest.shardCount = 0;
+
     rest_cleanup(&rest);
+    curl_global_cleanup();
 
     jwt_cleanup(&settings.http.security.jwt);
 
+    logging_cleanup();
+
     return 0;
 }
 
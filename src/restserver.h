@@ -24,28 +24,57 @@
 #include <ulfius.h>
 
 #include "http_codes.h"
+#include "rest-callbacks.h"
 #include "rest-core-types.h"
+#include "rest-delivery.h"
+#include "rest-hash.h"
+#include "rest-journal.h"
+#include "rest-notification-log.h"
+#include "rest-shard.h"
+#include "rest-stream.h"
 #include "rest-utils.h"
+#include "rest-values.h"
 
 
 typedef struct _u_request ulfius_req_t;
 typedef struct _u_response ulfius_resp_t;
 
-typedef struct
+/*
+ * The mutex protects notification, callback and endpoint directory state,
+ * while LwM2M contexts are protected by their shard locks. When both are
+ * needed, shard lock must be taken first.
+ */
+typedef struct rest_context_t
 {
     pthread_mutex_t mutex;
 
-    lwm2m_context_t *lwm2m;
+    rest_shard_t *shards;
+    size_t shardCount;
+
+    // rest-endpoints
+    rest_hash_t *endpointShards;
+    pthread_rwlock_t endpointShardsLock;
 
     // rest-core
     json_t *callback;
+    rest_decode_t callbackDecode; // atomic, read outside of rest_lock
+    bool callbackCbor;
+    size_t callbackBatchRecords;
+    size_t callbackBatchBytes;
+    int64_t callbackLinger;
+    int64_t callbackBatchStart;
+    size_t callbackQueueLimit;
+    rest_delivery_t *delivery;
+    rest_callback_t *callbacks;
+    size_t callbackCount;
 
     // rest-notifications
-    rest_list_t *registrationList;
-    rest_list_t *updateList;
-    rest_list_t *deregistrationList;
+    rest_notification_log_t *notificationLog;
+    rest_journal_t *journal;
     rest_list_t *timeoutList;
-    rest_list_t *asyncResponseList;
+    rest_stream_t *streams;
+    size_t streamCount;
+    size_t streamBufferSize;
 
     // rest-resources
     rest_list_t *pendingResponseList;
@@ -54,7 +83,11 @@ typedef struct
     rest_list_t *observeList;
 } rest_context_t;
 
-lwm2m_client_t *rest_endpoints_find_client(lwm2m_client_t *list, const char *name);
+lwm2m_client_t *rest_endpoints_find_client(rest_shard_t *shard, const char *name);
+
+rest_shard_t *rest_endpoints_find_shard(rest_context_t *rest, const char *name);
+void rest_endpoints_set_shard(rest_context_t *rest, const char *name, rest_shard_t *shard);
+void rest_endpoints_unset_shard(rest_context_t *rest, const char *name, rest_shard_t *shard);
 
 int rest_endpoints_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
 
@@ -63,13 +96,85 @@ int rest_endpoints_name_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *c
 int rest_resources_rwe_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
 
 
-void rest_notify_registration(rest_context_t *rest, rest_notif_registration_t *reg);
-void rest_notify_update(rest_context_t *rest, rest_notif_update_t *update);
-void rest_notify_deregistration(rest_context_t *rest, rest_notif_deregistration_t *dereg);
+void rest_notify_registration(rest_context_t *rest, rest_notif_registration_t *reg,
+                              const rest_notification_source_t *source);
+void rest_notify_update(rest_context_t *rest, rest_notif_update_t *update,
+                        const rest_notification_source_t *source);
+void rest_notify_deregistration(rest_context_t *rest, rest_notif_deregistration_t *dereg,
+                                const rest_notification_source_t *source);
 void rest_notify_timeout(rest_context_t *rest, rest_notif_timeout_t *timeout);
-void rest_notify_async_response(rest_context_t *rest, rest_notif_async_response_t *resp);
+void rest_notify_async_response(rest_context_t *rest, rest_notif_async_response_t *resp,
+                                const rest_notification_source_t *source);
+void rest_notify_observation(rest_context_t *rest, rest_notif_async_response_t *resp,
+                             const rest_notification_source_t *source);
+
+rest_decode_t rest_notifications_decode(rest_context_t *rest, rest_decode_t decode);
+
+#define REST_NOTIFICATIONS_PULL_LIMIT 100
+#define REST_NOTIFICATIONS_PULL_LIMIT_MAX 1000
+
+int rest_notifications_journal_open(rest_context_t *rest, const char *directory,
+                                    size_t segment_size, int sync_interval);
+
+/**
+ * Finds the end of the next callback batch, which starts with the oldest
+ * pending notification and is bounded by the number of notifications and
+ * by their approximate serialized size.
+ *
+ * @param[in]  rest         Pointer to the REST context
+ * @param[in]  max_records  Maximum number of notifications in the batch
+ * @param[in]  max_bytes    Maximum approximate size of the batch
+ * @param[out] full         Set to true if the batch reached one of the limits
+ *
+ * @return Sequence number of the first notification after the batch
+ */
+uint64_t rest_notifications_batch_end(rest_context_t *rest, size_t max_records, size_t max_bytes,
+                                      bool *full);
+
+/**
+ * Writes pending notifications up to (excluding) the given sequence number,
+ * grouped by type.
+ *
+ * @param[in]  rest    Pointer to the REST context
+ * @param[in]  end     Sequence number of the first notification not to write
+ * @param[in]  writer  Output writer
+ */
+void rest_notifications_json(rest_context_t *rest, uint64_t end, rest_json_writer_t *writer);
+
+void rest_notifications_cbor(rest_context_t *rest, uint64_t end, rest_cbor_t *cbor);
+
+/**
+ * Writes a single notification, the same way it appears in callback batches
+ * (or in cursor based pull, if with_seq is set).
+ *
+ * @param[in]  writer        Output writer
+ * @param[in]  notification  Notification (with data)
+ * @param[in]  with_seq      Whether sequence number and type are included
+ */
+void rest_notification_to_json(rest_json_writer_t *writer, const rest_notification_t *notification,
+                               bool with_seq);
+void rest_notification_to_cbor(rest_cbor_t *cbor, const rest_notification_t *notification,
+                               bool with_seq);
+
+/**
+ * Returns name of the batch group of notifications of the given type
+ * (e.g. "registrations").
+ *
+ * @param[in]  type  Notification type
+ *
+ * @return Group name
+ */
+const char *rest_notification_group(rest_notification_type_t type);
 
-json_t *rest_notifications_json(rest_context_t *rest);
+/**
+ * Parses notification type name (e.g. "reg-update").
+ *
+ * @param[in]  string  Type name
+ * @param[out] type    Parsed type
+ *
+ * @return 0 on success, -1 if the name is not valid
+ */
+int rest_notification_type_parse(const char *string, rest_notification_type_t *type);
 
 void rest_notifications_clear(rest_context_t *rest);
 
@@ -77,21 +182,78 @@ int rest_notifications_get_callback_cb(const ulfius_req_t *req, ulfius_resp_t *r
 int rest_notifications_put_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
 int rest_notifications_delete_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
                                           void *context);
+int rest_notifications_get_callbacks_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                        void *context);
+int rest_notifications_get_named_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                             void *context);
+int rest_notifications_put_named_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                             void *context);
+int rest_notifications_delete_named_callback_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                                void *context);
+int rest_notifications_get_dead_letters_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                           void *context);
+int rest_notifications_replay_dead_letters_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                              void *context);
+int rest_notifications_delete_dead_letters_cb(const ulfius_req_t *req, ulfius_resp_t *resp,
+                                              void *context);
 
 
 int rest_notifications_pull_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
+int rest_notifications_stream_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
+
+/**
+ * Ends every open notification stream, must be called before the HTTP
+ * server is stopped.
+ *
+ * @param[in]  rest  REST context
+ */
+void rest_notifications_close_streams(rest_context_t *rest);
 
 int rest_subscriptions_put_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
 int rest_subscriptions_delete_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
 
+int rest_metrics_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
+
+int rest_logging_get_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
+int rest_logging_put_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
+
 int rest_version_cb(const ulfius_req_t *req, ulfius_resp_t *resp, void *context);
 
 void rest_init(rest_context_t *rest);
 void rest_cleanup(rest_context_t *rest);
 int rest_step(rest_context_t *rest, struct timeval *tv);
 
+#define REST_CALLBACK_BATCH_RECORDS 1000
+#define REST_CALLBACK_BATCH_BYTES   (1024 * 1024)
+#define REST_CALLBACK_LINGER_MS     0
+#define REST_CALLBACK_BUSY_POLL_MS  100
+
+/**
+ * Sets limits of notification batches sent to the callback.
+ *
+ * @param[in]  rest           Pointer to the REST context
+ * @param[in]  max_records    Maximum number of notifications in a batch
+ * @param[in]  max_bytes      Maximum approximate size of a batch (uncompressed)
+ * @param[in]  max_linger_ms  Time a batch which is not full waits for more notifications
+ */
+void rest_set_callback_batching(rest_context_t *rest, size_t max_records, size_t max_bytes,
+                                int max_linger_ms);
+
+/**
+ * Sets number of batches queued for every callback. Notifications for a
+ * callback whose queue is full (or whose receiver is failing) are held back:
+ * the default callback leaves them pending in the notification log, named
+ * callbacks drop events once their open batch is full.
+ *
+ * @param[in]  rest         Pointer to the REST context
+ * @param[in]  queue_limit  Number of queued batches
+ */
+void rest_set_callback_queue_limit(rest_context_t *rest, size_t queue_limit);
+
 void rest_lock(rest_context_t *rest);
 void rest_unlock(rest_context_t *rest);
 
+void rest_wakeup(rest_context_t *rest);
+
 #endif // RESTSERVER_H
 
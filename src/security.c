@@ -17,11 +17,13 @@
  *
  */
 
+#define LOG_MODULE LOG_MODULE_JWT
+
+#include <crypt.h>
 #include <string.h>
 #include <stdio.h>
 #include <malloc.h>
 #include <jansson.h>
-#include <regex.h>
 
 #include "security.h"
 #include "logging.h"
@@ -84,8 +86,11 @@ user_t *security_user_new(void)
     if (user == NULL)
     {
         log_message(LOG_LEVEL_FATAL, "[JWT] Failed to allocate user memory");
+        return NULL;
     }
 
+    user_scope_init(&user->scope, NULL, 0);
+
     return user;
 }
 
@@ -94,31 +99,152 @@ void security_user_delete(user_t *user)
     if (user->name)
     {
         memset(user->name, 0, strnlen(user->name, J_MAX_LENGTH_USER_NAME));
+        free(user->name);
     }
 
     if (user->secret)
     {
         memset(user->secret, 0, strnlen(user->secret, J_MAX_LENGTH_USER_SECRET));
+        free(user->secret);
     }
 
+    free(user->secret_hash);
+
     if (user->j_scope_list)
     {
         json_decref(user->j_scope_list);
         user->j_scope_list = NULL;
     }
 
+    user_scope_cleanup(&user->scope);
+
     free(user);
 }
 
-int security_user_set(user_t *user, const char *name, const char *secret, json_t *scope)
+int security_user_set(user_t *user, const char *name, const char *secret, const char *secret_hash,
+                      json_t *scope)
 {
+    const char **patterns;
+    size_t index;
+    json_t *j_scope_pattern;
+    int result;
+
     user->name = strdup(name);
-    user->secret = strdup(secret);
+    user->secret = secret != NULL ? strdup(secret) : NULL;
+    user->secret_hash = secret_hash != NULL ? strdup(secret_hash) : NULL;
     user->j_scope_list = json_deep_copy(scope);
 
+    patterns = calloc(json_array_size(scope) + 1, sizeof(char *));
+    if (patterns == NULL)
+    {
+        return -1;
+    }
+
+    json_array_foreach(scope, index, j_scope_pattern)
+    {
+        patterns[index] = json_string_value(j_scope_pattern);
+    }
+
+    // Patterns are compiled once here instead of on every request
+    user_scope_cleanup(&user->scope);
+    result = user_scope_init(&user->scope, patterns, json_array_size(scope));
+    if (result > 0)
+    {
+        log_message(LOG_LEVEL_ERROR, "[JWT] User \"%s\" scope \"%s\" is not a valid pattern\n",
+                    name, patterns[result - 1]);
+    }
+    free(patterns);
+
+    return result == 0 ? 0 : -1;
+}
+
+int security_user_add(jwt_settings_t *settings, user_t *user)
+{
+    size_t name_length = strlen(user->name);
+
+    if (rest_hash_get(settings->users, user->name, name_length) != NULL
+        || rest_hash_put(settings->users, user->name, name_length, user) != 0)
+    {
+        return -1;
+    }
+
+    // Users are kept until jwt_cleanup(), so the hash outlives its use
+    if (settings->dummy_hash == NULL && user->secret_hash != NULL)
+    {
+        settings->dummy_hash = user->secret_hash;
+    }
+
     return 0;
 }
 
+user_t *security_user_find(jwt_settings_t *settings, const char *name)
+{
+    return rest_hash_get(settings->users, name, strlen(name));
+}
+
+/*
+ * Duration depends only on the length of the given secret, so the content of
+ * the expected one can not be guessed byte by byte.
+ */
+static bool security_secret_equal(const char *secret, const char *expected)
+{
+    size_t i, length = strlen(secret), expected_length = strlen(expected);
+    volatile unsigned char difference = (length != expected_length);
+
+    for (i = 0; i < length; i++)
+    {
+        difference |= (unsigned char)secret[i]
+                      ^ (unsigned char)expected[i < expected_length ? i : expected_length];
+    }
+
+    return difference == 0;
+}
+
+bool security_user_check_secret(user_t *user, const char *secret)
+{
+    struct crypt_data *data;
+    const char *hashed;
+    bool result;
+
+    if (user->secret_hash == NULL)
+    {
+        return user->secret != NULL && security_secret_equal(secret, user->secret);
+    }
+
+    data = calloc(1, sizeof(struct crypt_data));
+    if (data == NULL)
+    {
+        return false;
+    }
+
+    hashed = crypt_r(secret, user->secret_hash, data);
+    result = hashed != NULL && hashed[0] != '*' && security_secret_equal(hashed, user->secret_hash);
+
+    explicit_bzero(data, sizeof(struct crypt_data));
+    free(data);
+
+    return result;
+}
+
+user_t *security_user_authenticate(jwt_settings_t *settings, const char *name,
+                                   const char *secret)
+{
+    user_t *user = security_user_find(settings, name);
+    user_t dummy =
+    {
+        .secret = "",
+        .secret_hash = (char *)settings->dummy_hash,
+    };
+
+    if (user == NULL)
+    {
+        security_user_check_secret(&dummy, secret);
+        return NULL;
+    }
+
+    return security_user_check_secret(user, secret) ? user : NULL;
+}
+
 int security_unload(http_security_settings_t *settings)
 {
     memset(settings->private_key, 0, strlen(settings->private_key));
@@ -137,40 +263,32 @@ void jwt_init(jwt_settings_t *settings)
 
 void jwt_cleanup(jwt_settings_t *settings)
 {
-    rest_list_entry_t *entry;
+    rest_hash_entry_t *entry;
 
     if (settings->secret_key != NULL)
     {
         free(settings->secret_key);
     }
 
-    for (entry = settings->users_list->head; entry != NULL; entry = entry->next)
+    for (entry = rest_hash_next(settings->users, NULL); entry != NULL;
+         entry = rest_hash_next(settings->users, entry))
     {
         security_user_delete((user_t *) entry->data);
     }
 
-    rest_list_delete(settings->users_list);
+    rest_hash_delete(settings->users);
+    settings->users = NULL;
+    settings->dummy_hash = NULL;
+
+    if (settings->cache != NULL)
+    {
+        jwt_cache_delete(settings->cache);
+        settings->cache = NULL;
+    }
     settings->initialised = false;
 }
 
 int security_user_check_scope(user_t *user, char *required_scope)
 {
-    size_t index;
-    json_t *j_scope_pattern;
-    const char *scope_pattern;
-    regex_t regex;
-
-    json_array_foreach(user->j_scope_list, index, j_scope_pattern)
-    {
-        scope_pattern = json_string_value(j_scope_pattern);
-
-        regcomp(&regex, scope_pattern, REG_EXTENDED);
-
-        if (regexec(&regex, required_scope, 0, NULL, 0) == 0)
-        {
-            return 0;
-        }
-    }
-
-    return 1;
+    return user_scope_allows(&user->scope, required_scope) ? 0 : 1;
 }
@@ -25,7 +25,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#include "rest-list.h"
+#include "jwt-cache.h"
+#include "rest-hash.h"
+#include "user-scope.h"
 
 enum
 {
@@ -51,7 +53,9 @@ typedef struct
 {
     char *name;
     char *secret;
+    char *secret_hash;
     json_t *j_scope_list;
+    user_scope_t scope;
 } user_t;
 
 typedef struct
@@ -60,8 +64,11 @@ typedef struct
     jwt_alg_t algorithm;
     unsigned char *secret_key;
     size_t secret_key_length;
-    rest_list_t *users_list;
+    rest_hash_t *users;
+    const char *dummy_hash;
     json_int_t expiration_time;
+    size_t cache_size;
+    jwt_cache_t *cache;
 } jwt_settings_t;
 
 typedef struct
@@ -80,9 +87,56 @@ void jwt_init(jwt_settings_t *settings);
 void jwt_cleanup(jwt_settings_t *settings);
 
 user_t *security_user_new();
-int security_user_set(user_t *user, const char *name, const char *secret, json_t *scope);
+int security_user_set(user_t *user, const char *name, const char *secret, const char *secret_hash,
+                      json_t *scope);
 void security_user_delete(user_t *user);
 
+/**
+ * Adds user to the user table, which takes over the user.
+ *
+ * @param[in]  settings  JWT settings
+ * @param[in]  user      User
+ *
+ * @return 0 on success, -1 if the name is taken or on allocation error
+ */
+int security_user_add(jwt_settings_t *settings, user_t *user);
+
+/**
+ * Finds user by exact name.
+ *
+ * @param[in]  settings  JWT settings
+ * @param[in]  name      User name
+ *
+ * @return User or NULL if not found
+ */
+user_t *security_user_find(jwt_settings_t *settings, const char *name);
+
+/**
+ * Checks user secret in constant time (with respect to the secret content).
+ * Users configured with a secret hash are checked with crypt(3).
+ *
+ * @param[in]  user    User
+ * @param[in]  secret  Secret given by the client
+ *
+ * @return true if the secret is correct
+ */
+bool security_user_check_secret(user_t *user, const char *secret);
+
+/**
+ * Finds user and checks its secret. Unknown user names are rejected only
+ * after checking the secret against a dummy user (with a secret hash of the
+ * same kind, if there is one), so response time does not reveal which names
+ * exist.
+ *
+ * @param[in]  settings  JWT settings
+ * @param[in]  name      User name
+ * @param[in]  secret    Secret given by the client
+ *
+ * @return User or NULL if the name or the secret is wrong
+ */
+user_t *security_user_authenticate(jwt_settings_t *settings, const char *name,
+                                   const char *secret);
+
 int security_user_check_scope(user_t *user, char *required_scope);
 
 #endif // SECURITY_H
@@ -51,6 +51,30 @@ static void set_coap_settings(json_t *j_section, coap_settings_t *settings)
         {
             settings->port = (uint16_t) json_integer_value(j_value);
         }
+        else if (strcasecmp(key, "connection_timeout") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->connection_timeout = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "shards") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0
+                && json_integer_value(j_value) <= COAP_MAX_SHARDS)
+            {
+                settings->shards = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be an integer from 1 to %d\n",
+                        section_name, key, COAP_MAX_SHARDS);
+            }
+        }
         else
         {
             fprintf(stdout, "Unrecognised configuration file key: %s.%s\n",
@@ -59,17 +83,17 @@ static void set_coap_settings(json_t *j_section, coap_settings_t *settings)
     }
 }
 
-static int set_user_settings(json_t *user_settings, rest_list_t *users_list)
+static int set_user_settings(json_t *user_settings, jwt_settings_t *settings)
 {
-    user_t *user, *user_entry;
-    rest_list_entry_t *entry;
-    json_t *j_name, *j_secret, *j_scope, *j_scope_value;
-    const char *user_name, *user_secret;
+    user_t *user;
+    json_t *j_name, *j_secret, *j_secret_hash, *j_scope, *j_scope_value;
+    const char *user_name, *user_secret = NULL, *user_secret_hash = NULL;
     char *scope_value;
     size_t user_name_length, user_secret_length, scope_length, scope_index;
 
     j_name = json_object_get(user_settings, "name");
     j_secret = json_object_get(user_settings, "secret");
+    j_secret_hash = json_object_get(user_settings, "secret_hash");
     j_scope = json_object_get(user_settings, "scope");
 
     if (!json_is_string(j_name) || strlen(json_string_value(j_name)) < 1)
@@ -86,29 +110,36 @@ static int set_user_settings(json_t *user_settings, rest_list_t *users_list)
         return 1;
     }
 
-    for (entry = users_list->head; entry != NULL; entry = entry->next)
+    if (security_user_find(settings, user_name) != NULL)
     {
-        user_entry = entry->data;
+        fprintf(stdout, "Found duplicate \"%s\" user name in config\n", user_name);
+        return 1;
+    }
 
-        if (strncmp(user_entry->name, user_name, J_MAX_LENGTH_USER_NAME) == 0)
+    if (json_is_string(j_secret_hash))
+    {
+        // Salted crypt(3) hash, e.g. "$6$salt$..." made by "mkpasswd -m sha-512"
+        user_secret_hash = json_string_value(j_secret_hash);
+        if (user_secret_hash[0] != '$')
         {
-            fprintf(stdout, "Found duplicate \"%s\" user name in config\n", user_name);
+            fprintf(stdout, "User \"%s\" secret hash is not in crypt(3) format\n", user_name);
             return 1;
         }
     }
-
-    if (!json_is_string(j_secret))
+    else if (!json_is_string(j_secret))
     {
         fprintf(stdout, "User \"%s\" configured without valid secret key.\n", user_name);
         return 1;
     }
-
-    user_secret = json_string_value(j_secret);
-    user_secret_length = strnlen(user_secret, J_MAX_LENGTH_USER_SECRET);
-    if (user_secret_length == J_MAX_LENGTH_USER_NAME)
+    else
     {
-        fprintf(stdout, "User secret length is invalid\n");
-        return 1;
+        user_secret = json_string_value(j_secret);
+        user_secret_length = strnlen(user_secret, J_MAX_LENGTH_USER_SECRET);
+        if (user_secret_length == J_MAX_LENGTH_USER_NAME)
+        {
+            fprintf(stdout, "User secret length is invalid\n");
+            return 1;
+        }
     }
 
     if (!json_is_array(j_scope))
@@ -135,10 +166,24 @@ static int set_user_settings(json_t *user_settings, rest_list_t *users_list)
     }
 
     user = security_user_new();
+    if (user == NULL)
+    {
+        return 1;
+    }
 
-    security_user_set(user, user_name, user_secret, j_scope);
+    if (security_user_set(user, user_name, user_secret, user_secret_hash, j_scope) != 0)
+    {
+        fprintf(stdout, "User \"%s\" scope list configuration is invalid\n", user_name);
+        security_user_delete(user);
+        return 1;
+    }
 
-    rest_list_add(users_list, user);
+    if (security_user_add(settings, user) != 0)
+    {
+        fprintf(stderr, "Failed to add user \"%s\"!\n", user_name);
+        security_user_delete(user);
+        return 1;
+    }
 
     return 0;
 }
@@ -201,6 +246,17 @@ static void set_jwt_settings(json_t *j_section, jwt_settings_t *settings)
             }
             memcpy(settings->secret_key, string_value, value_length);
         }
+        else if (strcasecmp(key, "cache_size") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->cache_size = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
         else if (strcasecmp(key, "users") == 0)
         {
             if (json_is_array(j_value))
@@ -209,7 +265,7 @@ static void set_jwt_settings(json_t *j_section, jwt_settings_t *settings)
                 {
                     if (json_is_object(j_user_settings))
                     {
-                        set_user_settings(j_user_settings, settings->users_list);
+                        set_user_settings(j_user_settings, settings);
                     }
                     else
                     {
@@ -228,6 +284,21 @@ static void set_jwt_settings(json_t *j_section, jwt_settings_t *settings)
                     section_name, key);
         }
     }
+
+    // Tokens verified with previous users or secret key must not be reused
+    if (settings->cache != NULL)
+    {
+        jwt_cache_delete(settings->cache);
+        settings->cache = NULL;
+    }
+    if (settings->cache_size > 0)
+    {
+        settings->cache = jwt_cache_new(settings->cache_size);
+        if (settings->cache == NULL)
+        {
+            fprintf(stderr, "Failed to allocate JWT cache!\n");
+        }
+    }
 }
 
 static void set_http_security_settings(json_t *j_section, http_security_settings_t *settings)
@@ -281,6 +352,37 @@ static void set_http_settings(json_t *j_section, http_settings_t *settings)
     }
 }
 
+static void set_logging_module_settings(json_t *j_modules, logging_settings_t *settings)
+{
+    const char *name;
+    json_t *j_level;
+    logging_module_t module;
+
+    if (!json_is_object(j_modules))
+    {
+        fprintf(stdout, "logging.modules must be an object\n");
+        return;
+    }
+
+    json_object_foreach(j_modules, name, j_level)
+    {
+        if (logging_module_parse(name, &module) != 0)
+        {
+            fprintf(stdout, "Unrecognised logging module: %s\n", name);
+        }
+        else if (!json_is_integer(j_level) || json_integer_value(j_level) < LOG_LEVEL_FATAL
+                 || json_integer_value(j_level) > LOG_LEVEL_TRACE)
+        {
+            fprintf(stdout, "logging.modules.%s must be a level from 0 to 5\n", name);
+        }
+        else
+        {
+            settings->module_levels[module] = (logging_level_t) json_integer_value(j_level);
+            settings->module_levels_set |= 1u << module;
+        }
+    }
+}
+
 static void set_logging_settings(json_t *j_section, logging_settings_t *settings)
 {
     const char *key;
@@ -293,6 +395,10 @@ static void set_logging_settings(json_t *j_section, logging_settings_t *settings
         {
             settings->level = (logging_level_t) json_integer_value(j_value);
         }
+        else if (strcasecmp(key, "modules") == 0)
+        {
+            set_logging_module_settings(j_value, settings);
+        }
         else if (strcasecmp(key, "timestamp") == 0)
         {
             if (json_is_boolean(j_value))
@@ -317,6 +423,281 @@ static void set_logging_settings(json_t *j_section, logging_settings_t *settings
                         section_name, key);
             }
         }
+        else if (strcasecmp(key, "async") == 0)
+        {
+            if (json_is_boolean(j_value))
+            {
+                settings->async = json_is_true(j_value) ? true : false;
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be set to a boolean value!\n",
+                        section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "overflow_policy") == 0)
+        {
+            if (json_is_string(j_value) && strcasecmp(json_string_value(j_value), "drop") == 0)
+            {
+                settings->overflow_policy = LOGGING_OVERFLOW_DROP;
+            }
+            else if (json_is_string(j_value)
+                     && strcasecmp(json_string_value(j_value), "block") == 0)
+            {
+                settings->overflow_policy = LOGGING_OVERFLOW_BLOCK;
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be \"drop\" or \"block\"\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "file") == 0)
+        {
+            if (json_is_string(j_value))
+            {
+                settings->file = (char *) json_string_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a file path\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "file_size") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->file_size = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "file_count") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->file_count = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
+        else
+        {
+            fprintf(stdout, "Unrecognised configuration file key: %s.%s\n",
+                    section_name, key);
+        }
+    }
+}
+
+static void set_notifications_settings(json_t *j_section, notifications_settings_t *settings)
+{
+    const char *key;
+    const char *section_name = "notifications";
+    const char *policy;
+    json_t *j_value;
+
+    json_object_foreach(j_section, key, j_value)
+    {
+        if (strcasecmp(key, "journal") == 0)
+        {
+            if (json_is_string(j_value))
+            {
+                settings->journal = (char *) json_string_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a directory path\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "journal_segment_size") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->journal_segment_size = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "journal_sync_interval") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->journal_sync_interval = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "memory_limit") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->memory_limit = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "count_limit") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->count_limit = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "overflow_policy") == 0)
+        {
+            policy = json_string_value(j_value);
+            if (policy != NULL && strcasecmp(policy, "drop-oldest") == 0)
+            {
+                settings->overflow_policy = REST_NOTIFICATION_POLICY_DROP_OLDEST;
+            }
+            else if (policy != NULL && strcasecmp(policy, "spill") == 0)
+            {
+                settings->overflow_policy = REST_NOTIFICATION_POLICY_SPILL;
+            }
+            else if (policy != NULL && strcasecmp(policy, "reject") == 0)
+            {
+                settings->overflow_policy = REST_NOTIFICATION_POLICY_REJECT;
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be one of \"drop-oldest\", \"spill\", \"reject\"\n",
+                        section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "callback_pool_size") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->callback_pool_size = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "callback_idle_timeout") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->callback_idle_timeout = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "max_batch_records") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->max_batch_records = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "max_batch_bytes") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->max_batch_bytes = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "max_linger_ms") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->max_linger_ms = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "callback_max_retries") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->callback_max_retries = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "callback_dead_letter_limit") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) >= 0)
+            {
+                settings->callback_dead_letter_limit = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a non-negative integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "callback_queue_limit") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->callback_queue_limit = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "stream_buffer_size") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->stream_buffer_size = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "spill_directory") == 0)
+        {
+            if (json_is_string(j_value))
+            {
+                settings->spill_directory = (char *) json_string_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a directory path\n", section_name, key);
+            }
+        }
+        else if (strcasecmp(key, "spill_limit") == 0)
+        {
+            if (json_is_integer(j_value) && json_integer_value(j_value) > 0)
+            {
+                settings->spill_limit = json_integer_value(j_value);
+            }
+            else
+            {
+                fprintf(stdout, "%s.%s must be a positive integer\n", section_name, key);
+            }
+        }
         else
         {
             fprintf(stdout, "Unrecognised configuration file key: %s.%s\n",
@@ -356,6 +737,10 @@ int read_config(char *config_name, settings_t *settings)
         {
             set_logging_settings(j_value, &settings->logging);
         }
+        else if (strcasecmp(section, "notifications") == 0)
+        {
+            set_notifications_settings(j_value, &settings->notifications);
+        }
         else
         {
             fprintf(stdout, "Unrecognised configuration file section: %s\n", section);
@@ -22,10 +22,12 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 #include <jansson.h>
 #include <argp.h>
 
 #include "logging.h"
+#include "rest-notification-log.h"
 #include "security.h"
 
 typedef struct
@@ -34,16 +36,42 @@ typedef struct
     http_security_settings_t security;
 } http_settings_t;
 
+#define COAP_MAX_SHARDS 256
+
 typedef struct
 {
     uint16_t port;
+    time_t connection_timeout;
+    size_t shards;
 } coap_settings_t;
 
+typedef struct
+{
+    char *journal;
+    size_t journal_segment_size;
+    int journal_sync_interval;
+    size_t memory_limit;
+    size_t count_limit;
+    rest_notification_policy_t overflow_policy;
+    char *spill_directory;
+    size_t spill_limit;
+    size_t callback_pool_size;
+    int callback_idle_timeout;
+    size_t max_batch_records;
+    size_t max_batch_bytes;
+    int max_linger_ms;
+    int callback_max_retries;
+    size_t callback_dead_letter_limit;
+    size_t callback_queue_limit;
+    size_t stream_buffer_size;
+} notifications_settings_t;
+
 typedef struct
 {
     http_settings_t http;
     coap_settings_t coap;
     logging_settings_t logging;
+    notifications_settings_t notifications;
 } settings_t;
 
 int read_config(char *config_name, settings_t *settings);
@@ -0,0 +1,138 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#include "user-scope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rest-hash.h"
+
+int user_scope_init(user_scope_t *scope, const char **patterns, size_t count)
+{
+    regex_t regex;
+    char *alternation, *position;
+    size_t i, length = 0;
+    int result;
+
+    memset(scope, 0, sizeof(user_scope_t));
+    scope->empty = true;
+    pthread_mutex_init(&scope->mutex, NULL);
+
+    // Patterns are validated one by one, so the invalid one can be reported
+    for (i = 0; i < count; i++)
+    {
+        if (regcomp(&regex, patterns[i], REG_EXTENDED | REG_NOSUB) != 0)
+        {
+            return i + 1;
+        }
+        regfree(&regex);
+
+        length += strlen(patterns[i]) + 3;
+    }
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    alternation = malloc(length);
+    if (alternation == NULL)
+    {
+        return -1;
+    }
+
+    // "(p1)|(p2)|..." matches wherever any of the patterns matches
+    position = alternation;
+    for (i = 0; i < count; i++)
+    {
+        position += sprintf(position, i == 0 ? "(%s)" : "|(%s)", patterns[i]);
+    }
+
+    result = regcomp(&scope->regex, alternation, REG_EXTENDED | REG_NOSUB);
+    free(alternation);
+    if (result != 0)
+    {
+        return -1;
+    }
+    scope->empty = false;
+
+    return 0;
+}
+
+void user_scope_cleanup(user_scope_t *scope)
+{
+    size_t i;
+
+    if (!scope->empty)
+    {
+        regfree(&scope->regex);
+    }
+
+    for (i = 0; i < USER_SCOPE_CACHE_SIZE; i++)
+    {
+        free(scope->decisions[i].scope);
+    }
+
+    pthread_mutex_destroy(&scope->mutex);
+    memset(scope, 0, sizeof(user_scope_t));
+}
+
+bool user_scope_allows(user_scope_t *scope, const char *required_scope)
+{
+    user_scope_decision_t *decision;
+    uint32_t hash;
+    char *copy;
+    bool allowed;
+
+    if (scope->empty)
+    {
+        return false;
+    }
+
+    hash = rest_hash_bytes(required_scope, strlen(required_scope));
+    decision = &scope->decisions[hash & (USER_SCOPE_CACHE_SIZE - 1)];
+
+    pthread_mutex_lock(&scope->mutex);
+    if (decision->scope != NULL && decision->hash == hash
+        && strcmp(decision->scope, required_scope) == 0)
+    {
+        allowed = decision->allowed;
+        pthread_mutex_unlock(&scope->mutex);
+
+        return allowed;
+    }
+    pthread_mutex_unlock(&scope->mutex);
+
+    allowed = regexec(&scope->regex, required_scope, 0, NULL, 0) == 0;
+
+    // Colliding scopes simply replace each other
+    copy = strdup(required_scope);
+    if (copy != NULL)
+    {
+        pthread_mutex_lock(&scope->mutex);
+        free(decision->scope);
+        decision->scope = copy;
+        decision->hash = hash;
+        decision->allowed = allowed;
+        pthread_mutex_unlock(&scope->mutex);
+    }
+
+    return allowed;
+}
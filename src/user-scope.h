@@ -0,0 +1,81 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef USER_SCOPE_H
+#define USER_SCOPE_H
+
+#include <pthread.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define USER_SCOPE_CACHE_SIZE 256
+
+typedef struct
+{
+    uint32_t hash;
+    char *scope;
+    bool allowed;
+} user_scope_decision_t;
+
+/*
+ * Scope patterns of a single user, compiled once into a single alternation,
+ * so a request scope is matched by one regexec() call. Recent decisions are
+ * kept in a small direct mapped cache, which is thread-safe.
+ */
+typedef struct
+{
+    bool empty;
+    regex_t regex;
+    pthread_mutex_t mutex;
+    user_scope_decision_t decisions[USER_SCOPE_CACHE_SIZE];
+} user_scope_t;
+
+/**
+ * Compiles scope patterns. The matcher must be released with
+ * user_scope_cleanup() even if compilation fails.
+ *
+ * @param[out] scope     Scope matcher
+ * @param[in]  patterns  POSIX extended regular expressions, a request scope
+ *                       ("METHOD url") is allowed if any of them matches it
+ * @param[in]  count     Number of patterns, no scope is allowed if it is zero
+ *
+ * @return 0 on success, index of the first invalid pattern + 1 if a pattern
+ *         is not valid, -1 on other errors
+ */
+int user_scope_init(user_scope_t *scope, const char **patterns, size_t count);
+
+/**
+ * Releases compiled patterns and cached decisions.
+ *
+ * @param[in]  scope  Scope matcher
+ */
+void user_scope_cleanup(user_scope_t *scope);
+
+/**
+ * Checks whether request scope is allowed.
+ *
+ * @param[in]  scope           Scope matcher
+ * @param[in]  required_scope  Request scope, "METHOD url"
+ *
+ * @return true if allowed
+ */
+bool user_scope_allows(user_scope_t *scope, const char *required_scope);
+
+#endif // USER_SCOPE_H
@@ -0,0 +1,157 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures async response ID generation throughput of the previous
+ * implementation (/dev/urandom opened for every ID, formatted with
+ * snprintf()) against rest_async_response_new(), on one and on several
+ * threads.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rest-core-types.h"
+
+#define BENCH_IDS 200000
+#define BENCH_THREADS 4
+
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static rest_async_response_t *bench_urandom_response_new(void)
+{
+    rest_async_response_t *response;
+    uint16_t r[6];
+    FILE *f;
+    size_t length;
+
+    response = calloc(1, sizeof(rest_async_response_t));
+    if (response == NULL)
+    {
+        return NULL;
+    }
+
+    f = fopen("/dev/urandom", "r");
+    if (f == NULL)
+    {
+        free(response);
+        return NULL;
+    }
+    length = fread(r, 1, sizeof(r), f);
+    fclose(f);
+
+    if (length != sizeof(r))
+    {
+        free(response);
+        return NULL;
+    }
+
+    snprintf(response->id, sizeof(response->id), "%u#%04x%04x-%04x-%04x-%04x-%04x",
+             (uint32_t)time(NULL), r[0], r[1], r[2], r[3], r[4], r[5]);
+
+    return response;
+}
+
+static void *bench_worker(void *context)
+{
+    rest_async_response_t *(*generate)(void) = context;
+    rest_async_response_t *response;
+    size_t i;
+
+    for (i = 0; i < BENCH_IDS; i++)
+    {
+        response = generate();
+        if (response == NULL)
+        {
+            return (void *)1;
+        }
+        rest_async_response_delete(response);
+    }
+
+    return NULL;
+}
+
+static int bench_run(const char *name, rest_async_response_t *(*generate)(void), int threads)
+{
+    pthread_t workers[BENCH_THREADS];
+    void *result;
+    double start, elapsed;
+    int i, failed = 0;
+
+    start = bench_now_s();
+    for (i = 0; i < threads; i++)
+    {
+        if (pthread_create(&workers[i], NULL, bench_worker, generate) != 0)
+        {
+            fprintf(stderr, "Failed to create thread\n");
+            return -1;
+        }
+    }
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], &result);
+        failed |= result != NULL;
+    }
+    elapsed = bench_now_s() - start;
+
+    if (failed)
+    {
+        fprintf(stderr, "Failed to generate ID\n");
+        return -1;
+    }
+
+    printf("%-20s %8d %16.0f\n", name, threads, threads * BENCH_IDS / elapsed);
+
+    return 0;
+}
+
+int main(void)
+{
+    rest_async_response_t *response = rest_async_response_new();
+
+    if (response == NULL)
+    {
+        return 1;
+    }
+    printf("Sample ID: %s\n\n", response->id);
+    rest_async_response_delete(response);
+
+    printf("%-20s %8s %16s\n", "generator", "threads", "IDs per second");
+
+    if (bench_run("fopen(/dev/urandom)", bench_urandom_response_new, 1) != 0
+        || bench_run("fopen(/dev/urandom)", bench_urandom_response_new, BENCH_THREADS) != 0
+        || bench_run("per-thread ChaCha20", rest_async_response_new, 1) != 0
+        || bench_run("per-thread ChaCha20", rest_async_response_new, BENCH_THREADS) != 0)
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures base64 encoding throughput of the previous byte-at-a-time
+ * encoder against rest_base64_encode() for payload sizes from 4 B to 64 KiB.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rest-base64.h"
+
+#define BENCH_BYTES (256 * 1024 * 1024)
+#define BENCH_MAX_SIZE (64 * 1024)
+
+static const size_t bench_sizes[] = { 4, 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+static const char *bench_table =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static size_t bench_legacy_encode(const uint8_t *data, size_t length, char *buffer)
+{
+    uint8_t previous_byte = 0;
+    size_t data_index, buffer_index = 0;
+
+    for (data_index = 0; data_index < length; data_index++)
+    {
+        switch (data_index % 3)
+        {
+        case 2:
+            buffer[buffer_index++] = bench_table[((previous_byte & 0x0f) << 2)
+                                                 + ((data[data_index] & 0xc0) >> 6)];
+            buffer[buffer_index++] = bench_table[data[data_index] & 0x3f];
+            break;
+        case 1:
+            buffer[buffer_index++] = bench_table[((previous_byte & 0x03) << 4)
+                                                 + ((data[data_index] & 0xf0) >> 4)];
+            break;
+        case 0:
+            buffer[buffer_index++] = bench_table[(data[data_index] & 0xfc) >> 2];
+            break;
+        }
+        previous_byte = data[data_index];
+    }
+
+    if ((data_index % 3) == 2)
+    {
+        buffer[buffer_index++] = bench_table[(previous_byte & 0x0f) << 2];
+        buffer[buffer_index++] = '=';
+    }
+    else if ((data_index % 3) == 1)
+    {
+        buffer[buffer_index++] = bench_table[(previous_byte & 0x03) << 4];
+        buffer[buffer_index++] = '=';
+        buffer[buffer_index++] = '=';
+    }
+
+    buffer[buffer_index] = '\0';
+
+    return buffer_index;
+}
+
+static double bench_run(size_t (*encode)(const uint8_t *, size_t, char *),
+                        const uint8_t *data, size_t size, char *output)
+{
+    size_t i, iterations = BENCH_BYTES / size;
+    size_t written = 0;
+    double start, elapsed;
+
+    start = bench_now_s();
+    for (i = 0; i < iterations; i++)
+    {
+        written += encode(data, size, output);
+    }
+    elapsed = bench_now_s() - start;
+
+    // Keeps the loop from being optimized away
+    if (written != iterations * rest_base64_encoded_length(size))
+    {
+        return -1;
+    }
+
+    return iterations * size / elapsed / (1024 * 1024);
+}
+
+int main(void)
+{
+    uint8_t *data = malloc(BENCH_MAX_SIZE);
+    char *expected = malloc(rest_base64_encoded_length(BENCH_MAX_SIZE) + 1);
+    char *output = malloc(rest_base64_encoded_length(BENCH_MAX_SIZE) + 1);
+    double legacy, current;
+    size_t i;
+
+    if (data == NULL || expected == NULL || output == NULL)
+    {
+        return 1;
+    }
+
+    srand(0);
+    for (i = 0; i < BENCH_MAX_SIZE; i++)
+    {
+        data[i] = rand();
+    }
+
+    printf("Implementation: %s\n\n", rest_base64_implementation());
+    printf("%8s %16s %16s\n", "size", "legacy (MiB/s)", "current (MiB/s)");
+
+    for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    {
+        bench_legacy_encode(data, bench_sizes[i], expected);
+        rest_base64_encode(data, bench_sizes[i], output);
+        if (strcmp(expected, output) != 0)
+        {
+            fprintf(stderr, "Encoding of %zu bytes differs\n", bench_sizes[i]);
+            return 1;
+        }
+
+        legacy = bench_run(bench_legacy_encode, data, bench_sizes[i], output);
+        current = bench_run(rest_base64_encode, data, bench_sizes[i], output);
+        printf("%8zu %16.0f %16.0f\n", bench_sizes[i], legacy, current);
+    }
+
+    free(data);
+    free(expected);
+    free(output);
+
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures client registry lookup latency for growing number of registered
+ * clients. Internal client IDs are 16-bit per LwM2M context, so larger fleets
+ * are spread over shards the same way the server does it, including the
+ * endpoint name to shard directory lookup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "client-registry.h"
+
+#define BENCH_LOOKUPS 1000000
+#define BENCH_SHARD_CLIENTS 65536
+#define BENCH_NAME_LENGTH 40
+
+static const size_t bench_sizes[] = { 1000, 10000, 100000, 1000000 };
+
+
+static double bench_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static int bench_run(size_t count)
+{
+    size_t shard_count = (count + BENCH_SHARD_CLIENTS - 1) / BENCH_SHARD_CLIENTS;
+    client_registry_t *registries;
+    rest_hash_t *directory;
+    lwm2m_client_t *clients;
+    char *names;
+    size_t i, index;
+    size_t found = 0;
+    double start, name_ns, id_ns;
+
+    registries = calloc(shard_count, sizeof(client_registry_t));
+    clients = calloc(count, sizeof(lwm2m_client_t));
+    names = malloc(count * BENCH_NAME_LENGTH);
+    directory = rest_hash_new();
+    if (registries == NULL || clients == NULL || names == NULL || directory == NULL)
+    {
+        fprintf(stderr, "Failed to allocate %zu clients\n", count);
+        return -1;
+    }
+
+    for (i = 0; i < shard_count; i++)
+    {
+        if (client_registry_init(&registries[i]) != 0)
+        {
+            fprintf(stderr, "Failed to initialise registry\n");
+            return -1;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        clients[i].name = names + i * BENCH_NAME_LENGTH;
+        snprintf(clients[i].name, BENCH_NAME_LENGTH, "urn:dev:bench-%zu", i);
+        clients[i].internalID = i / shard_count;
+
+        if (client_registry_add(&registries[i % shard_count], &clients[i]) != 0
+            || rest_hash_put(directory, clients[i].name, strlen(clients[i].name),
+                             &registries[i % shard_count]) != 0)
+        {
+            fprintf(stderr, "Failed to index client %zu\n", i);
+            return -1;
+        }
+    }
+
+    srand(count);
+
+    start = bench_now_ns();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        const char *name = clients[rand() % count].name;
+        client_registry_t *registry = rest_hash_get(directory, name, strlen(name));
+
+        found += client_registry_find_name(registry, name) != NULL;
+    }
+    name_ns = (bench_now_ns() - start) / BENCH_LOOKUPS;
+
+    start = bench_now_ns();
+    for (i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        index = rand() % count;
+        found += client_registry_find_id(&registries[index % shard_count],
+                                         clients[index].internalID) != NULL;
+    }
+    id_ns = (bench_now_ns() - start) / BENCH_LOOKUPS;
+
+    printf("%10zu %8zu %14.1f %14.1f\n", count, shard_count, name_ns, id_ns);
+
+    for (i = 0; i < shard_count; i++)
+    {
+        client_registry_cleanup(&registries[i]);
+    }
+    rest_hash_delete(directory);
+    free(registries);
+    free(clients);
+    free(names);
+
+    return found == 2 * BENCH_LOOKUPS ? 0 : -1;
+}
+
+int main(void)
+{
+    size_t i;
+
+    printf("%10s %8s %14s %14s\n", "clients", "shards", "by name (ns)", "by id (ns)");
+
+    for (i = 0; i < sizeof(bench_sizes) / sizeof(bench_sizes[0]); i++)
+    {
+        if (bench_run(bench_sizes[i]) != 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures serialization of a 100k notification batch by building a jansson
+ * tree and dumping it (the former callback/pull path) against the streaming
+ * rest_json_writer_t.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <jansson.h>
+
+#include "rest-base64.h"
+#include "rest-json.h"
+
+#define BENCH_RECORDS 100000
+#define BENCH_ROUNDS 10
+#define BENCH_PAYLOAD_SIZE 16
+
+// Every tenth notification is a registration, the rest are async responses
+#define BENCH_REGISTRATION_RATIO 10
+
+typedef struct
+{
+    int64_t timestamp;
+    char id[40];
+    int status;
+    uint8_t payload[BENCH_PAYLOAD_SIZE];
+    char name[32];
+} bench_record_t;
+
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static bool bench_is_registration(size_t index)
+{
+    return index % BENCH_REGISTRATION_RATIO == 0;
+}
+
+static char *bench_jansson(const bench_record_t *records, size_t count, size_t *length)
+{
+    json_t *jnotifs, *jnotif;
+    char *payload, *text;
+    size_t i;
+
+    jnotifs = json_pack("{s:[], s:[], s:[], s:[]}",
+                        "registrations", "reg-updates",
+                        "de-registrations", "async-responses");
+
+    for (i = 0; i < count; i++)
+    {
+        jnotif = json_object();
+        if (bench_is_registration(i))
+        {
+            json_object_set_new(jnotif, "name", json_string(records[i].name));
+            json_array_append_new(json_object_get(jnotifs, "registrations"), jnotif);
+            continue;
+        }
+
+        json_object_set_new(jnotif, "timestamp", json_integer(records[i].timestamp));
+        json_object_set_new(jnotif, "id", json_string(records[i].id));
+        json_object_set_new(jnotif, "status", json_integer(records[i].status));
+
+        payload = malloc(rest_base64_encoded_length(BENCH_PAYLOAD_SIZE) + 1);
+        rest_base64_encode(records[i].payload, BENCH_PAYLOAD_SIZE, payload);
+        json_object_set_new(jnotif, "payload", json_string(payload));
+        free(payload);
+
+        json_array_append_new(json_object_get(jnotifs, "async-responses"), jnotif);
+    }
+
+    text = json_dumps(jnotifs, JSON_COMPACT | JSON_PRESERVE_ORDER);
+    json_decref(jnotifs);
+
+    *length = text != NULL ? strlen(text) : 0;
+
+    return text;
+}
+
+static void bench_writer_group(rest_json_writer_t *writer, const bench_record_t *records,
+                               size_t count, const char *group, bool registrations)
+{
+    size_t i;
+
+    rest_json_key(writer, group);
+    rest_json_array_start(writer);
+    for (i = 0; i < count; i++)
+    {
+        if (bench_is_registration(i) != registrations)
+        {
+            continue;
+        }
+
+        rest_json_object_start(writer);
+        if (registrations)
+        {
+            rest_json_key(writer, "name");
+            rest_json_string(writer, records[i].name);
+        }
+        else
+        {
+            rest_json_key(writer, "timestamp");
+            rest_json_int(writer, records[i].timestamp);
+            rest_json_key(writer, "id");
+            rest_json_string(writer, records[i].id);
+            rest_json_key(writer, "status");
+            rest_json_int(writer, records[i].status);
+            rest_json_key(writer, "payload");
+            rest_json_base64(writer, records[i].payload, BENCH_PAYLOAD_SIZE);
+        }
+        rest_json_object_end(writer);
+    }
+    rest_json_array_end(writer);
+}
+
+static char *bench_writer(const bench_record_t *records, size_t count, size_t *length)
+{
+    rest_json_writer_t writer;
+
+    rest_json_writer_init(&writer);
+    rest_json_writer_reserve(&writer, count * 128);
+
+    rest_json_object_start(&writer);
+    bench_writer_group(&writer, records, count, "registrations", true);
+    rest_json_key(&writer, "reg-updates");
+    rest_json_array_start(&writer);
+    rest_json_array_end(&writer);
+    rest_json_key(&writer, "de-registrations");
+    rest_json_array_start(&writer);
+    rest_json_array_end(&writer);
+    bench_writer_group(&writer, records, count, "async-responses", false);
+    rest_json_object_end(&writer);
+
+    *length = writer.length;
+
+    return writer.data;
+}
+
+static double bench_run(char *(*serialize)(const bench_record_t *, size_t, size_t *),
+                        const bench_record_t *records, size_t *length)
+{
+    double start, best = 0;
+    char *text;
+    int round;
+
+    for (round = 0; round < BENCH_ROUNDS; round++)
+    {
+        start = bench_now_s();
+        text = serialize(records, BENCH_RECORDS, length);
+        start = bench_now_s() - start;
+        free(text);
+
+        if (best == 0 || start < best)
+        {
+            best = start;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    bench_record_t *records = calloc(BENCH_RECORDS, sizeof(bench_record_t));
+    size_t i, j, jansson_length, writer_length;
+    char *jansson_text, *writer_text;
+    double jansson, writer;
+
+    if (records == NULL)
+    {
+        return 1;
+    }
+
+    srand(0);
+    for (i = 0; i < BENCH_RECORDS; i++)
+    {
+        records[i].timestamp = 1500000000 + i;
+        snprintf(records[i].id, sizeof(records[i].id), "%zu#%08x-%04x-%04x-%04x-%04x",
+                 i, rand(), rand() & 0xffff, rand() & 0xffff, rand() & 0xffff, rand() & 0xffff);
+        records[i].status = 200;
+        for (j = 0; j < BENCH_PAYLOAD_SIZE; j++)
+        {
+            records[i].payload[j] = rand();
+        }
+        snprintf(records[i].name, sizeof(records[i].name), "eui64-%08x-76656438", rand());
+    }
+
+    // Both paths must produce identical documents
+    jansson_text = bench_jansson(records, BENCH_RECORDS, &jansson_length);
+    writer_text = bench_writer(records, BENCH_RECORDS, &writer_length);
+    if (jansson_text == NULL || writer_text == NULL || jansson_length != writer_length
+        || memcmp(jansson_text, writer_text, writer_length) != 0)
+    {
+        fprintf(stderr, "Serialized batches differ\n");
+        return 1;
+    }
+    free(jansson_text);
+    free(writer_text);
+
+    jansson = bench_run(bench_jansson, records, &jansson_length);
+    writer = bench_run(bench_writer, records, &writer_length);
+
+    printf("Batch of %d notifications, %zu bytes\n\n", BENCH_RECORDS, writer_length);
+    printf("%10s %12s %16s\n", "path", "time (ms)", "records/s");
+    printf("%10s %12.2f %16.0f\n", "jansson", jansson * 1000, BENCH_RECORDS / jansson);
+    printf("%10s %12.2f %16.0f\n", "writer", writer * 1000, BENCH_RECORDS / writer);
+
+    free(records);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+/*
+ * Punica - LwM2M server with REST API
+ * Copyright (C) 2018 8devices
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Measures scope checks of users with 1, 10 and 100 patterns: the previous
+ * compile-per-request matching against user_scope_allows() with distinct
+ * request scopes (decision cache misses) and with repeated ones (hits).
+ */
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "user-scope.h"
+
+#define BENCH_CHECKS 20000
+#define BENCH_SCOPES 4096
+#define BENCH_SCOPE_LENGTH 64
+
+static const size_t bench_pattern_counts[] = { 1, 10, 100 };
+
+
+static double bench_now_s(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Previous implementation, without the regfree() leak
+static bool bench_legacy_allows(const char **patterns, size_t count, const char *required_scope)
+{
+    regex_t regex;
+    size_t i;
+    int result;
+
+    for (i = 0; i < count; i++)
+    {
+        regcomp(&regex, patterns[i], REG_EXTENDED);
+        result = regexec(&regex, required_scope, 0, NULL, 0);
+        regfree(&regex);
+
+        if (result == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(void)
+{
+    static char scopes[BENCH_SCOPES][BENCH_SCOPE_LENGTH];
+    char *patterns[100];
+    user_scope_t scope;
+    size_t i, c, count, allowed;
+    double start, legacy, miss, hit;
+
+    // Only the last pattern matches, which is the worst case for the legacy loop
+    for (i = 0; i < BENCH_SCOPES; i++)
+    {
+        snprintf(scopes[i], BENCH_SCOPE_LENGTH, "GET /endpoints/device-%zu/3/0/0", i);
+    }
+
+    printf("%8s %18s %18s %18s\n", "patterns", "legacy (ns)", "cache miss (ns)",
+           "cache hit (ns)");
+
+    for (c = 0; c < sizeof(bench_pattern_counts) / sizeof(bench_pattern_counts[0]); c++)
+    {
+        count = bench_pattern_counts[c];
+        for (i = 0; i < count; i++)
+        {
+            patterns[i] = malloc(BENCH_SCOPE_LENGTH);
+            if (i + 1 < count)
+            {
+                snprintf(patterns[i], BENCH_SCOPE_LENGTH, "PUT /endpoints/group-%zu/.*", i);
+            }
+            else
+            {
+                snprintf(patterns[i], BENCH_SCOPE_LENGTH, "GET /endpoints/device-[0-9]+/.*");
+            }
+        }
+
+        if (user_scope_init(&scope, (const char **)patterns, count) != 0)
+        {
+            fprintf(stderr, "Failed to compile %zu patterns\n", count);
+            return 1;
+        }
+
+        allowed = 0;
+        start = bench_now_s();
+        for (i = 0; i < BENCH_CHECKS; i++)
+        {
+            allowed += bench_legacy_allows((const char **)patterns, count,
+                                           scopes[i % BENCH_SCOPES]);
+        }
+        legacy = (bench_now_s() - start) / BENCH_CHECKS * 1e9;
+
+        // Scopes outnumber the cache slots, so every check is evaluated
+        start = bench_now_s();
+        for (i = 0; i < BENCH_CHECKS; i++)
+        {
+            allowed += user_scope_allows(&scope, scopes[(i * 7919) % BENCH_SCOPES]);
+        }
+        miss = (bench_now_s() - start) / BENCH_CHECKS * 1e9;
+
+        start = bench_now_s();
+        for (i = 0; i < BENCH_CHECKS; i++)
+        {
+            allowed += user_scope_allows(&scope, scopes[0]);
+        }
+        hit = (bench_now_s() - start) / BENCH_CHECKS * 1e9;
+
+        // Keeps the loops from being optimized away
+        if (allowed != 3 * BENCH_CHECKS)
+        {
+            fprintf(stderr, "Scope decisions differ\n");
+            return 1;
+        }
+
+        printf("%8zu %18.0f %18.0f %18.0f\n", count, legacy, miss, hit);
+
+        user_scope_cleanup(&scope);
+        for (i = 0; i < count; i++)
+        {
+            free(patterns[i]);
+        }
+    }
+
+    return 0;
+}
@@ -44,6 +44,19 @@ describe('Endpoints interface', () => {
       });
   });
 
+  it('should list endpoints as CBOR when requested', (done) => {
+    chai.request(server)
+      .get('/endpoints')
+      .set('Accept', 'application/cbor')
+      .buffer()
+      .end((err, res) => {
+        should.not.exist(err);
+        res.should.have.status(200);
+        res.should.have.header('content-type', 'application/cbor');
+        done();
+      });
+  });
+
   it('should list all resources on /endpoints/{endpoint-name}', (done) => {
     chai.request(server)
       .get('/endpoints/' + client.name)
@@ -0,0 +1,94 @@
+const chai = require('chai');
+const chai_http = require('chai-http');
+const server = require('./server-if');
+
+const should = chai.should();
+chai.use(chai_http);
+
+describe('Logging', function () {
+  let levels;
+
+  before(function (done) {
+    server.start();
+
+    chai.request(server)
+      .get('/logging')
+      .end(function (err, res) {
+        should.not.exist(err);
+        levels = res.body.modules;
+
+        done();
+      });
+  });
+
+  after(function (done) {
+    // Server is shared with other specs
+    chai.request(server)
+      .put('/logging')
+      .set('Content-Type', 'application/json')
+      .send(JSON.stringify({modules: levels}))
+      .end(function (err, res) {
+        should.not.exist(err);
+        res.should.have.status(204);
+
+        done();
+      });
+  });
+
+  describe('GET /logging', function() {
+
+    it('should return 200 and module log levels', function(done) {
+      chai.request(server)
+        .get('/logging')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(200);
+
+          res.body.should.be.a('object');
+          res.body.should.have.property('level');
+          res.body.should.have.property('modules');
+          res.body.modules.should.have.property('jwt');
+          res.body.modules.should.have.property('monitor');
+
+          done();
+        });
+    });
+  });
+
+  describe('PUT /logging', function() {
+
+    it('should change module log level', function(done) {
+      chai.request(server)
+        .put('/logging')
+        .set('Content-Type', 'application/json')
+        .send('{"modules": {"observe": 4}}')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(204);
+
+          chai.request(server)
+            .get('/logging')
+            .end(function (err, res) {
+              should.not.exist(err);
+              res.should.have.status(200);
+              res.body.modules.observe.should.be.eql(4);
+
+              done();
+            });
+        });
+    });
+
+    it('should return 400 for unknown module', function(done) {
+      chai.request(server)
+        .put('/logging')
+        .set('Content-Type', 'application/json')
+        .send('{"modules": {"unknown": 4}}')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(400);
+
+          done();
+        });
+    });
+  });
+});
@@ -0,0 +1,37 @@
+const chai = require('chai');
+const chai_http = require('chai-http');
+const server = require('./server-if');
+
+const should = chai.should();
+chai.use(chai_http);
+
+describe('Metrics', function () {
+  before(function (done) {
+    server.start();
+
+    done();
+  });
+
+  after(function (done) {
+    done();
+  });
+
+  describe('GET /metrics', function() {
+
+    it('should return 200 and callback delivery metrics', function(done) {
+      chai.request(server)
+        .get('/metrics')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(200);
+
+          res.body.should.be.a('object');
+          res.body.should.have.property('callback.queue_depth');
+          res.body.should.have.property('callback.batches_delivered');
+          res.body.should.have.property('callback.delivery_latency_us_total');
+
+          done();
+        });
+    });
+  });
+});
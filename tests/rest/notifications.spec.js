@@ -155,6 +155,42 @@ describe('Notifications interface', function () {
         });
     });
 
+    it('should return 400 for invalid decode mode', function(done) {
+      chai.request(server)
+        .put('/notification/callback')
+        .set('Content-Type', 'application/json')
+        .send('{"url": "http://localhost:9999/my_callback", "headers": {}, "decode": "invalid"}')
+        .end(function (err, res) {
+          err.should.have.status(400);
+
+          done();
+        });
+    });
+
+    it('should return 400 for unsupported callback encoding', function(done) {
+      chai.request(server)
+        .put('/notification/callback')
+        .set('Content-Type', 'application/json')
+        .send('{"url": "http://localhost:9999/my_callback", "headers": {}, "accept": "text/plain"}')
+        .end(function (err, res) {
+          err.should.have.status(400);
+
+          done();
+        });
+    });
+
+    it('should return 400 for unsupported callback content encoding', function(done) {
+      chai.request(server)
+        .put('/notification/callback')
+        .set('Content-Type', 'application/json')
+        .send('{"url": "http://localhost:9999/my_callback", "headers": {}, "encoding": "br"}')
+        .end(function (err, res) {
+          err.should.have.status(400);
+
+          done();
+        });
+    });
+
     it('should return 400 for invalid url', function(done) {
       chai.request(server)
         .put('/notification/callback')
@@ -214,6 +250,156 @@ describe('Notifications interface', function () {
     });
   });
 
+  describe('PUT /notification/callbacks/:name', function() {
+
+    it('should return 201 and store named callback with its filter', function(done) {
+      const callback = {
+        url: 'http://localhost:9999/test_callback',
+        headers: {},
+        filter: {events: ['async-response'], endpoint: '^node-[0-9]+$', path: '/3303'},
+      };
+
+      chai.request(server)
+        .put('/notification/callbacks/alerts')
+        .set('Content-Type', 'application/json')
+        .send(JSON.stringify(callback))
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(201);
+
+          chai.request(server)
+            .get('/notification/callbacks')
+            .end(function (err, res) {
+              should.not.exist(err);
+              res.should.have.status(200);
+              res.body.should.deep.equal({alerts: callback});
+
+              done();
+            });
+        });
+    });
+
+    it('should return 400 for invalid filter', function(done) {
+      chai.request(server)
+        .put('/notification/callbacks/alerts')
+        .set('Content-Type', 'application/json')
+        .send('{"url": "http://localhost:9999/test_callback", "headers": {}, "filter": {"events": ["reboot"]}}')
+        .end(function (err, res) {
+          res.should.have.status(400);
+
+          chai.request(server)
+            .put('/notification/callbacks/alerts')
+            .set('Content-Type', 'application/json')
+            .send('{"url": "http://localhost:9999/test_callback", "headers": {}, "filter": {"endpoint": "("}}')
+            .end(function (err, res) {
+              res.should.have.status(400);
+
+              done();
+            });
+        });
+    });
+
+    it('should return 204 for deletion and 404 once deleted', function(done) {
+      chai.request(server)
+        .delete('/notification/callbacks/alerts')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(204);
+
+          chai.request(server)
+            .get('/notification/callbacks/alerts')
+            .end(function (err, res) {
+              res.should.have.status(404);
+
+              done();
+            });
+        });
+    });
+  });
+
+  describe('Callback delivery', function() {
+
+    it('should retry batch while the receiver answers 503', function(done) {
+      this.timeout(10000);
+
+      let requests = 0;
+      express_server.put('/test_callback_unavailable', (req, resp) => {
+        requests++;
+
+        // Probe is accepted, every batch is refused
+        if (requests === 1) {
+          resp.status(204).send();
+          return;
+        }
+
+        resp.status(503).send();
+
+        if (requests === 3) {
+          chai.request(server)
+            .delete('/notification/callbacks/unavailable')
+            .end(function (err, res) {
+              should.not.exist(err);
+              res.should.have.status(204);
+
+              done();
+            });
+        }
+      });
+
+      chai.request(server)
+        .put('/notification/callbacks/unavailable')
+        .set('Content-Type', 'application/json')
+        .send('{"url": "http://localhost:9999/test_callback_unavailable", "headers": {}, "filter": {"events": ["reg-update"]}}')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(201);
+
+          client.sendUpdate()
+            .catch((err) => {
+              should.not.exist(err);
+            });
+        });
+    });
+  });
+
+  describe('GET /notification/dead-letters', function() {
+
+    it('should return 200 and an empty dead-letter list', function(done) {
+      chai.request(server)
+        .get('/notification/dead-letters')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(200);
+          res.should.have.header('content-type', 'application/json');
+          res.body.should.be.a('array');
+          res.body.length.should.be.eql(0);
+
+          chai.request(server)
+            .post('/notification/dead-letters/replay')
+            .end(function (err, res) {
+              res.should.have.status(200);
+              res.body.should.be.eql({replayed: 0});
+
+              done();
+            });
+        });
+    });
+  });
+
+  describe('GET /notification/stream', function() {
+
+    it('should return 400 for an invalid event filter', function(done) {
+      chai.request(server)
+        .get('/notification/stream?events=registration,unknown')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(400);
+
+          done();
+        });
+    });
+  });
+
   describe('GET /notification/pull', function() {
 
     it('should return object and 200 for single pull', function(done) {
@@ -310,5 +496,58 @@ describe('Notifications interface', function () {
         });
       });
     });
+
+    it('should return ordered page of events for cursor pull', function(done) {
+      chai.request(server)
+        .get('/notification/pull?since=0&limit=1000')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(200);
+          res.should.have.header('content-type', 'application/json');
+
+          res.body.should.be.a('object');
+          res.body.should.have.property('oldest');
+          res.body.should.have.property('cursor');
+          res.body.should.have.property('notifications');
+          res.body['notifications'].should.be.a('array');
+          res.body['notifications'].length.should.be.above(0);
+
+          let previous = 0;
+          for (let i = 0; i < res.body['notifications'].length; i++) {
+            const notification = res.body['notifications'][i];
+            notification.should.have.property('seq');
+            notification.should.have.property('type');
+            notification['seq'].should.be.above(previous);
+            previous = notification['seq'];
+          }
+          res.body['cursor'].should.be.equal(previous);
+
+          chai.request(server)
+            .get('/notification/pull?since=0&limit=1')
+            .end(function (err, res) {
+              should.not.exist(err);
+              res.should.have.status(200);
+              res.body['notifications'].length.should.be.equal(1);
+
+              done();
+            });
+        });
+    });
+
+    it('should return 400 for invalid cursor pull parameters', function(done) {
+      chai.request(server)
+        .get('/notification/pull?since=abc')
+        .end(function (err, res) {
+          res.should.have.status(400);
+
+          chai.request(server)
+            .get('/notification/pull?since=0&limit=0')
+            .end(function (err, res) {
+              res.should.have.status(400);
+
+              done();
+            });
+        });
+    });
   });
 });
@@ -100,6 +100,36 @@ describe('Resources interface', function () {
         });
     });
 
+    it('response should contain decoded values instead of payload', function (done) {
+      var self = this;
+
+      chai.request(server)
+        .get('/endpoints/'+client.name+'/3/0/0?decode=values-only')
+        .end(function (err, res) {
+          should.not.exist(err);
+          res.should.have.status(202);
+
+          const id = res.body['async-response-id'];
+          self.events.on('async-response', resp => {
+            if (resp.id == id) {
+              resp.status.should.be.eql(200);
+              resp.should.not.have.property('payload');
+              resp.values.should.be.eql([{path: '/3/0/0', type: 'string', value: '8devices'}]);
+              done();
+            }
+          });
+        });
+    });
+
+    it('should return 400 for invalid decode mode', function (done) {
+      chai.request(server)
+        .get('/endpoints/'+client.name+'/3/0/0?decode=invalid')
+        .end(function (err, res) {
+          res.should.have.status(400);
+          done();
+        });
+    });
+
     it('response should return 404 for invalid resource-path', function (done) {
       var self = this;
 
@@ -471,6 +471,60 @@ describe('Secure connection', function () {
       authenticationRequest.end();
     });
 
+    it('should check scope of a repeatedly used access token', function(done) {
+      const credentials = '{"name": "put-all", "secret": "restricted-user"}';
+
+      const options = {
+        host: 'localhost',
+        port: '8889',
+        ca: [
+          fs.readFileSync('../../certificate.pem'),
+        ],
+      };
+
+      options.agent = new https.Agent(options);
+
+      options.path = '/authenticate';
+      options.method = 'POST';
+      options.headers = {
+        'Content-Type': 'application/json',
+      };
+
+      const authenticationRequest = https.request(options, (response) => {
+        let data = '';
+        response.statusCode.should.be.equal(201);
+
+        response.on('data', (chunk) => {
+          data = data + chunk;
+        });
+
+        response.on('end', () => {
+          const parsedBody = JSON.parse(data);
+
+          options.path = '/endpoints';
+          options.method = 'GET';
+          options.headers = {
+            'Authorization': 'Bearer ' + parsedBody['access_token'],
+          };
+
+          // Second request is served from the verified token cache
+          https.request(options, (response) => {
+            response.statusCode.should.be.equal(401);
+
+            https.request(options, (response) => {
+              response.statusCode.should.be.equal(401);
+              response.should.have.header('WWW-Authenticate', 'error="invalid_scope",error_description="The scope is invalid"');
+
+              done();
+            }).end();
+          }).end();
+        });
+      });
+
+      authenticationRequest.write(credentials);
+      authenticationRequest.end();
+    });
+
     it('should return error for invalid access token', function(done) {
       const options = {
         host: 'localhost',